@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/variant/apply_visitor.hpp>
+#include <boost/variant/get.hpp>
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+
+#include "codegen.h"
+#include "driver.h"
+#include "flatast.h"
+#include "parser.h"
+#include "synthetic.h"
+
+using namespace std;
+using namespace std::chrono;
+namespace po = boost::program_options;
+
+using namespace marklar;
+using namespace parser;
+
+
+namespace {
+
+	const string g_benchExe = "marklarc_bench.out";
+
+	struct bench_result {
+		string name;
+		string kind;
+		size_t bytes = 0;
+		size_t nodes = 0;
+		double parseSeconds = 0;
+
+		// Parsing into the flat AST as the driver does, the descent parser skips the tree then
+		double flatParseSeconds = 0;
+
+		// Negative when the step was skipped or failed
+		double codegenSeconds = -1;
+		double compileSeconds = -1;
+	};
+
+	// Counts every node of the AST, leaves included
+	class node_counter : public boost::static_visitor<size_t> {
+	public:
+		size_t operator()(const base_expr& expr) const { return 1 + list(expr.children); }
+		size_t operator()(const interned_string& expr) const { return 1; }
+		size_t operator()(const func_expr& expr) const { return 1 + list(expr.args) + list(expr.expressions); }
+		size_t operator()(const def_expr& expr) const { return 1; }
+		size_t operator()(const decl_expr& expr) const { return 1 + boost::apply_visitor(*this, expr.val); }
+		size_t operator()(const operator_expr& expr) const { return 1; }
+		size_t operator()(const return_expr& expr) const { return 1 + boost::apply_visitor(*this, expr.ret); }
+		size_t operator()(const call_expr& expr) const { return 1 + list(expr.values); }
+		size_t operator()(const if_expr& expr) const { return 1 + (*this)(expr.condition) + list(expr.thenBranch) + list(expr.elseBranch); }
+		size_t operator()(const while_loop& expr) const { return 1 + (*this)(expr.condition) + list(expr.loopBody); }
+		size_t operator()(const var_assign& expr) const { return 1 + boost::apply_visitor(*this, expr.varRhs); }
+		size_t operator()(const udf_type& expr) const { return 1 + list(expr.internalVars); }
+
+		size_t operator()(const binary_op& expr) const {
+			size_t count = 1 + boost::apply_visitor(*this, expr.lhs);
+			for (const auto& itr : expr.operation) {
+				count += boost::apply_visitor(*this, itr.rhs);
+			}
+			return count;
+		}
+
+	private:
+		size_t list(const vector<base_expr_node>& nodes) const {
+			size_t count = 0;
+			for (const auto& itr : nodes) {
+				count += boost::apply_visitor(*this, itr);
+			}
+			return count;
+		}
+	};
+
+	// Median wall time of the runs, the callable returns false when the step failed
+	template <typename step_t>
+	bool timeMedian(unsigned iterations, double& seconds, step_t step) {
+		vector<double> samples;
+		for (unsigned i = 0; i < iterations; ++i) {
+			const auto start = steady_clock::now();
+			if (!step()) {
+				return false;
+			}
+			samples.push_back(duration<double>(steady_clock::now() - start).count());
+		}
+
+		sort(samples.begin(), samples.end());
+		seconds = samples[samples.size() / 2];
+		return true;
+	}
+
+	bool generateCode(const base_expr_node& rootAst) {
+		llvm::LLVMContext context;
+		unique_ptr<llvm::Module> module(new llvm::Module("", context));
+		llvm::IRBuilder<> builder(context);
+
+		ast_codegen codeGenerator(&context, module.get(), builder, true);
+
+		const base_expr* expr = boost::get<base_expr>(&rootAst);
+		for (auto& itr : expr->children) {
+			boost::apply_visitor(codeGenerator, itr);
+		}
+
+		return !llvm::verifyModule(*module);
+	}
+
+	bool runBenchmark(const string& source, unsigned iterations, bool endToEnd, bench_result& result) {
+		result.bytes = source.size();
+
+		base_expr_node rootAst;
+		const bool parsed = timeMedian(iterations, result.parseSeconds, [&]() {
+			rootAst = base_expr_node();
+			return parse(source, rootAst);
+		});
+
+		if (!parsed) {
+			cerr << "Failed to parse '" << result.name << "'" << endl;
+			return false;
+		}
+
+		result.nodes = boost::apply_visitor(node_counter(), rootAst);
+
+		flat::ast flatAst;
+		timeMedian(iterations, result.flatParseSeconds, [&]() {
+			return parse(source, flatAst);
+		});
+
+		// Programs the code generator rejects are still useful for the parser numbers
+		const bool generated = timeMedian(iterations, result.codegenSeconds, [&]() {
+			return generateCode(rootAst);
+		});
+
+		if (!generated) {
+			cerr << "Failed to generate code for '" << result.name << "'" << endl;
+			result.codegenSeconds = -1;
+		} else if (endToEnd) {
+			if (!timeMedian(iterations, result.compileSeconds, [&]() { return driver::compileExecutable(source, g_benchExe); })) {
+				result.compileSeconds = -1;
+			}
+			boost::filesystem::remove(g_benchExe);
+		}
+
+		return true;
+	}
+
+	string optionalValue(double value) {
+		if (value < 0) {
+			return "null";
+		}
+
+		ostringstream out;
+		out << value;
+		return out.str();
+	}
+
+	void writeJson(ostream& out, const vector<bench_result>& results) {
+		out << "{\n\t\"benchmarks\": [";
+		for (size_t i = 0; i < results.size(); ++i) {
+			const bench_result& result = results[i];
+
+			out << (i > 0 ? "," : "") << "\n\t\t{";
+			out << "\"name\": \"" << result.name << "\", ";
+			out << "\"kind\": \"" << result.kind << "\", ";
+			out << "\"bytes\": " << result.bytes << ", ";
+			out << "\"nodes\": " << result.nodes << ", ";
+			out << "\"parse_seconds\": " << result.parseSeconds << ", ";
+			out << "\"parse_mb_per_s\": " << (result.bytes / 1e6) / max(result.parseSeconds, 1e-9) << ", ";
+			out << "\"parse_flat_seconds\": " << result.flatParseSeconds << ", ";
+			out << "\"codegen_seconds\": " << optionalValue(result.codegenSeconds) << ", ";
+			out << "\"codegen_ns_per_node\": " << optionalValue(result.codegenSeconds * 1e9 / max<size_t>(result.nodes, 1)) << ", ";
+			out << "\"compile_seconds\": " << optionalValue(result.compileSeconds);
+			out << "}";
+		}
+		out << "\n\t]\n}" << endl;
+	}
+
+}
+
+
+int main(int argc, char** argv) {
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help", "produce help message")
+		("input-dir", po::value<string>()->default_value("tests/inputFiles"), "directory of .mrk programs to benchmark")
+		("functions", po::value<vector<size_t>>()->multitoken(), "sizes of the synthetic programs in functions (default 10000 100000 1000000)")
+		("statements", po::value<size_t>()->default_value(8), "statements per synthetic function")
+		("depth", po::value<size_t>()->default_value(2), "nesting depth of the synthetic functions")
+		("iterations", po::value<unsigned>()->default_value(5), "runs per measurement, the median is reported")
+		("compile-max-functions", po::value<size_t>()->default_value(10000), "largest synthetic program also compiled end-to-end")
+		("parser", po::value<string>()->default_value("spirit"), "parser to measure, either spirit or descent")
+		("output", po::value<string>(), "write the JSON results to this file instead of stdout")
+		;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help") > 0) {
+		cout << desc << endl;
+		return 1;
+	}
+
+	const string parserName = vm["parser"].as<string>();
+	if (parserName == "descent") {
+		setParserBackend(parser_backend::descent);
+	} else if (parserName != "spirit") {
+		cerr << "Unknown parser '" << parserName << "', expected spirit or descent" << endl;
+		return 1;
+	}
+
+	const unsigned iterations = max(vm["iterations"].as<unsigned>(), 1u);
+	vector<bench_result> results;
+
+	// The checked in programs, sorted so runs line up across commits
+	vector<boost::filesystem::path> inputFiles;
+	const boost::filesystem::path inputDir(vm["input-dir"].as<string>());
+	if (boost::filesystem::is_directory(inputDir)) {
+		for (const auto& entry : boost::filesystem::directory_iterator(inputDir)) {
+			if (entry.path().extension() == ".mrk") {
+				inputFiles.push_back(entry.path());
+			}
+		}
+	}
+	sort(inputFiles.begin(), inputFiles.end());
+
+	for (const auto& inputFile : inputFiles) {
+		ifstream in(inputFile.string().c_str());
+		const string source(static_cast<stringstream const&>(stringstream() << in.rdbuf()).str());
+
+		bench_result result;
+		result.name = inputFile.stem().string();
+		result.kind = "input";
+
+		if (runBenchmark(source, iterations, true, result)) {
+			results.push_back(result);
+		}
+	}
+
+	bench::synthetic_options synthetic;
+	synthetic.statements = vm["statements"].as<size_t>();
+	synthetic.nestingDepth = vm["depth"].as<size_t>();
+
+	const vector<size_t> sizes = (vm.count("functions") > 0 ? vm["functions"].as<vector<size_t>>() : vector<size_t>{ 10000, 100000, 1000000 });
+	for (const size_t functions : sizes) {
+		synthetic.functions = functions;
+
+		bench_result result;
+		result.name = "synthetic-" + to_string(functions) + "x" + to_string(synthetic.statements) + "x" + to_string(synthetic.nestingDepth);
+		result.kind = "synthetic";
+
+		const bool endToEnd = (functions <= vm["compile-max-functions"].as<size_t>());
+		if (runBenchmark(bench::generateProgram(synthetic), iterations, endToEnd, result)) {
+			results.push_back(result);
+		}
+	}
+
+	if (vm.count("output") > 0) {
+		ofstream out(vm["output"].as<string>().c_str());
+		writeJson(out, results);
+	} else {
+		writeJson(cout, results);
+	}
+
+	return 0;
+}
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+
+#include "driver.h"
+
+using namespace std;
+using namespace std::chrono;
+namespace po = boost::program_options;
+
+using namespace marklar;
+
+
+namespace {
+
+	const string g_benchExe = "./marklarc_runbench.out";
+
+	struct run_sample {
+		double seconds = 0;
+
+		// Negative when the counter is unavailable
+		long long instructions = -1;
+	};
+
+	struct bench_result {
+		string name;
+		unsigned optLevel = 0;
+		uintmax_t binaryBytes = 0;
+		size_t runs = 0;
+		double medianSeconds = 0;
+		double p95Seconds = 0;
+		long long medianInstructions = -1;
+	};
+
+	// Counts user space instructions retired by the process once it calls exec, -1 if perf events
+	// are unsupported or not permitted (see /proc/sys/kernel/perf_event_paranoid)
+	int openInstructionCounter(pid_t pid) {
+#ifdef __linux__
+		perf_event_attr attr = {};
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+		attr.disabled = 1;
+		attr.enable_on_exec = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		return static_cast<int>(syscall(__NR_perf_event_open, &attr, pid, -1, -1, 0));
+#else
+		return -1;
+#endif
+	}
+
+	// Runs the executable once with its output discarded, the child blocks on a pipe until the
+	// counter is attached so only the program itself is measured
+	bool runOnce(const string& exe, run_sample& sample) {
+		int syncPipe[2];
+		if (pipe(syncPipe) != 0) {
+			cerr << "Failed to create pipe" << endl;
+			return false;
+		}
+
+		const pid_t pid = fork();
+		if (pid < 0) {
+			cerr << "Failed to fork" << endl;
+			close(syncPipe[0]);
+			close(syncPipe[1]);
+			return false;
+		}
+
+		if (pid == 0) {
+			close(syncPipe[1]);
+
+			char go;
+			if (read(syncPipe[0], &go, 1) != 1) {
+				_exit(126);
+			}
+			close(syncPipe[0]);
+
+			const int devNull = open("/dev/null", O_WRONLY);
+			dup2(devNull, STDOUT_FILENO);
+
+			execl(exe.c_str(), exe.c_str(), static_cast<char*>(nullptr));
+			_exit(127);
+		}
+
+		close(syncPipe[0]);
+		const int counter = openInstructionCounter(pid);
+
+		const auto start = steady_clock::now();
+		const bool started = (write(syncPipe[1], "x", 1) == 1);
+		close(syncPipe[1]);
+
+		int status = 0;
+		waitpid(pid, &status, 0);
+		sample.seconds = duration<double>(steady_clock::now() - start).count();
+
+		sample.instructions = -1;
+		if (counter >= 0) {
+			long long count = 0;
+			if (read(counter, &count, sizeof(count)) == sizeof(count)) {
+				sample.instructions = count;
+			}
+			close(counter);
+		}
+
+		// Some programs return what printf did, only a crash counts as a failure
+		if (!started || !WIFEXITED(status)) {
+			cerr << "'" << exe << "' terminated abnormally" << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	template <typename value_t>
+	value_t percentile(vector<value_t> values, double fraction) {
+		sort(values.begin(), values.end());
+
+		const size_t rank = static_cast<size_t>(fraction * values.size() + 0.999999);
+		return values[min(max<size_t>(rank, 1), values.size()) - 1];
+	}
+
+	bool runBenchmark(const string& source, unsigned warmup, unsigned iterations, bench_result& result) {
+		driver::compile_options options;
+		options.optLevel = result.optLevel;
+
+		if (!driver::compileExecutable(source, g_benchExe, options)) {
+			cerr << "Failed to compile '" << result.name << "' at -O" << result.optLevel << endl;
+			return false;
+		}
+
+		result.binaryBytes = boost::filesystem::file_size(g_benchExe);
+
+		vector<double> seconds;
+		vector<long long> instructions;
+		for (unsigned i = 0; i < warmup + iterations; ++i) {
+			run_sample sample;
+			if (!runOnce(g_benchExe, sample)) {
+				boost::filesystem::remove(g_benchExe);
+				return false;
+			}
+
+			if (i >= warmup) {
+				seconds.push_back(sample.seconds);
+				if (sample.instructions >= 0) {
+					instructions.push_back(sample.instructions);
+				}
+			}
+		}
+
+		boost::filesystem::remove(g_benchExe);
+
+		result.runs = seconds.size();
+		result.medianSeconds = percentile(seconds, 0.5);
+		result.p95Seconds = percentile(seconds, 0.95);
+		if (instructions.size() == seconds.size()) {
+			result.medianInstructions = percentile(instructions, 0.5);
+		}
+
+		return true;
+	}
+
+	void writeJson(ostream& out, const vector<bench_result>& results) {
+		out << "{\n\t\"benchmarks\": [";
+		for (size_t i = 0; i < results.size(); ++i) {
+			const bench_result& result = results[i];
+
+			out << (i > 0 ? "," : "") << "\n\t\t{";
+			out << "\"name\": \"" << result.name << "\", ";
+			out << "\"opt_level\": " << result.optLevel << ", ";
+			out << "\"binary_bytes\": " << result.binaryBytes << ", ";
+			out << "\"runs\": " << result.runs << ", ";
+			out << "\"median_seconds\": " << result.medianSeconds << ", ";
+			out << "\"p95_seconds\": " << result.p95Seconds << ", ";
+			out << "\"median_instructions\": ";
+			if (result.medianInstructions < 0) {
+				out << "null";
+			} else {
+				out << result.medianInstructions;
+			}
+			out << "}";
+		}
+		out << "\n\t]\n}" << endl;
+	}
+
+}
+
+
+int main(int argc, char** argv) {
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help", "produce help message")
+		("input-dir", po::value<string>()->default_value("tests/inputFiles"), "directory of the euler*.mrk programs")
+		("opt-levels", po::value<vector<unsigned>>()->multitoken(), "optimization levels to compare (default 0 1 2 3)")
+		("warmup", po::value<unsigned>()->default_value(1), "untimed runs before measuring")
+		("iterations", po::value<unsigned>()->default_value(5), "timed runs of each executable")
+		("output", po::value<string>(), "write the JSON results to this file instead of stdout")
+		;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help") > 0) {
+		cout << desc << endl;
+		return 1;
+	}
+
+	const unsigned warmup = vm["warmup"].as<unsigned>();
+	const unsigned iterations = max(vm["iterations"].as<unsigned>(), 1u);
+	const vector<unsigned> optLevels = (vm.count("opt-levels") > 0 ? vm["opt-levels"].as<vector<unsigned>>() : vector<unsigned>{ 0, 1, 2, 3 });
+	for (const unsigned optLevel : optLevels) {
+		if (optLevel > 3) {
+			cerr << "Unknown optimization level '" << optLevel << "', expected 0 to 3" << endl;
+			return 1;
+		}
+	}
+
+	vector<boost::filesystem::path> inputFiles;
+	const boost::filesystem::path inputDir(vm["input-dir"].as<string>());
+	if (boost::filesystem::is_directory(inputDir)) {
+		for (const auto& entry : boost::filesystem::directory_iterator(inputDir)) {
+			const string fileName = entry.path().filename().string();
+			if (fileName.compare(0, 5, "euler") == 0 && entry.path().extension() == ".mrk") {
+				inputFiles.push_back(entry.path());
+			}
+		}
+	}
+	sort(inputFiles.begin(), inputFiles.end());
+
+	vector<bench_result> results;
+	for (const auto& inputFile : inputFiles) {
+		ifstream in(inputFile.string().c_str());
+		const string source(static_cast<stringstream const&>(stringstream() << in.rdbuf()).str());
+
+		for (const unsigned optLevel : optLevels) {
+			bench_result result;
+			result.name = inputFile.stem().string();
+			result.optLevel = optLevel;
+
+			if (runBenchmark(source, warmup, iterations, result)) {
+				results.push_back(result);
+			}
+		}
+	}
+
+	if (vm.count("output") > 0) {
+		ofstream out(vm["output"].as<string>().c_str());
+		writeJson(out, results);
+	} else {
+		writeJson(cout, results);
+	}
+
+	return 0;
+}
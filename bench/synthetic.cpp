@@ -0,0 +1,91 @@
+#include "synthetic.h"
+
+#include <sstream>
+
+
+using namespace std;
+
+namespace {
+
+	string indent(size_t depth) {
+		return string(depth + 1, '\t');
+	}
+
+	// Alternates between the statement kinds the code generator handles so every visitor gets exercised
+	void writeStatement(ostringstream& out, size_t func, size_t index, size_t depth) {
+		const string var = "v" + to_string(index);
+
+		switch (index % 4) {
+			case 0:
+				out << indent(depth) << "i64 " << var << " = a + " << (func + index) << ";\n";
+				break;
+
+			case 1:
+				out << indent(depth) << "i64 " << var << " = (a * " << (index + 3) << ") >> 1;\n";
+				break;
+
+			case 2:
+				out << indent(depth) << "a = (a % 65521) - " << index << ";\n";
+				break;
+
+			default:
+				out << indent(depth) << "a = (a & 1023) + " << (index % 7) << ";\n";
+				break;
+		}
+	}
+
+	void writeBlock(ostringstream& out, const bench::synthetic_options& options, size_t func, size_t depth) {
+		if (depth == options.nestingDepth) {
+			for (size_t i = 0; i < options.statements; ++i) {
+				writeStatement(out, func, i, depth);
+			}
+			return;
+		}
+
+		// Loops shrink 'a' so the generated programs also terminate when run
+		if (depth % 2 == 0) {
+			out << indent(depth) << "if (a > " << depth << ") {\n";
+			writeBlock(out, options, func, depth + 1);
+			out << indent(depth) << "} else {\n";
+			out << indent(depth + 1) << "a = a + 1;\n";
+			out << indent(depth) << "}\n";
+		} else {
+			out << indent(depth) << "while (a > 4096) {\n";
+			out << indent(depth + 1) << "a = a >> 1;\n";
+			writeBlock(out, options, func, depth + 1);
+			out << indent(depth) << "}\n";
+		}
+	}
+
+}
+
+namespace bench {
+
+	string generateProgram(const synthetic_options& options) {
+		ostringstream out;
+
+		for (size_t func = 0; func < options.functions; ++func) {
+			out << "i64 f" << func << "(i64 n) {\n";
+			out << "\ti64 a = n;\n";
+			writeBlock(out, options, func, 0);
+
+			// Binary ops take the type of their left operand, keep an i64 there rather than a literal
+			if (func > 0) {
+				out << "\ta = a + f" << (func - 1) << "(a & 255);\n";
+			}
+			out << "\treturn a;\n";
+			out << "}\n\n";
+		}
+
+		out << "i64 main() {\n";
+		if (options.functions > 0) {
+			out << "\ti64 result = f" << (options.functions - 1) << "(7);\n";
+		}
+		out << "\treturn 0;\n";
+		out << "}\n";
+
+		return out.str();
+	}
+
+}
+
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+
+namespace bench {
+
+	struct synthetic_options {
+		// Number of functions besides main, each one calls the previous
+		size_t functions = 10000;
+
+		// Statements generated at the innermost level of every function
+		size_t statements = 8;
+
+		// Depth of the if/while blocks wrapped around the statements
+		size_t nestingDepth = 2;
+	};
+
+	// Generates a valid Marklar program with the given shape, the output only depends on the options
+	std::string generateProgram(const synthetic_options& options);
+
+}
+
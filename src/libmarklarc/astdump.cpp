@@ -0,0 +1,166 @@
+#include "astdump.h"
+
+#include <boost/variant/apply_visitor.hpp>
+
+
+using namespace parser;
+using namespace std;
+
+namespace {
+
+	/* Appends every node as "(kind fields... children...)". Leaves are written verbatim, this is
+	 * unambiguous since names and numbers never contain spaces, parentheses or quotes and quoted
+	 * strings can't contain quotes.
+	 */
+	class ast_dumper : public boost::static_visitor<void> {
+	public:
+		explicit ast_dumper(string& out)
+		: m_out(out) {}
+
+		void operator()(const base_expr& expr) {
+			open("root");
+			list(expr.children);
+			close();
+		}
+
+		void operator()(const interned_string& expr) {
+			m_out += ' ';
+			m_out += expr.str();
+		}
+
+		void operator()(const func_expr& expr) {
+			open("func");
+			(*this)(expr.returnType);
+			(*this)(expr.functionName);
+			open("args");
+			list(expr.args);
+			close();
+			list(expr.expressions);
+			close();
+		}
+
+		void operator()(const def_expr& expr) {
+			open("def");
+			(*this)(expr.typeName);
+			(*this)(expr.defName);
+			close();
+		}
+
+		void operator()(const decl_expr& expr) {
+			open("decl");
+			(*this)(expr.typeName);
+			(*this)(expr.declName);
+			boost::apply_visitor(*this, expr.val);
+			close();
+		}
+
+		void operator()(const operator_expr& expr) {
+			open("operator");
+			(*this)(expr.valLHS);
+			for (const auto& itr : expr.op_and_valRHS) {
+				(*this)(itr);
+			}
+			close();
+		}
+
+		void operator()(const return_expr& expr) {
+			open("return");
+			boost::apply_visitor(*this, expr.ret);
+			close();
+		}
+
+		void operator()(const call_expr& expr) {
+			open("call");
+			(*this)(expr.funcName);
+			list(expr.values);
+			close();
+		}
+
+		void operator()(const if_expr& expr) {
+			open("if");
+			(*this)(expr.condition);
+			open("then");
+			list(expr.thenBranch);
+			close();
+			open("else");
+			list(expr.elseBranch);
+			close();
+			close();
+		}
+
+		void operator()(const binary_op& expr) {
+			open("op");
+			boost::apply_visitor(*this, expr.lhs);
+			for (const auto& itr : expr.operation) {
+				// Quoted, the operator may legitimately be empty
+				m_out += " '" + itr.op.str() + "'";
+				boost::apply_visitor(*this, itr.rhs);
+			}
+			close();
+		}
+
+		void operator()(const while_loop& expr) {
+			open("while");
+			(*this)(expr.condition);
+			list(expr.loopBody);
+			close();
+		}
+
+		void operator()(const var_assign& expr) {
+			open("assign");
+			(*this)(expr.varName);
+			boost::apply_visitor(*this, expr.varRhs);
+			close();
+		}
+
+		void operator()(const udf_type& expr) {
+			open("type");
+			(*this)(expr.typeName);
+			list(expr.internalVars);
+			close();
+		}
+
+	private:
+		void open(const char* kind) {
+			if (!m_out.empty()) {
+				m_out += ' ';
+			}
+			m_out += '(';
+			m_out += kind;
+		}
+
+		void close() {
+			m_out += ')';
+		}
+
+		void list(const vector<base_expr_node>& nodes) {
+			for (const auto& itr : nodes) {
+				boost::apply_visitor(*this, itr);
+			}
+		}
+
+		string& m_out;
+	};
+
+}
+
+namespace marklar {
+
+	string dumpAst(const base_expr_node& node) {
+		string out;
+		ast_dumper dumper(out);
+		boost::apply_visitor(dumper, node);
+
+		return out;
+	}
+
+	string dumpAst(const func_expr& func) {
+		string out;
+		ast_dumper dumper(out);
+		dumper(func);
+
+		return out;
+	}
+
+}
+
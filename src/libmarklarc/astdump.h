@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+#include "parser.h"
+
+
+namespace marklar {
+
+	// Renders the AST as a canonical s-expression, two trees are equal exactly when their dumps are
+	std::string dumpAst(const parser::base_expr_node& node);
+
+	std::string dumpAst(const parser::func_expr& func);
+
+}
+
@@ -0,0 +1,847 @@
+#include "bytecode.h"
+
+#include <cstring>
+#include <map>
+#include <sstream>
+
+#include <boost/variant/get.hpp>
+
+#include "callgraph.h"
+#include "literal.h"
+#include "location.h"
+#include "operators.h"
+#include "precompiled.h"
+#include "profiler.h"
+
+
+using namespace marklar;
+using namespace marklar::bytecode;
+using namespace parser;
+using namespace std;
+
+
+namespace {
+
+	const char* const opcodeNames[] = {
+#define MARKLAR_BYTECODE_NAME(name, operands) #name,
+		MARKLAR_BYTECODE_OPCODES(MARKLAR_BYTECODE_NAME)
+#undef MARKLAR_BYTECODE_NAME
+	};
+
+	const char* const opcodeOperands[] = {
+#define MARKLAR_BYTECODE_OPERANDS(name, operands) operands,
+		MARKLAR_BYTECODE_OPCODES(MARKLAR_BYTECODE_OPERANDS)
+#undef MARKLAR_BYTECODE_OPERANDS
+	};
+
+	// Characters allowed between the '%' and the conversion of a printf specification
+	const char* const printfSpecifierChars = "-+ #0123456789.hljzt";
+
+	bool convertMarklarType(interned_string typeName, value_type& type) {
+		static const interned_string i32Type("i32");
+		static const interned_string i64Type("i64");
+
+		if (typeName == i32Type) {
+			type = value_type::i32;
+		} else if (typeName == i64Type) {
+			type = value_type::i64;
+		} else {
+			return false;
+		}
+
+		return true;
+	}
+
+	unsigned bitWidth(value_type type) {
+		switch (type) {
+			case value_type::i1:  return 1;
+			case value_type::i32: return 32;
+			default:              return 64;
+		}
+	}
+
+	// Opcode computing op on operands of the type. The i1 values of comparisons are handled by the
+	// 32-bit variants, with the result truncated afterwards
+	opcode selectOpcode(binary_operator op, value_type type) {
+		const bool wide = (type == value_type::i64);
+
+		switch (op) {
+			case binary_operator::add:          return (wide ? opcode::add64 : opcode::add32);
+			case binary_operator::sub:          return (wide ? opcode::sub64 : opcode::sub32);
+			case binary_operator::mult:         return (wide ? opcode::mult64 : opcode::mult32);
+			case binary_operator::div:          return (wide ? opcode::div64 : opcode::div32);
+			case binary_operator::rem:          return (wide ? opcode::rem64 : opcode::rem32);
+			case binary_operator::lessThan:     return (wide ? opcode::lessThan64 : opcode::lessThan32);
+			case binary_operator::greaterThan:  return (wide ? opcode::greaterThan64 : opcode::greaterThan32);
+			case binary_operator::lessEqual:    return (wide ? opcode::lessEqual64 : opcode::lessEqual32);
+			case binary_operator::greaterEqual: return (wide ? opcode::greaterEqual64 : opcode::greaterEqual32);
+			case binary_operator::equal:        return opcode::equal;
+			case binary_operator::notEqual:     return opcode::notEqual;
+			case binary_operator::shiftLeft:    return (wide ? opcode::shiftLeft64 : opcode::shiftLeft32);
+			case binary_operator::shiftRight:   return (wide ? opcode::shiftRight64 : opcode::shiftRight32);
+			case binary_operator::logicalOr:    return opcode::bitOr;
+			default:                            return opcode::bitAnd;
+		}
+	}
+
+	// Register and type of a value, temporary when the register was allocated just to hold it
+	struct operand {
+		uint16_t reg = 0;
+		value_type type = value_type::i32;
+		bool temporary = false;
+	};
+
+	// Name or literal the node consists of, arguments come wrapped in a binary_op without operations
+	const interned_string* nameOf(const base_expr_node& node) {
+		if (const binary_op* op = boost::get<binary_op>(&node)) {
+			return (op->operation.empty() ? nameOf(op->lhs) : nullptr);
+		}
+
+		return boost::get<interned_string>(&node);
+	}
+
+	struct signature {
+		uint16_t index;
+		vector<value_type> argTypes;
+		value_type returnType;
+	};
+
+	/* Lowers the functions of the AST to bytecode one at a time. Locals and temporaries are
+	 * allocated from the function's registers like a stack, so the temporaries of a statement are
+	 * released once it's compiled and the locals of a branch or loop body when it goes out of scope.
+	 */
+	class bytecode_compiler {
+	public:
+		static constexpr int noRegister = -1;
+
+		bytecode_compiler(module& out, string_view source, const vector<const precompiled_module*>& libraries)
+		: m_module(out), m_source(source), m_libraries(libraries) {}
+
+		bool declare(const func_expr& func) {
+			const location_scope at(*this, func.location);
+
+			signature sig;
+			if (!nextFunctionIndex(sig.index)) {
+				return false;
+			}
+
+			if (!convertMarklarType(func.returnType, sig.returnType)) {
+				cerr << errorLocation() << "Unknown type: '" << func.returnType << "'" << endl;
+				return false;
+			}
+
+			for (const auto& arg : func.args) {
+				const def_expr& def = boost::get<def_expr>(arg);
+
+				value_type argType;
+				if (!convertMarklarType(def.typeName, argType)) {
+					cerr << errorLocation() << "Unknown type: '" << def.typeName << "'" << endl;
+					return false;
+				}
+
+				sig.argTypes.push_back(argType);
+			}
+
+			if (!m_signatures.emplace(func.functionName, sig).second) {
+				cerr << errorLocation() << "Error: Function '" << func.functionName << "' is defined more than once" << endl;
+				return false;
+			}
+
+			bytecode::function f;
+			f.name = func.functionName.str();
+			f.argTypes = sig.argTypes;
+			f.returnType = sig.returnType;
+			m_module.functions.push_back(std::move(f));
+
+			return true;
+		}
+
+		bool compileFunction(const func_expr& func) {
+			profiler::scope timer("function", func.functionName);
+			const location_scope at(*this, func.location);
+
+			m_function = &m_module.functions[m_signatures.at(func.functionName).index];
+			m_locals.clear();
+			m_nextRegister = 0;
+
+			for (size_t i = 0; i < func.args.size(); ++i) {
+				const def_expr& def = boost::get<def_expr>(func.args[i]);
+
+				if (findLocal(def.defName)) {
+					cerr << errorLocation() << "Error: Definition of '" << def.defName << "' already exists" << endl;
+					return false;
+				}
+
+				m_locals.push_back(local{ def.defName, allocateRegister(), m_function->argTypes[i] });
+			}
+
+			bool returned = false;
+			if (!compileBlock(func.expressions, returned)) {
+				return false;
+			}
+
+			// Falling off the end returns 0, like the return value codegen initializes
+			if (!returned) {
+				const uint16_t zero = allocateRegister();
+				emit(opcode::loadConstant, zero);
+				emit(opcode::ret, zero);
+			}
+
+			if (m_nextRegisterMax > UINT16_MAX) {
+				cerr << errorLocation() << "Error: Function '" << func.functionName << "' needs too many registers" << endl;
+				return false;
+			}
+
+			m_function->registerCount = m_nextRegisterMax;
+			m_nextRegisterMax = 0;
+
+			return true;
+		}
+
+	private:
+		struct local {
+			interned_string name;
+			uint16_t reg;
+			value_type type;
+		};
+
+		// Releases the locals and registers allocated within a block
+		class block_scope {
+		public:
+			explicit block_scope(bytecode_compiler& compiler)
+			: m_compiler(compiler), m_localCount(compiler.m_locals.size()), m_nextRegister(compiler.m_nextRegister) {}
+
+			~block_scope() {
+				m_compiler.m_locals.resize(m_localCount);
+				m_compiler.m_nextRegister = m_nextRegister;
+			}
+
+		private:
+			bytecode_compiler& m_compiler;
+			const size_t m_localCount;
+			const unsigned m_nextRegister;
+		};
+
+		// Tracks the node being compiled for error messages
+		class location_scope {
+		public:
+			location_scope(bytecode_compiler& compiler, source_span location)
+			: m_compiler(compiler), m_previous(compiler.m_location) {
+				if (location.valid()) {
+					compiler.m_location = location;
+				}
+			}
+
+			~location_scope() {
+				m_compiler.m_location = m_previous;
+			}
+
+		private:
+			bytecode_compiler& m_compiler;
+			const source_span m_previous;
+		};
+
+		string errorLocation() const {
+			if (m_source.empty() || !m_location.valid()) {
+				return "";
+			}
+
+			return describeLocation(m_source, m_location) + ": ";
+		}
+
+		// Calls refer to the functions with 16 bits, the imports come after the module's own functions
+		bool nextFunctionIndex(uint16_t& index) {
+			const size_t next = m_module.functions.size() + m_module.imports.size();
+			if (next > UINT16_MAX) {
+				cerr << errorLocation() << "Error: Too many functions" << endl;
+				return false;
+			}
+
+			index = static_cast<uint16_t>(next);
+			return true;
+		}
+
+		// Adds the signature of a function the first library defining it has, false if none does
+		bool importFunction(interned_string name) {
+			for (const precompiled_module* library : m_libraries) {
+				const precompiled_function* func = library->findFunction(name.str());
+				if (!func) {
+					continue;
+				}
+
+				signature sig;
+				if (!nextFunctionIndex(sig.index)) {
+					return false;
+				}
+
+				bytecode::import imported;
+				imported.name = name.str();
+				imported.returnType = func->returnType;
+				for (uint32_t i = 0; i < func->argCount; ++i) {
+					imported.argTypes.push_back(library->argType(func->firstArgType + i));
+				}
+
+				sig.argTypes = imported.argTypes;
+				sig.returnType = imported.returnType;
+
+				m_module.imports.push_back(std::move(imported));
+				m_signatures.emplace(name, sig);
+
+				return true;
+			}
+
+			return false;
+		}
+
+		const local* findLocal(interned_string name) const {
+			for (auto itr = m_locals.rbegin(); itr != m_locals.rend(); ++itr) {
+				if (itr->name == name) {
+					return &*itr;
+				}
+			}
+
+			return nullptr;
+		}
+
+		uint16_t allocateRegister() {
+			const unsigned reg = m_nextRegister++;
+			m_nextRegisterMax = max(m_nextRegisterMax, m_nextRegister);
+
+			// Checked once the function is done, until then the index just wraps
+			return static_cast<uint16_t>(reg);
+		}
+
+		size_t emit(opcode op, uint16_t a = 0, uint16_t b = 0, uint16_t c = 0, uint32_t imm = 0) {
+			instruction inst;
+			inst.op = op;
+			inst.a = a;
+			inst.b = b;
+			inst.c = c;
+			inst.imm = imm;
+
+			m_function->code.push_back(inst);
+			return m_function->code.size() - 1;
+		}
+
+		// Points an earlier jump at the next instruction
+		void patchJump(size_t jump) {
+			m_function->code[jump].imm = static_cast<uint32_t>(m_function->code.size());
+		}
+
+		// Zero extending is free, so only narrowing takes an instruction
+		operand castToType(operand value, value_type type, int dest) {
+			if (bitWidth(value.type) > bitWidth(type)) {
+				const uint16_t target = (dest != noRegister ? dest : (value.temporary ? value.reg : allocateRegister()));
+				emit(type == value_type::i1 ? opcode::truncate1 : opcode::truncate32, target, value.reg);
+
+				value.reg = target;
+				value.temporary = (dest == noRegister);
+			} else if (dest != noRegister && value.reg != dest) {
+				emit(opcode::move, dest, value.reg);
+				value.reg = dest;
+			}
+
+			value.type = type;
+			return value;
+		}
+
+		// Each statement is compiled with its own temporaries. returned is set once every path
+		// through the block has returned, the statements after that are left out like codegen does
+		bool compileBlock(const vector<base_expr_node>& statements, bool& returned) {
+			returned = false;
+
+			for (const auto& statement : statements) {
+				const unsigned mark = m_nextRegister;
+				const size_t localCount = m_locals.size();
+
+				if (!compileStatement(statement, returned)) {
+					return false;
+				}
+
+				// A declaration keeps the first register, the rest of the statement's are free again
+				m_nextRegister = mark + static_cast<unsigned>(m_locals.size() - localCount);
+
+				if (returned) {
+					break;
+				}
+			}
+
+			return true;
+		}
+
+		bool compileStatement(const base_expr_node& node, bool& returned) {
+			if (const decl_expr* decl = boost::get<decl_expr>(&node)) {
+				return compileDeclaration(*decl);
+			} else if (const var_assign* assign = boost::get<var_assign>(&node)) {
+				return compileAssignment(*assign);
+			} else if (const return_expr* ret = boost::get<return_expr>(&node)) {
+				returned = true;
+				return compileReturn(*ret);
+			} else if (const if_expr* expr = boost::get<if_expr>(&node)) {
+				return compileIf(*expr, returned);
+			} else if (const while_loop* loop = boost::get<while_loop>(&node)) {
+				return compileWhileLoop(*loop);
+			}
+
+			// Anything else is evaluated for its side effects, e.g. a call to printf
+			operand unused;
+			return compileExpression(node, unused, noRegister);
+		}
+
+		bool compileDeclaration(const decl_expr& decl) {
+			const location_scope at(*this, decl.location);
+
+			value_type type;
+			if (!convertMarklarType(decl.typeName, type)) {
+				cerr << errorLocation() << "Unknown type: '" << decl.typeName << "'" << endl;
+				return false;
+			}
+
+			if (findLocal(decl.declName)) {
+				cerr << errorLocation() << "Warning: Variable is shadowing existing: '" << decl.declName << "'" << endl;
+			}
+
+			// The initializer can't see the variable it declares
+			const uint16_t reg = allocateRegister();
+
+			operand value;
+			if (!compileExpression(decl.val, value, reg)) {
+				return false;
+			}
+
+			if (!checkInteger(value)) {
+				return false;
+			}
+
+			castToType(value, type, reg);
+			m_locals.push_back(local{ decl.declName, reg, type });
+
+			return true;
+		}
+
+		bool compileAssignment(const var_assign& assign) {
+			const location_scope at(*this, assign.location);
+
+			const local* var = findLocal(assign.varName);
+			if (!var) {
+				cerr << errorLocation() << "Unknown variable assignment: '" << assign.varName << "'" << endl;
+				return false;
+			}
+
+			operand value;
+			if (!compileExpression(assign.varRhs, value, var->reg) || !checkInteger(value)) {
+				return false;
+			}
+
+			castToType(value, var->type, var->reg);
+			return true;
+		}
+
+		bool compileReturn(const return_expr& ret) {
+			const location_scope at(*this, ret.location);
+
+			operand value;
+			if (!compileExpression(ret.ret, value, noRegister) || !checkInteger(value)) {
+				return false;
+			}
+
+			value = castToType(value, m_function->returnType, noRegister);
+			emit(opcode::ret, value.reg);
+
+			return true;
+		}
+
+		bool compileIf(const if_expr& expr, bool& returned) {
+			const location_scope at(*this, expr.location);
+
+			operand cond;
+			if (!compileBinaryOp(expr.condition, cond, noRegister) || !checkInteger(cond)) {
+				return false;
+			}
+
+			const size_t skipThen = emit(opcode::jumpIfZero, cond.reg);
+
+			bool thenReturned = false;
+			{
+				block_scope thenScope(*this);
+				if (!compileBlock(expr.thenBranch, thenReturned)) {
+					return false;
+				}
+			}
+
+			if (expr.elseBranch.empty()) {
+				patchJump(skipThen);
+				return true;
+			}
+
+			const size_t skipElse = (thenReturned ? 0 : emit(opcode::jump));
+			patchJump(skipThen);
+
+			bool elseReturned = false;
+			{
+				block_scope elseScope(*this);
+				if (!compileBlock(expr.elseBranch, elseReturned)) {
+					return false;
+				}
+			}
+
+			if (!thenReturned) {
+				patchJump(skipElse);
+			}
+
+			returned = (thenReturned && elseReturned);
+			return true;
+		}
+
+		// The condition is placed after the body, so each iteration only takes the one jump back
+		bool compileWhileLoop(const while_loop& loop) {
+			const location_scope at(*this, loop.location);
+
+			const size_t toCondition = emit(opcode::jump);
+			const uint32_t bodyStart = static_cast<uint32_t>(m_function->code.size());
+
+			{
+				block_scope bodyScope(*this);
+
+				bool returned = false;
+				if (!compileBlock(loop.loopBody, returned)) {
+					return false;
+				}
+			}
+
+			patchJump(toCondition);
+
+			operand cond;
+			if (!compileBinaryOp(loop.condition, cond, noRegister) || !checkInteger(cond)) {
+				return false;
+			}
+
+			emit(opcode::jumpIfNotZero, cond.reg, 0, 0, bodyStart);
+			return true;
+		}
+
+		bool checkInteger(const operand& value) {
+			if (value.type == value_type::string) {
+				cerr << errorLocation() << "Error: String literals can only be passed to printf" << endl;
+				return false;
+			}
+
+			return true;
+		}
+
+		// Places the value in dest, any register holding it will do with noRegister
+		bool compileExpression(const base_expr_node& node, operand& result, int dest) {
+			if (const binary_op* op = boost::get<binary_op>(&node)) {
+				return compileBinaryOp(*op, result, dest);
+			} else if (const call_expr* call = boost::get<call_expr>(&node)) {
+				return compileCall(*call, result, dest);
+			} else if (const interned_string* name = boost::get<interned_string>(&node)) {
+				return compileName(*name, result, dest);
+			}
+
+			cerr << errorLocation() << "Error: Unsupported expression" << endl;
+			return false;
+		}
+
+		bool compileName(interned_string name, operand& result, int dest) {
+			if (const local* var = findLocal(name)) {
+				result.reg = var->reg;
+				result.type = var->type;
+				result.temporary = false;
+
+				if (dest != noRegister && dest != var->reg) {
+					emit(opcode::move, dest, var->reg);
+					result.reg = dest;
+				}
+
+				return true;
+			}
+
+			result.temporary = (dest == noRegister);
+			result.reg = (dest != noRegister ? dest : allocateRegister());
+
+			if (isNumberLiteral(name)) {
+				// Truncated to an i32 as codegen does
+				result.type = value_type::i32;
+				emit(opcode::loadConstant, result.reg, 0, 0, static_cast<uint32_t>(stoull(name.str())));
+			} else if (isStringLiteral(name)) {
+				result.type = value_type::string;
+				emit(opcode::loadString, result.reg, 0, 0, static_cast<uint32_t>(m_module.strings.size()));
+				m_module.strings.push_back(stringLiteralValue(name));
+			} else {
+				cerr << errorLocation() << "ERROR: Could not find symbol: '" << name << "'" << endl;
+				return false;
+			}
+
+			return true;
+		}
+
+		// The operators are applied left to right, the right operand is cast to the type of the left.
+		// Only the last operation writes to dest, the operands may still read it until then
+		bool compileBinaryOp(const binary_op& op, operand& result, int dest) {
+			const location_scope at(*this, op.location);
+
+			if (!compileExpression(op.lhs, result, (op.operation.empty() ? dest : noRegister))) {
+				return false;
+			}
+
+			for (size_t i = 0; i < op.operation.size(); ++i) {
+				const binary_operator binOp = lookupBinaryOperator(op.operation[i].op);
+				if (binOp == binary_operator::unknown) {
+					cerr << errorLocation() << "Unknown operator: \"" << op.operation[i].op << "\"" << endl;
+					return false;
+				}
+
+				operand rhs;
+				if (!checkInteger(result) || !compileExpression(op.operation[i].rhs, rhs, noRegister) || !checkInteger(rhs)) {
+					return false;
+				}
+
+				rhs = castToType(rhs, result.type, noRegister);
+
+				const bool last = (i + 1 == op.operation.size());
+				const uint16_t target = (last && dest != noRegister ? dest : (result.temporary ? result.reg : allocateRegister()));
+
+				// i1 orders true (-1) before false, the reverse of the 32-bit variants
+				uint16_t lhsReg = result.reg;
+				uint16_t rhsReg = rhs.reg;
+				if (result.type == value_type::i1 && isComparison(binOp) && binOp != binary_operator::equal && binOp != binary_operator::notEqual) {
+					swap(lhsReg, rhsReg);
+				}
+
+				emit(selectOpcode(binOp, result.type), target, lhsReg, rhsReg);
+
+				if (isComparison(binOp)) {
+					result.type = value_type::i1;
+				} else if (result.type == value_type::i1 && binOp != binary_operator::bitAnd && binOp != binary_operator::logicalAnd && binOp != binary_operator::logicalOr) {
+					emit(opcode::truncate1, target, target);
+				}
+
+				result.reg = target;
+				result.temporary = !(last && dest != noRegister);
+			}
+
+			return true;
+		}
+
+		// The arguments are placed in consecutive registers that start the callee's window, their
+		// temporaries come after them and are free to be overwritten by the call
+		bool compileArguments(const vector<base_expr_node>& values, const vector<value_type>* types, uint16_t& first) {
+			first = static_cast<uint16_t>(m_nextRegister);
+			for (size_t i = 0; i < values.size(); ++i) {
+				allocateRegister();
+			}
+
+			for (size_t i = 0; i < values.size(); ++i) {
+				const uint16_t reg = static_cast<uint16_t>(first + i);
+
+				operand value;
+				if (!compileExpression(values[i], value, reg)) {
+					return false;
+				}
+
+				if (types) {
+					if (!checkInteger(value)) {
+						return false;
+					}
+
+					castToType(value, (*types)[i], reg);
+				}
+			}
+
+			return true;
+		}
+
+		bool compileCall(const call_expr& call, operand& result, int dest) {
+			const location_scope at(*this, call.location);
+
+			static const interned_string printfName("printf");
+
+			if (call.funcName == printfName) {
+				if (!checkPrintfArguments(call)) {
+					return false;
+				}
+
+				uint16_t first = 0;
+				if (!compileArguments(call.values, nullptr, first)) {
+					return false;
+				}
+
+				result.type = value_type::i32;
+				result.temporary = (dest == noRegister);
+				result.reg = (dest != noRegister ? dest : allocateRegister());
+				emit(opcode::printf, result.reg, first, static_cast<uint16_t>(call.values.size()));
+
+				return true;
+			}
+
+			auto sig = m_signatures.find(call.funcName);
+			if (sig == m_signatures.end() && importFunction(call.funcName)) {
+				sig = m_signatures.find(call.funcName);
+			}
+
+			if (sig == m_signatures.end()) {
+				cerr << errorLocation() << "Error: Could not find function definition for \"" << call.funcName << "\"" << endl;
+				return false;
+			}
+
+			if (sig->second.argTypes.size() != call.values.size()) {
+				cerr << errorLocation() << "Error: \"" << call.funcName << "\" takes " << sig->second.argTypes.size() << " arguments, "
+				     << call.values.size() << " given" << endl;
+				return false;
+			}
+
+			uint16_t first = 0;
+			if (!compileArguments(call.values, &sig->second.argTypes, first)) {
+				return false;
+			}
+
+			result.type = sig->second.returnType;
+			result.temporary = (dest == noRegister);
+			result.reg = (dest != noRegister ? dest : allocateRegister());
+			emit(opcode::call, result.reg, sig->second.index, first);
+
+			return true;
+		}
+
+		// The interpreter formats each conversion itself, so the format has to be a literal whose
+		// conversions match the arguments
+		bool checkPrintfArguments(const call_expr& call) {
+			const interned_string* format = (call.values.empty() ? nullptr : nameOf(call.values[0]));
+			if (!format || !isStringLiteral(*format)) {
+				cerr << errorLocation() << "Error: printf expects a string literal as its format" << endl;
+				return false;
+			}
+
+			const string text = stringLiteralValue(*format);
+
+			size_t arg = 1;
+			for (size_t i = 0; i < text.size(); ++i) {
+				if (text[i] != '%') {
+					continue;
+				}
+
+				i += 1 + strspn(text.c_str() + i + 1, printfSpecifierChars);
+				if (i >= text.size()) {
+					cerr << errorLocation() << "Error: printf format ends within a conversion" << endl;
+					return false;
+				}
+
+				const char conversion = text[i];
+				if (conversion == '%') {
+					continue;
+				}
+
+				if (!strchr("diouxXcs", conversion)) {
+					cerr << errorLocation() << "Error: Unsupported printf conversion '%" << conversion << "'" << endl;
+					return false;
+				}
+
+				if (arg >= call.values.size()) {
+					cerr << errorLocation() << "Error: printf format expects more arguments than given" << endl;
+					return false;
+				}
+
+				const interned_string* name = nameOf(call.values[arg]);
+				const bool isString = (name && isStringLiteral(*name));
+				if (isString != (conversion == 's')) {
+					cerr << errorLocation() << "Error: printf argument " << arg << " doesn't match '%" << conversion << "'" << endl;
+					return false;
+				}
+
+				++arg;
+			}
+
+			return true;
+		}
+
+		module& m_module;
+		const string_view m_source;
+		const vector<const precompiled_module*>& m_libraries;
+
+		map<interned_string, signature> m_signatures;
+
+		// State of the function being compiled
+		bytecode::function* m_function = nullptr;
+		vector<local> m_locals;
+		unsigned m_nextRegister = 0;
+		unsigned m_nextRegisterMax = 0;
+		source_span m_location;
+	};
+
+}
+
+namespace marklar {
+
+	namespace bytecode {
+
+		bool compile(const base_expr_node& root, module& out, string_view source, const vector<const precompiled_module*>& libraries) {
+			profiler::scope timer("bytecode");
+
+			const base_expr* program = boost::get<base_expr>(&root);
+			if (!program) {
+				cerr << "Error: Expected a list of top level items" << endl;
+				return false;
+			}
+
+			const vector<const func_expr*> functions = functionsReachedFromMain(*program);
+
+			// Every signature is known before any body is compiled, as with codegen, so functions may
+			// call ones defined after them
+			bytecode_compiler compiler(out, source, libraries);
+			for (const func_expr* func : functions) {
+				if (!compiler.declare(*func)) {
+					return false;
+				}
+			}
+
+			for (const func_expr* func : functions) {
+				if (!compiler.compileFunction(*func)) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		string disassemble(const module& program) {
+			ostringstream out;
+
+			for (const auto& func : program.functions) {
+				out << func.name << ": " << func.argTypes.size() << " arguments, " << func.registerCount << " registers" << endl;
+
+				for (size_t i = 0; i < func.code.size(); ++i) {
+					const instruction& inst = func.code[i];
+					const size_t op = static_cast<size_t>(inst.op);
+
+					out << "  " << i << ": " << opcodeNames[op];
+
+					const char* separator = " ";
+					for (const char* operand = opcodeOperands[op]; *operand; ++operand) {
+						out << separator;
+						separator = ", ";
+
+						switch (*operand) {
+							case 'a': out << "r" << inst.a; break;
+							case 'b': out << "r" << inst.b; break;
+							case 'c': out << "r" << inst.c; break;
+							case 'n': out << inst.c; break;
+							case 'w': out << "r" << inst.c; break;
+							case 'f': out << (inst.b < program.functions.size() ? program.functions[inst.b].name : program.imports[inst.b - program.functions.size()].name); break;
+							case 'i': out << inst.imm; break;
+							case 't': out << "@" << inst.imm; break;
+							case 's': out << "\"" << program.strings[inst.imm] << "\""; break;
+						}
+					}
+
+					out << endl;
+				}
+			}
+
+			return out.str();
+		}
+
+	}
+
+}
+
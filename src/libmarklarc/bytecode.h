@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "parser.h"
+
+
+/* Every opcode along with its operands, the interpreter and disassembler expand this as well.
+ * a, b and c are registers, 'n' is c used as a count, 'f' is b used as a function index, 'w' is
+ * c used as the start of the callee's register window and i, t and s are the immediate as a
+ * constant, jump target and string literal.
+ */
+#define MARKLAR_BYTECODE_OPCODES(X) \
+	X(move,           "ab")  /* a = b */ \
+	X(loadConstant,   "ai")  /* a = imm */ \
+	X(loadString,     "as")  /* a = index of the string literal imm, only printf looks it up */ \
+	X(truncate1,      "ab")  /* a = b & 1 */ \
+	X(truncate32,     "ab")  /* a = b & 0xffffffff */ \
+	X(add32,          "abc") \
+	X(add64,          "abc") \
+	X(sub32,          "abc") \
+	X(sub64,          "abc") \
+	X(mult32,         "abc") \
+	X(mult64,         "abc") \
+	X(div32,          "abc") \
+	X(div64,          "abc") \
+	X(rem32,          "abc") \
+	X(rem64,          "abc") \
+	X(shiftLeft32,    "abc") \
+	X(shiftLeft64,    "abc") \
+	X(shiftRight32,   "abc") \
+	X(shiftRight64,   "abc") \
+	X(bitAnd,         "abc") \
+	X(bitOr,          "abc") \
+	X(equal,          "abc") \
+	X(notEqual,       "abc") \
+	X(lessThan32,     "abc") \
+	X(lessThan64,     "abc") \
+	X(greaterThan32,  "abc") \
+	X(greaterThan64,  "abc") \
+	X(lessEqual32,    "abc") \
+	X(lessEqual64,    "abc") \
+	X(greaterEqual32, "abc") \
+	X(greaterEqual64, "abc") \
+	X(jump,           "t")   /* continue at imm */ \
+	X(jumpIfZero,     "at")  /* continue at imm when a is zero */ \
+	X(jumpIfNotZero,  "at")  /* continue at imm when a isn't zero */ \
+	X(call,           "afw") /* a = function b, its register window starts at c with the arguments */ \
+	X(printf,         "abn") /* a = printf of the c registers from b on, the first is the format */ \
+	X(ret,            "a")   /* return a to the caller */
+
+
+namespace marklar {
+
+	namespace bytecode {
+
+		/* Register based bytecode for the interpreter, which runs a program without going through LLVM
+		 * so it starts as soon as it's parsed.
+		 *
+		 * Each call gets a window of registers starting with the arguments, followed by the locals and
+		 * temporaries. A register holds its value zero-extended to 64 bits, which makes widening free,
+		 * the arithmetic and signed comparisons come in a variant for each width instead.
+		 */
+		enum class opcode : uint8_t {
+#define MARKLAR_BYTECODE_ENUM(name, operands) name,
+			MARKLAR_BYTECODE_OPCODES(MARKLAR_BYTECODE_ENUM)
+#undef MARKLAR_BYTECODE_ENUM
+			count
+		};
+
+		// Types only exist while compiling, the registers themselves are untyped
+		enum class value_type : uint8_t {
+			i1,
+			i32,
+			i64,
+			string
+		};
+
+		struct instruction {
+			opcode op;
+			uint16_t a = 0;
+			uint16_t b = 0;
+			uint16_t c = 0;
+			uint32_t imm = 0;
+		};
+
+		struct function {
+			std::string name;
+			std::vector<value_type> argTypes;
+			value_type returnType = value_type::i32;
+
+			// Size of the register window, including the arguments
+			unsigned registerCount = 0;
+
+			std::vector<instruction> code;
+		};
+
+		// Function defined by a precompiled module, only its signature is known when compiling
+		struct import {
+			std::string name;
+			std::vector<value_type> argTypes;
+			value_type returnType = value_type::i32;
+		};
+
+		struct module {
+			// Functions are called by their index, the imports are numbered after them
+			std::vector<function> functions;
+			std::vector<import> imports;
+
+			// Decoded string literals, loadString refers to them by index
+			std::vector<std::string> strings;
+		};
+
+		class precompiled_module;
+
+		// Compiles the functions main reaches through calls, or all of them when there's no main. Calls to
+		// functions the source doesn't define are imported from the first library defining them. Errors
+		// are reported to cerr, prefixed with their location when the source is given, and return false
+		bool compile(const parser::base_expr_node& root, module& out, std::string_view source = std::string_view(),
+		             const std::vector<const precompiled_module*>& libraries = {});
+
+		// Interprets main, which may take argc, and stores what it returned in exitCode. printf writes to out.
+		// The imports are resolved against the libraries by name and have to match their signatures.
+		// False when there's no main or the program failed while running, e.g. on a division by zero
+		bool run(const precompiled_module& program, int& exitCode, std::ostream& out = std::cout, int32_t argCount = 1,
+		         const std::vector<const precompiled_module*>& libraries = {});
+
+		// Same as above, the module is laid out as a precompiled one first
+		bool run(const module& program, int& exitCode, std::ostream& out = std::cout, int32_t argCount = 1,
+		         const std::vector<const precompiled_module*>& libraries = {});
+
+		// Listing of every function, one instruction per line
+		std::string disassemble(const module& program);
+
+	}
+
+}
+
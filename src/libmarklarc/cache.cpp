@@ -0,0 +1,90 @@
+#include "cache.h"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SHA1.h>
+
+#include "source_hash.h"
+
+#include <iostream>
+
+
+using namespace llvm;
+using namespace std;
+
+namespace {
+
+	// The build hashes the compiler's sources, so objects generated by any other version of it miss
+	const string g_compilerVersion = string("marklarc-") + MARKLAR_SOURCE_HASH + "/llvm-" + LLVM_VERSION_STRING;
+
+	void hashField(SHA1& hasher, string_view field) {
+		// Length prefix each field so distinct inputs can't collide by concatenation
+		const string length = to_string(field.size()) + ":";
+		hasher.update(length);
+		hasher.update(StringRef(field.data(), field.size()));
+	}
+
+}
+
+namespace marklar {
+
+	namespace cache {
+
+		string computeKey(string_view source, const string& flags) {
+			SHA1 hasher;
+			hashField(hasher, g_compilerVersion);
+			hashField(hasher, flags);
+			hashField(hasher, source);
+
+			return toHex(hasher.final(), true);
+		}
+
+		string objectPath(const string& cacheDir, const string& key) {
+			SmallString<128> path(cacheDir);
+			sys::path::append(path, key + ".o");
+
+			return path.str().str();
+		}
+
+		bool contains(const string& cacheDir, const string& key) {
+			return sys::fs::exists(objectPath(cacheDir, key));
+		}
+
+		bool insert(const string& cacheDir, const string& key, const string& objName) {
+			if (std::error_code ec = sys::fs::create_directories(cacheDir)) {
+				cerr << "Failed to create cache directory '" << cacheDir << "': " << ec.message() << endl;
+				return false;
+			}
+
+			// Write to a unique name first and rename into place, readers never see a partial object
+			SmallString<128> tmpModel(cacheDir);
+			sys::path::append(tmpModel, key + "-%%%%%%%%.tmp");
+
+			SmallString<128> tmpPath;
+			if (std::error_code ec = sys::fs::createUniqueFile(tmpModel, tmpPath)) {
+				cerr << "Failed to create cache entry for '" << key << "': " << ec.message() << endl;
+				return false;
+			}
+
+			if (std::error_code ec = sys::fs::copy_file(objName, tmpPath)) {
+				cerr << "Failed to copy '" << objName << "' into the cache: " << ec.message() << endl;
+				sys::fs::remove(tmpPath);
+				return false;
+			}
+
+			if (std::error_code ec = sys::fs::rename(tmpPath, objectPath(cacheDir, key))) {
+				cerr << "Failed to finalize cache entry for '" << key << "': " << ec.message() << endl;
+				sys::fs::remove(tmpPath);
+				return false;
+			}
+
+			return true;
+		}
+
+	}
+
+}
+
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+
+namespace marklar {
+
+	/* On-disk cache of optimized object files, addressed by a hash of everything that
+	 * influences the generated code.
+	 */
+	namespace cache {
+
+		// Hashes the source text together with a hash of the compiler's own sources and the given optimization flags
+		std::string computeKey(std::string_view source, const std::string& flags);
+
+		// Path the object for the key is stored under, this does not check that it exists
+		std::string objectPath(const std::string& cacheDir, const std::string& key);
+
+		bool contains(const std::string& cacheDir, const std::string& key);
+
+		// Copies the object file into the cache, concurrent writers of the same key are safe
+		bool insert(const std::string& cacheDir, const std::string& key, const std::string& objName);
+
+	}
+
+}
+
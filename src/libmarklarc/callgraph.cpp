@@ -0,0 +1,170 @@
+#include "callgraph.h"
+
+#include <boost/variant/apply_visitor.hpp>
+#include <boost/variant/get.hpp>
+
+#include <map>
+#include <vector>
+
+
+using namespace parser;
+using namespace std;
+
+namespace {
+
+	// Walks a function body and records the name of each call_expr
+	class callee_collector : public boost::static_visitor<void> {
+	public:
+		explicit callee_collector(set<string>& callees)
+		: m_callees(callees) {}
+
+		void operator()(const base_expr& expr) {
+			list(expr.children);
+		}
+
+		void operator()(const interned_string& expr) {}
+
+		void operator()(const func_expr& expr) {
+			list(expr.expressions);
+		}
+
+		void operator()(const def_expr& expr) {}
+
+		void operator()(const decl_expr& expr) {
+			boost::apply_visitor(*this, expr.val);
+		}
+
+		void operator()(const operator_expr& expr) {}
+
+		void operator()(const return_expr& expr) {
+			boost::apply_visitor(*this, expr.ret);
+		}
+
+		void operator()(const call_expr& expr) {
+			m_callees.insert(expr.funcName);
+			list(expr.values);
+		}
+
+		void operator()(const if_expr& expr) {
+			(*this)(expr.condition);
+			list(expr.thenBranch);
+			list(expr.elseBranch);
+		}
+
+		void operator()(const binary_op& expr) {
+			boost::apply_visitor(*this, expr.lhs);
+			for (const auto& itr : expr.operation) {
+				boost::apply_visitor(*this, itr.rhs);
+			}
+		}
+
+		void operator()(const while_loop& expr) {
+			(*this)(expr.condition);
+			list(expr.loopBody);
+		}
+
+		void operator()(const var_assign& expr) {
+			boost::apply_visitor(*this, expr.varRhs);
+		}
+
+		void operator()(const udf_type& expr) {}
+
+	private:
+		void list(const vector<base_expr_node>& nodes) {
+			for (const auto& itr : nodes) {
+				boost::apply_visitor(*this, itr);
+			}
+		}
+
+		set<string>& m_callees;
+	};
+
+	// Calls can be nested anywhere below a statement, every node keeps what's below it as children
+	void collectFlatCallees(flat::any_node node, set<string>& callees) {
+		if (node.kind() == flat::node_kind::call_expr) {
+			callees.insert(node.get().name);
+		}
+
+		for (const auto& itr : node.tree->children(node.id)) {
+			collectFlatCallees(itr, callees);
+		}
+	}
+
+}
+
+namespace marklar {
+
+	set<string> collectCallees(const func_expr& func) {
+		set<string> callees;
+		callee_collector collector(callees);
+		collector(func);
+
+		return callees;
+	}
+
+	set<string> collectCallees(const flat::func_expr& func) {
+		set<string> callees;
+		for (const auto& itr : func.expressions) {
+			collectFlatCallees(itr, callees);
+		}
+
+		return callees;
+	}
+
+	set<string> reachableFunctions(const string& entry, const function<bool(const string&, set<string>&)>& calleesOf) {
+		set<string> reached;
+		set<string> visited = { entry };
+		vector<string> pending = { entry };
+
+		while (!pending.empty()) {
+			const string name = pending.back();
+			pending.pop_back();
+
+			set<string> callees;
+			if (!calleesOf(name, callees)) {
+				continue;
+			}
+
+			reached.insert(name);
+			for (const auto& callee : callees) {
+				if (visited.insert(callee).second) {
+					pending.push_back(callee);
+				}
+			}
+		}
+
+		return reached;
+	}
+
+	vector<const func_expr*> functionsReachedFromMain(const base_expr& root) {
+		multimap<string, const func_expr*> functions;
+		for (auto& itr : root.children) {
+			if (const func_expr* func = boost::get<func_expr>(&itr)) {
+				functions.emplace(func->functionName, func);
+			}
+		}
+
+		const bool hasMain = (functions.count("main") > 0);
+		const set<string> reachable = reachableFunctions("main", [&](const string& name, set<string>& callees) {
+			const auto range = functions.equal_range(name);
+			for (auto itr = range.first; itr != range.second; ++itr) {
+				const set<string> calls = collectCallees(*itr->second);
+				callees.insert(calls.begin(), calls.end());
+			}
+
+			return range.first != range.second;
+		});
+
+		vector<const func_expr*> result;
+		for (auto& itr : root.children) {
+			const func_expr* func = boost::get<func_expr>(&itr);
+			if (func && (!hasMain || reachable.count(func->functionName) > 0)) {
+				result.push_back(func);
+			}
+		}
+
+		return result;
+	}
+
+}
+
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "flatast.h"
+#include "parser.h"
+
+
+namespace marklar {
+
+	// Names of every function called anywhere in the body of func, including printf
+	std::set<std::string> collectCallees(const parser::func_expr& func);
+
+	// Same as above for the flat AST, a lazily parsed body has to be materialized first
+	std::set<std::string> collectCallees(const parser::flat::func_expr& func);
+
+	// Functions reachable through calls from entry, including entry itself. calleesOf is asked once
+	// about every name reached and returns false for names that aren't defined, e.g. printf
+	std::set<std::string> reachableFunctions(const std::string& entry, const std::function<bool(const std::string&, std::set<std::string>&)>& calleesOf);
+
+	// Top level functions main reaches through calls, in source order. Without a main it's all of them
+	std::vector<const parser::func_expr*> functionsReachedFromMain(const parser::base_expr& root);
+
+}
+
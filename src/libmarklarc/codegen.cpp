@@ -4,7 +4,6 @@
 #include <string>
 #include <vector>
 
-#include <boost/algorithm/string.hpp>
 #include <boost/variant/get.hpp>
 
 #include <llvm/IR/DerivedTypes.h>
@@ -17,6 +16,11 @@
 #include <llvm/Support/Casting.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include "literal.h"
+#include "location.h"
+#include "operators.h"
+#include "profiler.h"
+
 // Debugging
 #include <iostream>
 
@@ -26,51 +30,42 @@ using namespace parser;
 
 using namespace llvm;
 using namespace std;
-using namespace std::placeholders;
 
 
 namespace {
 
-	bool is_number(const string& s) {
-		return !s.empty() && find_if(s.begin(),
-			s.end(), [](char c) { return !isdigit(c); }) == s.end();
-	}
-
-	bool isQuotedString(const string& s) {
-		const auto sz = s.size();
-
-		if (sz < 2) {
-			return false;
-		}
-
-		return (s[0] == '"' && s[sz-1] == '"');
-	}
-
-	string trimQuotes(const string& s) {
-		string newStr(s);
-
-		boost::trim_if(newStr, boost::is_any_of("\""));
-
-		return newStr;
-	}
-
-	string convertEscapedCharacters(const string& s) {
-		return boost::replace_all_copy(s, "\\n", "\n");
-	}
-
 	// Helper to convert from a marklar type to a LLVM type,
 	// e.g. i32 to Type*
-	Type* convertMarklarTypeToLLVM(LLVMContext& ctx, const string& mrkType) {
+	Type* convertMarklarTypeToLLVM(LLVMContext& ctx, interned_string mrkType) {
+		static const interned_string i32Type("i32");
+		static const interned_string i64Type("i64");
+
 		// TODO Flesh this out with more types
-		if (mrkType == "i32") {
+		if (mrkType == i32Type) {
 			return IntegerType::getInt32Ty(ctx);
-		} else if (mrkType == "i64") {
+		} else if (mrkType == i64Type) {
 			return IntegerType::getInt64Ty(ctx);
 		} else {
 			return nullptr;
 		}
 	}
 
+	// Helper to zero extend or truncate an integer to the given type
+	Value* castIntToType(Value* const value, Type* const type, IRBuilder<>& builder) {
+		const auto lSize = type->getIntegerBitWidth();
+		const auto rSize = value->getType()->getIntegerBitWidth();
+
+		if (lSize > rSize) {
+			CastInst* zeroExtendRHS = new ZExtInst(value, type, "conv", builder.GetInsertBlock());
+			return zeroExtendRHS;
+		} else if (rSize > lSize) {
+			TruncInst* truncRHS = new TruncInst(value, type, "conv", builder.GetInsertBlock());
+			return truncRHS;
+		}
+
+		return value;
+	}
+
 	// Helper to zero extend a type
 	Value* castInt(Value* const valueLhs, Value* const valueRhs, IRBuilder<>& builder) {
 		auto lhsType = valueLhs->getType();
@@ -80,19 +75,7 @@ namespace {
 		}
 
 		// If the left is smaller, we need to cast the right
-		const auto lSize = lhsType->getIntegerBitWidth();
-		const auto rSize = valueRhs->getType()->getIntegerBitWidth();
-
-		if (lSize > rSize) {
-			CastInst* zeroExtendRHS = new ZExtInst(valueRhs, lhsType, "conv", builder.GetInsertBlock());
-			return zeroExtendRHS;
-		} else if (rSize > lSize) {
-			// TODO: Update the function name to more of a general "cast"
-			TruncInst* truncRHS = new TruncInst(valueRhs, lhsType, "conv", builder.GetInsertBlock());
-			return truncRHS;
-		}
-
-		return valueRhs;
+		return castIntToType(valueRhs, lhsType, builder);
 	}
 
 	// Debug helper to dump out types
@@ -105,6 +88,38 @@ namespace {
 		return t1.str();
 	}
 
+	Value* createBinaryOperator(IRBuilder<>& builder, binary_operator op, Value* lhs, Value* rhs) {
+		switch (op) {
+			case binary_operator::add:          return builder.CreateAdd(lhs, rhs, "add");
+			case binary_operator::sub:          return builder.CreateSub(lhs, rhs, "sub");
+			case binary_operator::mult:         return builder.CreateMul(lhs, rhs, "mult");
+			case binary_operator::div:          return builder.CreateSDiv(lhs, rhs, "div");
+			case binary_operator::rem:          return builder.CreateSRem(lhs, rhs, "rem");
+			case binary_operator::lessThan:     return builder.CreateICmpSLT(lhs, rhs, "cmp");
+			case binary_operator::greaterThan:  return builder.CreateICmpSGT(lhs, rhs, "cmp");
+			case binary_operator::lessEqual:    return builder.CreateICmpSLE(lhs, rhs, "cmp");
+			case binary_operator::greaterEqual: return builder.CreateICmpSGE(lhs, rhs, "cmp");
+			case binary_operator::equal:        return builder.CreateICmpEQ(lhs, rhs, "cmp");
+			case binary_operator::notEqual:     return builder.CreateICmpNE(lhs, rhs, "cmp");
+			case binary_operator::bitAnd:       return builder.CreateAnd(lhs, rhs, "and");
+			case binary_operator::logicalAnd:   return builder.CreateAnd(lhs, rhs, "and");
+			case binary_operator::logicalOr:    return builder.CreateOr(lhs, rhs, "or");
+			case binary_operator::shiftRight:   return builder.CreateLShr(lhs, rhs, "shr");
+			case binary_operator::shiftLeft:    return builder.CreateShl(lhs, rhs, "shl");
+			default:                            return nullptr;
+		}
+	}
+
+	// Arguments of a function are definitions in either AST
+	const def_expr& definitionOf(const base_expr_node& node) {
+		return boost::get<def_expr>(node);
+	}
+
+	flat::def_expr definitionOf(flat::any_node node) {
+		assert(node.kind() == flat::node_kind::def_expr);
+		return flat::def_expr(node);
+	}
+
 	// Helper functions for printf
 	/*
 	FunctionType* printf_type(LLVMContext& ctx, const vector<Value*>& args) {
@@ -149,17 +164,21 @@ namespace {
 }
 
 
-Value* ast_codegen::operator()(const string& val) {
+Value* ast_codegen::operator()(const interned_string& val) {
 	BasicBlock *bb = m_builder.GetInsertBlock();
 	Function *TheFunction = bb->getParent();
 	//const string varName = string(TheFunction->getName()) + "_" + val;
-	const string varName = val;
+	const interned_string varName = val;
 
 	Value *retVal = nullptr;
 
-	auto itr = m_symbolTable.find(varName);
-	if (itr != m_symbolTable.end()) {
-		Value* const localVar = itr->second;
+	const symbol* sym = m_symbolTable.find(varName);
+	if (sym && sym->ssaVariable != symbol::noSsaVariable) {
+		return m_ssa->readVariable(sym->ssaVariable, m_builder.GetInsertBlock());
+	}
+
+	if (sym) {
+		Value* const localVar = sym->value;
 
 		// Only create a load if this is a pointer type, this avoids
 		// problems with function arguments that aren't created through Alloca
@@ -169,24 +188,24 @@ Value* ast_codegen::operator()(const string& val) {
 			retVal = localVar;
 		}
 
-		retVal->setName(varName);
-	} else if (is_number(val)) {
+		retVal->setName(varName.str());
+	} else if (isNumberLiteral(val)) {
 		APInt vInt(32, stol(val));
 		retVal = ConstantInt::get(*m_context, vInt);
 	} else {
 		// TODO: Prototype hacky code to create a string for printf
-		if (isQuotedString(val)) {
+		if (isStringLiteral(val)) {
 			// This is a string in quotes and is only seen once, therefore build a constant for it
-			const auto rawString = convertEscapedCharacters(trimQuotes(val));
+			const auto rawString = stringLiteralValue(val);
 
 			retVal = geti8StrVal(*m_context, *m_module, rawString.c_str(), ".str");
 		} else {
-			cerr << "ERROR: Could not find symbol: '" << val << "' (internal name: " << varName << ")" << endl;
+			cerr << errorLocation() << "ERROR: Could not find symbol: '" << val << "' (internal name: " << varName << ")" << endl;
 			cerr << "  SymbolTable size: " << m_symbolTable.size() << endl;
 
-			for (const auto& kv : m_symbolTable) {
-				cerr  << "    Key: " << kv.first << ", Value: " << kv.second << endl;
-			}
+			m_symbolTable.forEach([](const string& name, const symbol& sym) {
+				cerr  << "    Key: " << name << ", Value: " << sym.value << endl;
+			});
 
 			cerr << endl;
 		}
@@ -201,69 +220,146 @@ Value* ast_codegen::operator()(const parser::base_expr& expr) {
 	return nullptr;
 }
 
-Value* ast_codegen::operator()(const parser::func_expr& func) {
-	Function *F = nullptr;
+Value* ast_codegen::operator()(const parser::flat::base_expr& expr) {
+	return nullptr;
+}
+
+Value* ast_codegen::visit(const base_expr_node& node) {
+	return boost::apply_visitor(*this, node);
+}
+
+Value* ast_codegen::visit(const parser::binary_op& op) {
+	return generateBinaryOp(op);
+}
+
+Value* ast_codegen::visit(flat::any_node node) {
+	// Values are only located in the flat AST
+	const location_scope at(*this, node.location());
+
+	return flat::apply_visitor(*this, node);
+}
+
+string ast_codegen::errorLocation() const {
+	if (m_source.empty() || !m_location.valid()) {
+		return "";
+	}
+
+	return describeLocation(m_source, m_location) + ": ";
+}
+
+Function* ast_codegen::declareFunction(const parser::func_expr& func) {
+	return declareFunctionPrototype(func);
+}
+
+Function* ast_codegen::declareFunction(const parser::flat::func_expr& func) {
+	return declareFunctionPrototype(func);
+}
+
+bool ast_codegen::canCall(const string& name) const {
+	return (name == "printf" || m_module->getFunction(name) != nullptr);
+}
+
+template <typename func_expr_t>
+Function* ast_codegen::declareFunctionPrototype(const func_expr_t& func) {
+	const location_scope at(*this, func.location);
+
 	Type* returnType = convertMarklarTypeToLLVM(*m_context, func.returnType);
 
 	if (!returnType) {
-		cerr << "Unknown type: '" << func.returnType << "'" << endl;
+		cerr << errorLocation() << "Unknown type: '" << func.returnType << "'" << endl;
 		return nullptr;
 	}
 
 	// Determine if this function name has been defined yet
-	auto itr = m_symbolTable.find(func.functionName);
-	if (itr == m_symbolTable.end()) {
-		// Could not find existing function with this name, build it
+	const symbol* sym = m_symbolTable.find(func.functionName);
+	if (sym) {
+		return dyn_cast_or_null<Function>(sym->value);
+	}
 
-		// Begin with our argument types, we don't need to define names just yet (and it's
-		//   difficult as the symbol table for the function hasn't been added)
-		vector<Type*> args;
-		for (auto& argDef : func.args) {
-			def_expr arg(*boost::get<def_expr>(&argDef));
+	// Could not find existing function with this name, build it
 
-			args.push_back(convertMarklarTypeToLLVM(*m_context, arg.typeName));
-		}
+	// Begin with our argument types, we don't need to define names just yet (and it's
+	//   difficult as the symbol table for the function hasn't been added)
+	vector<Type*> args;
+	for (const auto& argDef : func.args) {
+		const auto arg = definitionOf(argDef);
 
-		// Build the final function type
-		FunctionType *FT = FunctionType::get(returnType, args, false);
-		F = Function::Create(FT, Function::ExternalLinkage, func.functionName, m_module);
+		args.push_back(convertMarklarTypeToLLVM(*m_context, arg.typeName));
+	}
 
-		// Add it to the symbol table so we can refer to it later
-		m_symbolTable[func.functionName] = F;
-	} else {
-		F = dyn_cast<Function>(itr->second);
+	// Build the final function type
+	FunctionType *FT = FunctionType::get(returnType, args, false);
+	Function* F = Function::Create(FT, Function::ExternalLinkage, func.functionName.str(), m_module);
+
+	// Add it to the symbol table so we can refer to it later
+	m_symbolTable.set(func.functionName, F);
+
+	return F;
+}
+
+template <typename func_expr_t>
+Value* ast_codegen::generateFunction(const func_expr_t& func) {
+	profiler::scope timer("function", func.functionName);
+	const location_scope at(*this, func.location);
+	// Interned once rather than for every function
+	static const interned_string retValName("__retval__");
+	static const interned_string retValBlockName("__retval__BB");
+
+
+	Function *F = declareFunctionPrototype(func);
+	if (!F) {
+		return nullptr;
+	}
+
+	// The prototype is shared by every definition of the name, only the first one may fill it in
+	if (!F->empty()) {
+		cerr << errorLocation() << "Error: Function '" << func.functionName << "' is defined more than once" << endl;
+		m_failed = true;
+		return nullptr;
 	}
 
+	Type* returnType = F->getReturnType();
+
 	BasicBlock *BB = BasicBlock::Create(*m_context, func.functionName.c_str(), F);
 	m_builder.SetInsertPoint(BB);
 
-	// Build a return value in place
-	IRBuilder<> TmpB(&F->getEntryBlock(), F->getEntryBlock().begin());
-	AllocaInst* const Alloca = TmpB.CreateAlloca(returnType, nullptr, "__retval__");
-	assert(Alloca);
-	m_symbolTable["__retval__"] = Alloca;
+	// Function-level scoping so our symbols aren't re-used across other functions
+	symbol_table::scope functionScope(m_symbolTable);
+
+	BasicBlock *ReturnBB = BasicBlock::Create(*m_context, "return");
+	m_symbolTable.set(retValBlockName, ReturnBB);
 
+	// Build a return value in place
 	APInt vInt(returnType->getIntegerBitWidth(), 0);
-	m_builder.CreateStore(ConstantInt::get(*m_context, vInt), Alloca);
 
-	BasicBlock *ReturnBB = BasicBlock::Create(*m_context, "return");
-	m_symbolTable["__retval__BB"] = ReturnBB;
+	if (m_directSsa) {
+		// Every function starts with fresh SSA state, the entry block has no predecessors
+		m_ssa.reset(new ssa_builder());
+		m_ssa->sealBlock(BB);
 
-	// Create a new visitor, this allows function-level scoping so our symbol table
-	// isn't re-used across other functions
-	ast_codegen symbolVisitor(*this);
+		addSsaVariable(retValName, returnType, ConstantInt::get(*m_context, vInt));
+	} else {
+		IRBuilder<> TmpB(&F->getEntryBlock(), F->getEntryBlock().begin());
+		AllocaInst* const Alloca = TmpB.CreateAlloca(returnType, nullptr, "__retval__");
+		assert(Alloca);
+		m_symbolTable.set(retValName, Alloca);
+
+		m_builder.CreateStore(ConstantInt::get(*m_context, vInt), Alloca);
+	}
 
 	// Add function argument names, the types should have already been setup above
 	Function::arg_iterator argItr = F->arg_begin();
-	for (auto& argDef : func.args) {
-		auto* arg = boost::get<def_expr>(&argDef);
-		assert(arg);
-
-		const string argName = arg->defName;
-
-		argItr->setName(argName);
-		if (!symbolVisitor.addSymbol(argName, argItr)) {
-			cerr << "Error: Definition of '" << argName << "' already exists" << endl;
+	for (const auto& argDef : func.args) {
+		const interned_string argName = definitionOf(argDef).defName;
+
+		argItr->setName(argName.str());
+		if (m_directSsa) {
+			if (!addSsaVariable(argName, argItr->getType(), &*argItr)) {
+				cerr << errorLocation() << "Error: Definition of '" << argName << "' already exists" << endl;
+				return nullptr;
+			}
+		} else if (!addSymbol(argName, &*argItr)) {
+			cerr << errorLocation() << "Error: Definition of '" << argName << "' already exists" << endl;
 			return nullptr;
 		}
 
@@ -273,7 +369,7 @@ Value* ast_codegen::operator()(const parser::func_expr& func) {
 	/*
 	// Visit declarations inside the function node
 	for (auto& itrDecl : func.declarations) {
-		boost::apply_visitor(symbolVisitor, itrDecl);
+		boost::apply_visitor(*this, itrDecl);
 	}
 	*/
 
@@ -282,8 +378,8 @@ Value* ast_codegen::operator()(const parser::func_expr& func) {
 	Value* lastExpr = ReturnBB;
 
 	// Visit expressions inside the function node
-	for (auto& itrExpr : func.expressions) {
-		lastExpr = boost::apply_visitor(symbolVisitor, itrExpr);
+	for (const auto& itrExpr : func.expressions) {
+		lastExpr = visit(itrExpr);
 
 		// Indicates that all paths branched (in the current case, this means everything returned)
 		// and we didn't create an "if.end" merge block, therefore stop here
@@ -300,7 +396,15 @@ Value* ast_codegen::operator()(const parser::func_expr& func) {
 	F->getBasicBlockList().push_back(ReturnBB);
 	m_builder.SetInsertPoint(ReturnBB);
 
-	Value* const loadRetVal = m_builder.CreateLoad(m_symbolTable["__retval__"]);
+	Value* loadRetVal = nullptr;
+	if (m_directSsa) {
+		// Every return has branched here by now
+		m_ssa->sealBlock(ReturnBB);
+		loadRetVal = m_ssa->readVariable(m_symbolTable.find(retValName)->ssaVariable, ReturnBB);
+	} else {
+		Value* const retVal = m_symbolTable.find(retValName)->value;
+		loadRetVal = m_builder.CreateLoad(retVal);
+	}
 	assert(loadRetVal);
 	Value* const retVal = m_builder.CreateRet(loadRetVal);
 	assert(retVal);
@@ -311,40 +415,79 @@ Value* ast_codegen::operator()(const parser::func_expr& func) {
 	return nullptr;
 }
 
-Value* ast_codegen::operator()(const parser::def_expr& def) {
+template <typename def_expr_t>
+Value* ast_codegen::generateDefinition(const def_expr_t& def) {
+	const location_scope at(*this, def.location);
+
 	const auto defType = def.typeName;
-	const string& defName = def.defName;
+	const interned_string defName = def.defName;
 
-	const auto itr = m_symbolTable.find(defName);
-	if (itr != m_symbolTable.end()) {
-		cerr << "Error: Definition of '" << defName << "' already exists" << endl;
+	if (m_symbolTable.contains(defName)) {
+		cerr << errorLocation() << "Error: Definition of '" << defName << "' already exists" << endl;
 		return nullptr;
 	} else {
 		auto* type = convertMarklarTypeToLLVM(*m_context, def.typeName);
+		if (!type) {
+			cerr << errorLocation() << "Unknown type: '" << def.typeName << "'" << endl;
+			return nullptr;
+		}
+
 		Value* retVal = UndefValue::get(type);
-		retVal->setName(defName);
 
-		m_symbolTable[defName] = retVal;
+		if (m_directSsa) {
+			addSsaVariable(defName, type, retVal);
+			return retVal;
+		}
+
+		retVal->setName(defName.str());
+
+		m_symbolTable.set(defName, retVal);
 		return retVal;
 	}
 
 	return nullptr;
 }
 
-Value* ast_codegen::operator()(const parser::decl_expr& decl) {
+template <typename decl_expr_t>
+Value* ast_codegen::generateDeclaration(const decl_expr_t& decl) {
+	const location_scope at(*this, decl.location);
+
 	Value* var = nullptr;
 
 	BasicBlock *bb = m_builder.GetInsertBlock();
 	Function *TheFunction = bb->getParent();
 
-	const string declName = decl.declName;
+	const interned_string declName = decl.declName;
+
+	auto* type = convertMarklarTypeToLLVM(*m_context, decl.typeName);
+	if (!type) {
+		cerr << errorLocation() << "Unknown type: '" << decl.typeName << "'" << endl;
+		return nullptr;
+	}
+
+	if (m_directSsa) {
+
+		if (m_symbolTable.contains(declName)) {
+			cerr << errorLocation() << "Warning: Variable is shadowing existing: '" << declName << "'" << endl;
+		}
+
+		// The initializer can't see the variable it declares
+		Value* exprRhs = visit(decl.val);
+		Value* const initVal = (exprRhs ? castIntToType(exprRhs, type, m_builder) : UndefValue::get(type));
 
-	map<string, Value*>::const_iterator itr = m_symbolTable.find(declName);
-	if (itr != m_symbolTable.end()) {
-		cerr << "Warning: Variable is shadowing existing: '" << declName << "'" << endl;
+		symbol sym;
+		sym.ssaVariable = m_ssa->addVariable(type, declName);
+		m_ssa->writeVariable(sym.ssaVariable, m_builder.GetInsertBlock(), initVal);
+		m_symbolTable.set(declName, sym);
+
+		return initVal;
+	}
+
+	if (const symbol* sym = m_symbolTable.find(declName)) {
+		cerr << errorLocation() << "Warning: Variable is shadowing existing: '" << declName << "'" << endl;
 
 		// Use the variable itself
-		var = itr->second;
+		var = sym->value;
 	}
 
 	{
@@ -352,35 +495,31 @@ Value* ast_codegen::operator()(const parser::decl_expr& decl) {
 
 		// If there is no basic block it indicates it might be at the global-level
 		if (bb) {
-			auto* type = convertMarklarTypeToLLVM(*m_context, decl.typeName);
-			assert(type);
-
 			IRBuilder<> TmpB(&TheFunction->getEntryBlock(), TheFunction->getEntryBlock().begin());
 			Alloca = TmpB.CreateAlloca(type, nullptr, declName.c_str());
 
-			m_symbolTable[declName] = Alloca;
+			m_symbolTable.set(declName, Alloca);
 		}
 
 		var = Alloca;
 	}
 
-	Value* exprRhs = boost::apply_visitor(*this, decl.val);
+	Value* exprRhs = visit(decl.val);
 	if (exprRhs) {
 		// Don't just obtain the variable from codegen, since that produces a load...
 		// instead just look it up directly
-		const auto itr = m_symbolTable.find(declName);
-		if (itr != m_symbolTable.end()) {
+		if (const symbol* sym = m_symbolTable.find(declName)) {
 			if (exprRhs->getType()->isPointerTy()) {
 				Value *varLhs = m_builder.CreateLoad(exprRhs);
-				m_builder.CreateStore(varLhs, itr->second);
+				m_builder.CreateStore(varLhs, sym->value);
 			} else {
 				// Zero-extends (casts) the RHS if necessary 
-				exprRhs = castInt(itr->second, exprRhs, m_builder);
+				exprRhs = castInt(sym->value, exprRhs, m_builder);
 
-				m_builder.CreateStore(exprRhs, itr->second);
+				m_builder.CreateStore(exprRhs, sym->value);
 			}
 		} else {
-			cerr << "ERROR: Could not find variable: " << declName << endl;
+			cerr << errorLocation() << "ERROR: Could not find variable: " << declName << endl;
 			return nullptr;
 		}
 	}
@@ -392,26 +531,41 @@ Value* ast_codegen::operator()(const parser::operator_expr& expr) {
 	return nullptr;
 }
 
-Value* ast_codegen::operator()(const parser::return_expr& exprRet) {
+Value* ast_codegen::operator()(const parser::flat::operator_expr& expr) {
+	return nullptr;
+}
+
+template <typename return_expr_t>
+Value* ast_codegen::generateReturn(const return_expr_t& exprRet) {
+	const location_scope at(*this, exprRet.location);
+
+	static const interned_string retValName("__retval__");
+	static const interned_string retValBlockName("__retval__BB");
+
 	// We can't generate a CreateRet in-place here since it might be
 	// within an if-else, LLVM doesn't allow terminators in the branches
 	// Therefore, just reference the return value on the stack we setup
 	// when the function was created - we should only be writing to this once
-	Value* const retVal = m_symbolTable["__retval__"];
-	assert(retVal);
-
-	Value* v = boost::apply_visitor(*this, exprRet.ret);
+	Value* v = visit(exprRet.ret);
 	if (!v) {
 		return nullptr;
 	}
 
-	// Cast if necessary
-	v = castInt(retVal, v, m_builder);
+	if (m_directSsa) {
+		const unsigned retVar = m_symbolTable.find(retValName)->ssaVariable;
+		m_ssa->writeVariable(retVar, m_builder.GetInsertBlock(), castIntToType(v, m_ssa->variableType(retVar), m_builder));
+	} else {
+		Value* const retVal = m_symbolTable.find(retValName)->value;
+		assert(retVal);
+
+		// Cast if necessary
+		v = castInt(retVal, v, m_builder);
 
-	Value* const n = m_builder.CreateStore(v, retVal);
-	assert(n);
+		Value* const n = m_builder.CreateStore(v, retVal);
+		assert(n);
+	}
 
-	Value* const ReturnBB = m_symbolTable["__retval__BB"];
+	Value* const ReturnBB = m_symbolTable.find(retValBlockName)->value;
 	Value* const r = m_builder.CreateBr(dyn_cast<BasicBlock>(ReturnBB));
 	assert(r);
 
@@ -423,27 +577,32 @@ Value* ast_codegen::operator()(const parser::return_expr& exprRet) {
 	return r;
 }
 
-Value* ast_codegen::operator()(const parser::call_expr& expr) {
+template <typename call_expr_t>
+Value* ast_codegen::generateCall(const call_expr_t& expr) {
+	const location_scope at(*this, expr.location);
+
 	// Build the arguments first, in case this is a vararg we need to know these types
 	std::vector<Value*> ArgsV;
-	for (auto& exprArg : expr.values) {
-		Value* const v = boost::apply_visitor(*this, exprArg);
+	for (const auto& exprArg : expr.values) {
+		Value* const v = visit(exprArg);
 		ArgsV.push_back(v);
 	}
 
-	const string& callFuncName = expr.funcName;
-	Function *calleeF = m_module->getFunction(callFuncName);
+	static const interned_string printfName("printf");
+
+	const interned_string callFuncName = expr.funcName;
+	Function *calleeF = m_module->getFunction(callFuncName.str());
 	if (calleeF == nullptr) {
 		// TODO: This is a prototype/hack to get printf working, needs to be generalized
-		if (callFuncName == "printf") {
+		if (callFuncName == printfName) {
 			calleeF = printf_prototype(*m_context, m_module, ArgsV);
 		} else {
-			cerr << "Error: Could not find function definition for \"" << callFuncName << "\"" << endl;
+			cerr << errorLocation() << "Error: Could not find function definition for \"" << callFuncName << "\"" << endl;
 			return nullptr;
 		}
 	} else {
 		// TODO: This is a prototype/hack to get printf working, needs to be generalized
-		if (callFuncName == "printf") {
+		if (callFuncName == printfName) {
 			// Check if the existing definition works for our call, this might be varargs
 			// which causes definitions to differ, e.g. printf("a") vs printf("a %d", 1);
 			//FunctionType* expectedType = printf_type(*m_context, ArgsV);
@@ -466,18 +625,21 @@ Value* ast_codegen::operator()(const parser::call_expr& expr) {
 		// --
 	}
 
-	CallInst *callInst = m_builder.CreateCall(calleeF, ArgsV, callFuncName);
+	CallInst *callInst = m_builder.CreateCall(calleeF, ArgsV, callFuncName.str());
 
 	// Pass the call up so the value can be stored
 	return callInst;
 }
 
-Value* ast_codegen::operator()(const parser::if_expr& expr) {
+template <typename if_expr_t>
+Value* ast_codegen::generateIf(const if_expr_t& expr) {
+	const location_scope at(*this, expr.location);
+
 	Function *TheFunction = m_builder.GetInsertBlock()->getParent();
 	assert(TheFunction);
 
 	// Call the visitor directory for the binary_op
-	Value* const CondV = (*this)(expr.condition);
+	Value* const CondV = visit(expr.condition);
 	assert(CondV);
 
 	// Create blocks for the then and else cases, insert the 'then' block at the
@@ -488,6 +650,12 @@ Value* ast_codegen::operator()(const parser::if_expr& expr) {
 
 	m_builder.CreateCondBr(CondV, ThenBB, ElseBB);
 
+	// Both branches have their only predecessor now, the merge block waits for both of them
+	if (m_directSsa) {
+		m_ssa->sealBlock(ThenBB);
+		m_ssa->sealBlock(ElseBB);
+	}
+
 	Value* ThenV = nullptr;
 	Value* ElseV = nullptr;
 
@@ -498,12 +666,11 @@ Value* ast_codegen::operator()(const parser::if_expr& expr) {
 	{
 		m_builder.SetInsertPoint(ThenBB);
 
-		// Created a new visitor, this allows scoping so our symbol table
-		// isn't re-used across other functions
-		ast_codegen symbolVisitor(*this);
+		// Declarations inside the branch go out of scope with it
+		symbol_table::scope thenScope(m_symbolTable);
 
 		for (const auto& itrThen : expr.thenBranch) {
-			ThenV = boost::apply_visitor(symbolVisitor, itrThen);
+			ThenV = visit(itrThen);
 			assert(ThenV);
 
 			if (isa<BranchInst>(ThenV)) {
@@ -526,12 +693,10 @@ Value* ast_codegen::operator()(const parser::if_expr& expr) {
 		TheFunction->getBasicBlockList().push_back(ElseBB);
 		m_builder.SetInsertPoint(ElseBB);
 
-		// Created a new visitor, this allows scoping so our symbol table
-		// isn't re-used across other functions
-		ast_codegen symbolVisitor(*this);
+		symbol_table::scope elseScope(m_symbolTable);
 
 		for (const auto& itrElse : expr.elseBranch) {
-			ElseV = boost::apply_visitor(symbolVisitor, itrElse);
+			ElseV = visit(itrElse);
 			assert(ElseV);
 
 			if (isa<BranchInst>(ElseV)) {
@@ -557,41 +722,19 @@ Value* ast_codegen::operator()(const parser::if_expr& expr) {
 		TheFunction->getBasicBlockList().push_back(MergeBB);
 		m_builder.SetInsertPoint(MergeBB);
 
+		if (m_directSsa) {
+			m_ssa->sealBlock(MergeBB);
+		}
+
 		return MergeBB;
 	}
 }
 
-Value* ast_codegen::operator()(const parser::binary_op& op) {
-	typedef Value* (IRBuilder<>::*logical_t)(Value*, Value*, const Twine&);
-	typedef Value* (IRBuilder<>::*shiftRight_t)(Value*, Value*, const Twine&, bool);
-	typedef Value* (IRBuilder<>::*shiftLeft_t)(Value*, Value*, const Twine&, bool, bool);
-
-	// Mapping of operator to LLVM creation calls
-	const map<string, std::function<Value*(Value*, Value*)>> ops = {
-		{ "+",  bind(&IRBuilder<>::CreateAdd,     m_builder, _1, _2, "add", false, false) },
-		{ "-",  bind(&IRBuilder<>::CreateSub,     m_builder, _1, _2, "sub", false, false) },
-		{ "<",  bind(&IRBuilder<>::CreateICmpSLT, m_builder, _1, _2, "cmp") },
-		{ ">",  bind(&IRBuilder<>::CreateICmpSGT, m_builder, _1, _2, "cmp") },
-		{ "%",  bind(&IRBuilder<>::CreateSRem,    m_builder, _1, _2, "rem") },
-		{ "/",  bind(&IRBuilder<>::CreateSDiv,    m_builder, _1, _2, "div", false) },
-		{ "*",  bind(&IRBuilder<>::CreateMul,     m_builder, _1, _2, "mult", false, false) },
-		{ ">=", bind(&IRBuilder<>::CreateICmpSGE, m_builder, _1, _2, "cmp") },
-		{ "<=", bind(&IRBuilder<>::CreateICmpSLE, m_builder, _1, _2, "cmp") },
-		{ "==", bind(&IRBuilder<>::CreateICmpEQ,  m_builder, _1, _2, "cmp") },
-		{ "!=", bind(&IRBuilder<>::CreateICmpNE,  m_builder, _1, _2, "cmp") },
-		{ "&",  bind(static_cast<logical_t>
-		            (&IRBuilder<>::CreateAnd),    m_builder, _1, _2, "and") },
-		{ "||", bind(static_cast<logical_t>
-		            (&IRBuilder<>::CreateOr),     m_builder, _1, _2, "or")  },
-		{ "&&", bind(static_cast<logical_t>
-		            (&IRBuilder<>::CreateAnd),    m_builder, _1, _2, "and")  },
-		{ ">>", bind(static_cast<shiftRight_t>
-		            (&IRBuilder<>::CreateLShr),   m_builder, _1, _2, "shr", false) },
-		{ "<<", bind(static_cast<shiftLeft_t>
-		            (&IRBuilder<>::CreateShl),    m_builder, _1, _2, "shl", false, false) },
-	};
-
-	Value* varLhs = boost::apply_visitor(*this, op.lhs);
+template <typename binary_op_t>
+Value* ast_codegen::generateBinaryOp(const binary_op_t& op) {
+	const location_scope at(*this, op.location);
+
+	Value* varLhs = visit(op.lhs);
 	//assert(varLhs);
 
 	if (!varLhs) {
@@ -599,13 +742,13 @@ Value* ast_codegen::operator()(const parser::binary_op& op) {
 	}
 
 	// This acts a chain, e.g.: "1 + 3 + i + k", varLhs is built up for each
-	for (auto& itr : op.operation) {
-		Value* varRhs = boost::apply_visitor(*this, itr.rhs);
+	for (const auto& itr : op.operation) {
+		Value* varRhs = visit(itr.rhs);
 		assert(varRhs);
 
-		const auto& itr2 = ops.find(itr.op);
-		if (itr2 == ops.end()) {
-			cerr << "Unknown operator: \"" << itr.op << "\"" << endl;
+		const binary_operator binOp = lookupBinaryOperator(itr.op);
+		if (binOp == binary_operator::unknown) {
+			cerr << errorLocation() << "Unknown operator: \"" << itr.op << "\"" << endl;
 			assert(false && "Unsupported operator");
 			return nullptr;
 		}
@@ -615,14 +758,16 @@ Value* ast_codegen::operator()(const parser::binary_op& op) {
 			varRhs = castInt(varLhs, varRhs, m_builder);
 		}
 
-		// Call the mapped operator type to create the appropriate one
-		varLhs = itr2->second(varLhs, varRhs);
+		varLhs = createBinaryOperator(m_builder, binOp, varLhs, varRhs);
 	}
 
 	return varLhs;
 }
 
-Value* ast_codegen::operator()(const parser::while_loop& loop) {
+template <typename while_loop_t>
+Value* ast_codegen::generateWhileLoop(const while_loop_t& loop) {
+	const location_scope at(*this, loop.location);
+
 	Function *TheFunction = m_builder.GetInsertBlock()->getParent();
 
 	BasicBlock *LoopBB = BasicBlock::Create(*m_context, "while.body");
@@ -633,19 +778,24 @@ Value* ast_codegen::operator()(const parser::while_loop& loop) {
 	m_builder.SetInsertPoint(loopCond);
 
 	// Generate the condition code directly
-	Value* const cond = (*this)(loop.condition);
+	Value* const cond = visit(loop.condition);
 	m_builder.CreateCondBr(cond, LoopBB, AfterBB);
 
+	// The body and exit are only entered from the condition, which itself stays open for the back-edge
+	if (m_directSsa) {
+		m_ssa->sealBlock(LoopBB);
+		m_ssa->sealBlock(AfterBB);
+	}
+
 	TheFunction->getBasicBlockList().push_back(LoopBB);
 	m_builder.SetInsertPoint(LoopBB);
 
-	// Created a new visitor, this allows scoping so our symbol table isn't re-used across other functions
-	ast_codegen symbolVisitor(*this);
-
-	// Generate the loop body
+	// Generate the loop body, its declarations go out of scope with it
 	bool branchGenerated = false;
+	symbol_table::scope bodyScope(m_symbolTable);
+
 	for (const auto& itrBody : loop.loopBody) {
-		Value* const v = boost::apply_visitor(symbolVisitor, itrBody);
+		Value* const v = visit(itrBody);
 		assert(v);
 
 		if ((v && isa<BranchInst>(v))) {
@@ -659,29 +809,125 @@ Value* ast_codegen::operator()(const parser::while_loop& loop) {
 		m_builder.CreateBr(loopCond);
 	}
 
+	if (m_directSsa) {
+		m_ssa->sealBlock(loopCond);
+	}
+
 	TheFunction->getBasicBlockList().push_back(AfterBB);
 	m_builder.SetInsertPoint(AfterBB);
 
 	return AfterBB;
 }
 
-Value* ast_codegen::operator()(const parser::var_assign& assign) {
+template <typename var_assign_t>
+Value* ast_codegen::generateAssignment(const var_assign_t& assign) {
+	const location_scope at(*this, assign.location);
+
 	BasicBlock *bb = m_builder.GetInsertBlock();
 	Function *TheFunction = bb->getParent();
-	const string varName = assign.varName;
+	const interned_string varName = assign.varName;
 
-	Value* const rhsVal = boost::apply_visitor(*this, assign.varRhs);
+	Value* const rhsVal = visit(assign.varRhs);
 
-	const auto& itr = m_symbolTable.find(varName);
-	if (itr == m_symbolTable.end()) {
-		cerr << "Unknown variable assignment: '" << assign.varName << "'" << endl;
+	const symbol* sym = m_symbolTable.find(varName);
+	if (!sym) {
+		cerr << errorLocation() << "Unknown variable assignment: '" << assign.varName << "'" << endl;
 		return nullptr;
 	}
 
-	return m_builder.CreateStore(rhsVal, itr->second);
+	if (sym->ssaVariable != symbol::noSsaVariable) {
+		if (!rhsVal) {
+			return nullptr;
+		}
+
+		Value* const val = castIntToType(rhsVal, m_ssa->variableType(sym->ssaVariable), m_builder);
+		m_ssa->writeVariable(sym->ssaVariable, m_builder.GetInsertBlock(), val);
+
+		return val;
+	}
+
+	return m_builder.CreateStore(rhsVal, sym->value);
 }
 
 Value* ast_codegen::operator()(const parser::udf_type& expr) {
 	return nullptr;
 }
 
+Value* ast_codegen::operator()(const parser::flat::udf_type& expr) {
+	return nullptr;
+}
+
+// Both ASTs share the code generation above
+
+Value* ast_codegen::operator()(const parser::func_expr& expr) {
+	return generateFunction(expr);
+}
+
+Value* ast_codegen::operator()(const parser::flat::func_expr& expr) {
+	return generateFunction(expr);
+}
+
+Value* ast_codegen::operator()(const parser::def_expr& expr) {
+	return generateDefinition(expr);
+}
+
+Value* ast_codegen::operator()(const parser::flat::def_expr& expr) {
+	return generateDefinition(expr);
+}
+
+Value* ast_codegen::operator()(const parser::decl_expr& expr) {
+	return generateDeclaration(expr);
+}
+
+Value* ast_codegen::operator()(const parser::flat::decl_expr& expr) {
+	return generateDeclaration(expr);
+}
+
+Value* ast_codegen::operator()(const parser::return_expr& expr) {
+	return generateReturn(expr);
+}
+
+Value* ast_codegen::operator()(const parser::flat::return_expr& expr) {
+	return generateReturn(expr);
+}
+
+Value* ast_codegen::operator()(const parser::call_expr& expr) {
+	return generateCall(expr);
+}
+
+Value* ast_codegen::operator()(const parser::flat::call_expr& expr) {
+	return generateCall(expr);
+}
+
+Value* ast_codegen::operator()(const parser::if_expr& expr) {
+	return generateIf(expr);
+}
+
+Value* ast_codegen::operator()(const parser::flat::if_expr& expr) {
+	return generateIf(expr);
+}
+
+Value* ast_codegen::operator()(const parser::binary_op& expr) {
+	return generateBinaryOp(expr);
+}
+
+Value* ast_codegen::operator()(const parser::flat::binary_op& expr) {
+	return generateBinaryOp(expr);
+}
+
+Value* ast_codegen::operator()(const parser::while_loop& expr) {
+	return generateWhileLoop(expr);
+}
+
+Value* ast_codegen::operator()(const parser::flat::while_loop& expr) {
+	return generateWhileLoop(expr);
+}
+
+Value* ast_codegen::operator()(const parser::var_assign& expr) {
+	return generateAssignment(expr);
+}
+
+Value* ast_codegen::operator()(const parser::flat::var_assign& expr) {
+	return generateAssignment(expr);
+}
+
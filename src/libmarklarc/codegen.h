@@ -1,7 +1,9 @@
 #pragma once
 
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <tuple>
 
 #include <llvm/IR/DerivedTypes.h>
@@ -9,7 +11,10 @@
 #include <llvm/IR/Value.h>
 #include <llvm/IR/Verifier.h>
 
+#include "flatast.h"
 #include "parser.h"
+#include "ssa.h"
+#include "symboltable.h"
 
 
 namespace marklar {
@@ -18,27 +23,60 @@ namespace marklar {
 	 */
 	class ast_codegen : public boost::static_visitor<llvm::Value*> {
 	public:
-		using symbolValue_t = std::map<std::string, llvm::Value*>;
+		// With directSsa the locals are kept as SSA values with phis at the merge points, rather
+		// than in allocas that are left for mem2reg
+		ast_codegen(llvm::LLVMContext* ctx, llvm::Module* m, llvm::IRBuilder<>& b, bool directSsa = false)
+		: m_context(ctx), m_module(m), m_builder(b), m_directSsa(directSsa) {}
 
-		ast_codegen(llvm::LLVMContext* ctx, llvm::Module* m, llvm::IRBuilder<>& b)
-		: m_context(ctx), m_module(m), m_builder(b) {}
+		// Scopes are entered and left on the one visitor, copies would share the builder's state
+		ast_codegen(const ast_codegen&) = delete;
+		ast_codegen& operator=(const ast_codegen&) = delete;
 
-		ast_codegen(const ast_codegen& rhs)
-		: m_context(rhs.m_context), m_module(rhs.m_module), m_builder(rhs.m_builder), m_symbolTable(rhs.m_symbolTable) {}
+		bool addSymbol(parser::interned_string name, llvm::Value* val) {
+			const bool exists = m_symbolTable.contains(name);
 
-		bool addSymbol(const std::string& name, llvm::Value* val) {
-			const bool exists = (m_symbolTable.find(name) != m_symbolTable.end());
+			if (!exists) {
+				m_symbolTable.set(name, val);
+			}
+
+			return !exists;
+		}
+
+		bool addSsaVariable(parser::interned_string name, llvm::Type* type, llvm::Value* val) {
+			const bool exists = m_symbolTable.contains(name);
 
 			if (!exists) {
-				m_symbolTable[name] = val;
+				symbol sym;
+				sym.ssaVariable = m_ssa->addVariable(type, name);
+				m_ssa->writeVariable(sym.ssaVariable, m_builder.GetInsertBlock(), val);
+				m_symbolTable.set(name, sym);
 			}
 
 			return !exists;
 		}
 
+		// Source the AST was parsed from, errors then start with the line and column of the node
+		void setSource(std::string_view source) {
+			m_source = source;
+		}
+
+		// Errors that leave the module valid, e.g. a function defined twice, the others are caught
+		// when the module is verified
+		bool failed() const {
+			return m_failed;
+		}
+
+		// Creates the function prototype (or returns the existing one) without generating its body,
+		// this allows calls to functions whose bodies live in another module
+		llvm::Function* declareFunction(const parser::func_expr& func);
+		llvm::Function* declareFunction(const parser::flat::func_expr& func);
+
+		// Whether a call to the name can be generated yet, i.e. it's printf or declared already
+		bool canCall(const std::string& name) const;
+
 
 		llvm::Value* operator()(const parser::base_expr& expr);
-		llvm::Value* operator()(const std::string& expr);
+		llvm::Value* operator()(const parser::interned_string& expr);
 		llvm::Value* operator()(const parser::func_expr& expr);
 		llvm::Value* operator()(const parser::def_expr& expr);
 		llvm::Value* operator()(const parser::decl_expr& expr);
@@ -51,12 +89,74 @@ namespace marklar {
 		llvm::Value* operator()(const parser::var_assign& expr);
 		llvm::Value* operator()(const parser::udf_type& expr);
 
+		// Same as above for the flat AST
+		llvm::Value* operator()(const parser::flat::base_expr& expr);
+		llvm::Value* operator()(const parser::flat::func_expr& expr);
+		llvm::Value* operator()(const parser::flat::def_expr& expr);
+		llvm::Value* operator()(const parser::flat::decl_expr& expr);
+		llvm::Value* operator()(const parser::flat::operator_expr& expr);
+		llvm::Value* operator()(const parser::flat::return_expr& expr);
+		llvm::Value* operator()(const parser::flat::call_expr& expr);
+		llvm::Value* operator()(const parser::flat::if_expr& expr);
+		llvm::Value* operator()(const parser::flat::binary_op& expr);
+		llvm::Value* operator()(const parser::flat::while_loop& expr);
+		llvm::Value* operator()(const parser::flat::var_assign& expr);
+		llvm::Value* operator()(const parser::flat::udf_type& expr);
+
 	private:
+		// Makes the node's location the one errors report until the scope ends, nodes without a
+		// location keep the enclosing one
+		class location_scope {
+		public:
+			location_scope(ast_codegen& codegen, parser::source_span location)
+			: m_codegen(codegen), m_previous(codegen.m_location) {
+				if (location.valid()) {
+					codegen.m_location = location;
+				}
+			}
+
+			~location_scope() {
+				m_codegen.m_location = m_previous;
+			}
+
+		private:
+			ast_codegen& m_codegen;
+			const parser::source_span m_previous;
+		};
+
+		// "line:column: " prefix for errors, empty without a source or location
+		std::string errorLocation() const;
+
+		llvm::Value* visit(const parser::base_expr_node& node);
+		llvm::Value* visit(const parser::binary_op& op);
+		llvm::Value* visit(parser::flat::any_node node);
+
+		// Each node is generated by one template shared by the parsed tree and the flat AST
+		template <typename func_expr_t> llvm::Function* declareFunctionPrototype(const func_expr_t& func);
+		template <typename func_expr_t> llvm::Value* generateFunction(const func_expr_t& func);
+		template <typename def_expr_t> llvm::Value* generateDefinition(const def_expr_t& def);
+		template <typename decl_expr_t> llvm::Value* generateDeclaration(const decl_expr_t& decl);
+		template <typename return_expr_t> llvm::Value* generateReturn(const return_expr_t& exprRet);
+		template <typename call_expr_t> llvm::Value* generateCall(const call_expr_t& expr);
+		template <typename if_expr_t> llvm::Value* generateIf(const if_expr_t& expr);
+		template <typename binary_op_t> llvm::Value* generateBinaryOp(const binary_op_t& op);
+		template <typename while_loop_t> llvm::Value* generateWhileLoop(const while_loop_t& loop);
+		template <typename var_assign_t> llvm::Value* generateAssignment(const var_assign_t& assign);
+
 		llvm::LLVMContext* m_context;
 		llvm::Module* m_module;
 		llvm::IRBuilder<>& m_builder;
 
-		symbolValue_t m_symbolTable;
+		symbol_table m_symbolTable;
+
+		// Direct SSA mode, variables in the symbol table refer to ids in the current function's builder
+		bool m_directSsa;
+		std::unique_ptr<ssa_builder> m_ssa;
+
+		std::string_view m_source;
+		parser::source_span m_location;
+
+		bool m_failed = false;
 	};
 
 }
@@ -0,0 +1,746 @@
+#include "descentparser.h"
+
+#include "flatast.h"
+#include "tokenizer.h"
+
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+
+using namespace marklar::lexer;
+using namespace parser;
+using namespace std;
+
+namespace {
+
+	// Position in the tokens, offset is only non-zero when a rule matched the start of an
+	// identifier, e.g. the keyword of "returnx" or a type name up to a quote
+	struct cursor {
+		uint32_t index;
+		uint32_t offset;
+	};
+
+	// The token at a cursor, or the part of the identifier that's left after the offset
+	struct lexeme {
+		token_kind kind;
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	// The same alternatives in the same order as the op rule of the X3 grammar
+	const char* const twoCharOps[] = { ">>", "<<", ">=", "<=", "!=", "==", "||", "&&" };
+	const char singleCharOps[] = "+<>%/*&-";
+
+	/* Every rule takes the cursor by reference and only moves it when the rule matched. Nodes
+	 * are added to the flat AST as soon as their children are complete, a rule that fails after
+	 * adding some rolls the arena back so an ordered choice can simply try the next alternative.
+	 *
+	 * Node producing rules leave the id of their node on the stack, like the flattener does.
+	 */
+	class descent_parser {
+	public:
+		// Without an output parseItems has to be used, it adds each item to an AST of its own. The
+		// source may be part of a file starting at base, locations are offsets into the whole file
+		descent_parser(string_view source, const vector<token>& tokens, flat::ast* out = nullptr, uint32_t base = 0)
+		: m_source(source), m_tokens(tokens), m_out(out), m_base(base) {}
+
+		// With lazyBodies only the signatures of functions are parsed, see marklar::parseLazily
+		bool parse(bool lazyBodies = false) {
+			m_lazyBodies = lazyBodies;
+
+			cursor c = { 0, 0 };
+
+			// *(udfType | funcExpr)
+			while (udfType(c) || funcExpr(c)) {
+			}
+
+			if (peek(c).kind != token_kind::end) {
+				return false;
+			}
+
+			add(flat::node_kind::base_expr, interned_string(), interned_string(), 0);
+			m_out->setRoot(m_stack.back());
+			return true;
+		}
+
+		// Same as parse but every top level item goes into its own AST, which is handed over as
+		// soon as the item is complete
+		bool parseItems(const function<bool(flat::ast&&)>& onItem) {
+			cursor c = { 0, 0 };
+
+			while (true) {
+				flat::ast item;
+				m_out = &item;
+
+				if (!udfType(c) && !funcExpr(c)) {
+					break;
+				}
+
+				item.setRoot(m_stack.back());
+				item.shrinkToFit();
+				m_stack.clear();
+
+				if (!onItem(std::move(item))) {
+					return false;
+				}
+			}
+
+			return peek(c).kind == token_kind::end;
+		}
+
+		// The statements of a function body without its braces
+		bool parseBody() {
+			cursor c = { 0, 0 };
+			statements(c);
+
+			if (peek(c).kind != token_kind::end) {
+				return false;
+			}
+
+			add(flat::node_kind::base_expr, interned_string(), interned_string(), 0);
+			m_out->setRoot(m_stack.back());
+			return true;
+		}
+
+	private:
+		lexeme peek(cursor c) const {
+			const token& t = m_tokens[c.index];
+			if (c.offset == 0) {
+				return lexeme{ t.kind, t.begin, t.end };
+			}
+
+			// Only identifiers are split, the rest is re-read the way the tokenizer would
+			const uint32_t begin = t.begin + c.offset;
+			const char ch = m_source[begin];
+
+			if (isIdentifierStart(ch)) {
+				return lexeme{ token_kind::identifier, begin, t.end };
+			}
+
+			if (isDigit(ch)) {
+				uint32_t end = begin + 1;
+				while (end < t.end && isDigit(m_source[end])) {
+					++end;
+				}
+
+				return lexeme{ token_kind::number, begin, end };
+			}
+
+			return lexeme{ token_kind::punct, begin, begin + 1 };
+		}
+
+		cursor advance(cursor c, uint32_t end) const {
+			const token& t = m_tokens[c.index];
+			if (end == t.end) {
+				return cursor{ c.index + 1, 0 };
+			}
+
+			return cursor{ c.index, end - t.begin };
+		}
+
+		string_view text(const lexeme& l) const {
+			return string_view(m_source.data() + l.begin, l.end - l.begin);
+		}
+
+		// Names repeat a lot, a small cache in front of the string table skips its lock and hash map
+		interned_string intern(string_view str) {
+			uint32_t hash = 2166136261u;
+			for (const char ch : str) {
+				hash = (hash ^ static_cast<uint8_t>(ch)) * 16777619u;
+			}
+
+			interned_string& cached = m_internCache[hash % internCacheSize];
+			if (cached.str() != str) {
+				cached = interned_string(str);
+			}
+
+			return cached;
+		}
+
+		// Source offset of the cursor, whitespace before it is already skipped
+		uint32_t offsetOf(cursor c) const {
+			return m_tokens[c.index].begin + c.offset;
+		}
+
+		// From begin up to the end of the last lexeme before the cursor, as X3 reports a rule's match
+		source_span span(uint32_t begin, cursor c) const {
+			const uint32_t end = (c.offset != 0 ? offsetOf(c) : m_tokens[c.index - 1].end);
+			return source_span{ begin, end - begin };
+		}
+
+		source_span span(string_view str) const {
+			return source_span{ static_cast<uint32_t>(str.data() - m_source.data()), static_cast<uint32_t>(str.size()) };
+		}
+
+		// Adds a node whose children are the ids pushed since mark, they're replaced by the node's id
+		void add(flat::node_kind kind, interned_string name, interned_string typeName, size_t mark, uint32_t split = 0, source_span location = source_span()) {
+			if (location.valid()) {
+				location.offset += m_base;
+			}
+
+			const uint32_t childCount = static_cast<uint32_t>(m_stack.size() - mark);
+			const flat::node_id id = m_out->add(kind, name, typeName, m_stack.data() + mark, childCount, split, location);
+
+			m_stack.resize(mark);
+			m_stack.push_back(id);
+		}
+
+		// Runs the rule on a copy of the cursor, everything it added is dropped when it fails
+		template <typename rule_t>
+		bool attempt(cursor& c, rule_t rule) {
+			const size_t stackSize = m_stack.size();
+			const flat::ast::checkpoint checkpoint = m_out->mark();
+
+			cursor p = c;
+			if (!rule(p)) {
+				m_stack.resize(stackSize);
+				m_out->rollback(checkpoint);
+				return false;
+			}
+
+			c = p;
+			return true;
+		}
+
+		bool punct(cursor& c, char ch) const {
+			const lexeme l = peek(c);
+			if (l.kind != token_kind::punct || m_source[l.begin] != ch) {
+				return false;
+			}
+
+			c = advance(c, l.end);
+			return true;
+		}
+
+		// Keywords are plain literals in the X3 grammar, they match the start of any identifier
+		bool keyword(cursor& c, const char* word, uint32_t length) const {
+			const lexeme l = peek(c);
+			if (l.kind != token_kind::identifier || l.end - l.begin < length || memcmp(m_source.data() + l.begin, word, length) != 0) {
+				return false;
+			}
+
+			c = advance(c, l.begin + length);
+			return true;
+		}
+
+		bool varName(cursor& c, string_view& name) const {
+			const lexeme l = peek(c);
+			if (l.kind != token_kind::identifier) {
+				return false;
+			}
+
+			name = text(l);
+			c = advance(c, l.end);
+			return true;
+		}
+
+		bool typeName(cursor& c, string_view& name) const {
+			const lexeme l = peek(c);
+			if (l.kind != token_kind::identifier) {
+				return false;
+			}
+
+			uint32_t end = l.begin + 1;
+			while (end < l.end && isTypeNameChar(m_source[end])) {
+				++end;
+			}
+
+			name = string_view(m_source.data() + l.begin, end - l.begin);
+			c = advance(c, end);
+			return true;
+		}
+
+		bool intLiteral(cursor& c) {
+			const lexeme l = peek(c);
+			if (l.kind != token_kind::number) {
+				return false;
+			}
+
+			c = advance(c, l.end);
+
+			// The X3 rule isn't a lexeme, digits separated by whitespace or comments are one literal
+			lexeme next = peek(c);
+			if (next.kind != token_kind::number) {
+				add(flat::node_kind::value, intern(text(l)), interned_string(), m_stack.size(), 0, span(text(l)));
+				return true;
+			}
+
+			string digits(text(l));
+			do {
+				digits.append(text(next));
+				c = advance(c, next.end);
+				next = peek(c);
+			} while (next.kind == token_kind::number);
+
+			add(flat::node_kind::value, intern(digits), interned_string(), m_stack.size(), 0, span(l.begin, c));
+			return true;
+		}
+
+		bool value(cursor& c) {
+			string_view name;
+			if (varName(c, name)) {
+				add(flat::node_kind::value, intern(name), interned_string(), m_stack.size(), 0, span(name));
+				return true;
+			}
+
+			return intLiteral(c);
+		}
+
+		bool quotedString(cursor& c) {
+			const lexeme l = peek(c);
+			if (l.kind != token_kind::string) {
+				return false;
+			}
+
+			add(flat::node_kind::value, intern(text(l)), interned_string(), m_stack.size(), 0, span(text(l)));
+			c = advance(c, l.end);
+			return true;
+		}
+
+		// Always matches, the operator may be empty
+		interned_string op(cursor& c) const {
+			static const interned_string twoChar[] = { ">>", "<<", ">=", "<=", "!=", "==", "||", "&&" };
+			static const interned_string singleChar[] = { "+", "<", ">", "%", "/", "*", "&", "-" };
+
+			const lexeme l = peek(c);
+			if (l.kind != token_kind::punct) {
+				return interned_string();
+			}
+
+			const cursor afterFirst = advance(c, l.end);
+			const char first = m_source[l.begin];
+
+			// Both characters of an operator have to be adjacent
+			const lexeme next = peek(afterFirst);
+			if (next.kind == token_kind::punct && next.begin == l.end) {
+				const char second = m_source[next.begin];
+
+				for (size_t i = 0; i < sizeof(twoCharOps) / sizeof(twoCharOps[0]); ++i) {
+					if (twoCharOps[i][0] == first && twoCharOps[i][1] == second) {
+						c = advance(afterFirst, next.end);
+						return twoChar[i];
+					}
+				}
+			}
+
+			const char* single = strchr(singleCharOps, first);
+			if (first == '\0' || !single) {
+				return interned_string();
+			}
+
+			c = afterFirst;
+			return singleChar[single - singleCharOps];
+		}
+
+		// factor >> *(op >> factor)
+		bool opExpr(cursor& c) {
+			const size_t mark = m_stack.size();
+			const uint32_t begin = offsetOf(c);
+			if (!factor(c)) {
+				return false;
+			}
+
+			while (attempt(c, [&](cursor& p) {
+				const size_t operationMark = m_stack.size();
+				const uint32_t operationBegin = offsetOf(p);
+				const interned_string name = op(p);
+				if (!factor(p)) {
+					return false;
+				}
+
+				add(flat::node_kind::operation, name, interned_string(), operationMark, 0, span(operationBegin, p));
+				return true;
+			})) {
+			}
+
+			add(flat::node_kind::binary_op, interned_string(), interned_string(), mark, 0, span(begin, c));
+			return true;
+		}
+
+		bool factor(cursor& c) {
+			const bool nested = attempt(c, [&](cursor& p) {
+				return punct(p, '(') && opExpr(p) && punct(p, ')');
+			});
+
+			return nested || callExpr(c) || value(c) || quotedString(c);
+		}
+
+		bool callExpr(cursor& c) {
+			return attempt(c, [&](cursor& p) {
+				string_view name;
+				if (!varName(p, name) || !punct(p, '(')) {
+					return false;
+				}
+
+				// *(callBaseExpr % ',')
+				const size_t mark = m_stack.size();
+				while (opExpr(p)) {
+					while (attempt(p, [&](cursor& q) { return punct(q, ',') && opExpr(q); })) {
+					}
+				}
+
+				if (!punct(p, ')')) {
+					return false;
+				}
+
+				add(flat::node_kind::call_expr, intern(name), interned_string(), mark, 0, span(offsetOf(c), p));
+				return true;
+			});
+		}
+
+		// Names are only interned once the definition is known to be kept
+		bool varDef(cursor& c, string_view& type, string_view& name) const {
+			cursor p = c;
+			if (!typeName(p, type) || !varName(p, name)) {
+				return false;
+			}
+
+			c = p;
+			return true;
+		}
+
+		void addDef(string_view type, string_view name) {
+			const string_view both(type.data(), name.data() + name.size() - type.data());
+			add(flat::node_kind::def_expr, intern(name), intern(type), m_stack.size(), 0, span(both));
+		}
+
+		// varDef >> ';'
+		bool varDefStatement(cursor& c) {
+			cursor p = c;
+			string_view type, name;
+			if (!varDef(p, type, name) || !punct(p, ';')) {
+				return false;
+			}
+
+			addDef(type, name);
+			c = p;
+			return true;
+		}
+
+		// *baseExpr
+		void statements(cursor& c) {
+			while (baseExpr(c)) {
+			}
+		}
+
+		bool baseExpr(cursor& c) {
+			const token_kind kind = peek(c).kind;
+			if (kind == token_kind::number) {
+				return intLiteral(c);
+			}
+
+			// Every other alternative starts with a name or keyword
+			if (kind != token_kind::identifier) {
+				return false;
+			}
+
+			return returnExpr(c) || callStatement(c) || ifExpr(c) || varDefStatement(c) || varDecl(c) || varAssign(c) || whileLoop(c);
+		}
+
+		// callExpr >> ';'
+		bool callStatement(cursor& c) {
+			return attempt(c, [&](cursor& p) {
+				return callExpr(p) && punct(p, ';');
+			});
+		}
+
+		bool returnExpr(cursor& c) {
+			return attempt(c, [&](cursor& p) {
+				if (!keyword(p, "return", 6)) {
+					return false;
+				}
+
+				const size_t mark = m_stack.size();
+				if (!(callExpr(p) || opExpr(p) || value(p)) || !punct(p, ';')) {
+					return false;
+				}
+
+				add(flat::node_kind::return_expr, interned_string(), interned_string(), mark, 0, span(offsetOf(c), p));
+				return true;
+			});
+		}
+
+		// '(' op_expr ')' '{' *baseExpr '}', shared by if and while
+		bool conditionAndBody(cursor& c) {
+			if (!punct(c, '(') || !opExpr(c) || !punct(c, ')') || !punct(c, '{')) {
+				return false;
+			}
+
+			statements(c);
+			return punct(c, '}');
+		}
+
+		bool ifExpr(cursor& c) {
+			return attempt(c, [&](cursor& p) {
+				const size_t mark = m_stack.size();
+				if (!keyword(p, "if", 2) || !conditionAndBody(p)) {
+					return false;
+				}
+
+				const uint32_t thenCount = static_cast<uint32_t>(m_stack.size() - mark - 1);
+
+				// -("else" '{' *baseExpr '}')
+				attempt(p, [&](cursor& q) {
+					if (!keyword(q, "else", 4) || !punct(q, '{')) {
+						return false;
+					}
+
+					statements(q);
+					return punct(q, '}');
+				});
+
+				add(flat::node_kind::if_expr, interned_string(), interned_string(), mark, thenCount, span(offsetOf(c), p));
+				return true;
+			});
+		}
+
+		bool whileLoop(cursor& c) {
+			return attempt(c, [&](cursor& p) {
+				const size_t mark = m_stack.size();
+				if (!keyword(p, "while", 5) || !conditionAndBody(p)) {
+					return false;
+				}
+
+				add(flat::node_kind::while_loop, interned_string(), interned_string(), mark, 0, span(offsetOf(c), p));
+				return true;
+			});
+		}
+
+		// '=' (op_expr | value)
+		bool assignedValue(cursor& c) {
+			return attempt(c, [&](cursor& p) {
+				return punct(p, '=') && (opExpr(p) || value(p));
+			});
+		}
+
+		bool varDecl(cursor& c) {
+			return attempt(c, [&](cursor& p) {
+				string_view type, name;
+				if (!typeName(p, type) || !varName(p, name)) {
+					return false;
+				}
+
+				// Without a value the declaration holds an empty base_expr, as in the tree
+				const size_t mark = m_stack.size();
+				if (!assignedValue(p)) {
+					add(flat::node_kind::base_expr, interned_string(), interned_string(), mark);
+				}
+
+				if (!punct(p, ';')) {
+					return false;
+				}
+
+				add(flat::node_kind::decl_expr, intern(name), intern(type), mark, 0, span(offsetOf(c), p));
+				return true;
+			});
+		}
+
+		bool varAssign(cursor& c) {
+			return attempt(c, [&](cursor& p) {
+				const size_t mark = m_stack.size();
+				string_view name;
+				if (!varName(p, name) || !assignedValue(p) || !punct(p, ';')) {
+					return false;
+				}
+
+				add(flat::node_kind::var_assign, intern(name), interned_string(), mark, 0, span(offsetOf(c), p));
+				return true;
+			});
+		}
+
+		bool udfType(cursor& c) {
+			return attempt(c, [&](cursor& p) {
+				string_view name;
+				if (!keyword(p, "type", 4) || !varName(p, name) || !punct(p, '{')) {
+					return false;
+				}
+
+				// *(varDef >> ';')
+				const size_t mark = m_stack.size();
+				while (varDefStatement(p)) {
+				}
+
+				if (!punct(p, '}')) {
+					return false;
+				}
+
+				add(flat::node_kind::udf_type, intern(name), interned_string(), mark, 0, span(offsetOf(c), p));
+				return true;
+			});
+		}
+
+		bool funcExpr(cursor& c) {
+			return attempt(c, [&](cursor& p) {
+				string_view returnType, name;
+				if (!typeName(p, returnType) || !varName(p, name) || !punct(p, '(')) {
+					return false;
+				}
+
+				// *(varDef % ',')
+				const size_t mark = m_stack.size();
+				string_view argType, argName;
+				while (varDef(p, argType, argName)) {
+					addDef(argType, argName);
+
+					while (true) {
+						cursor q = p;
+						if (!punct(q, ',') || !varDef(q, argType, argName)) {
+							break;
+						}
+
+						addDef(argType, argName);
+						p = q;
+					}
+				}
+
+				const uint32_t argCount = static_cast<uint32_t>(m_stack.size() - mark);
+				if (!punct(p, ')') || !punct(p, '{')) {
+					return false;
+				}
+
+				if (m_lazyBodies) {
+					const uint32_t bodyBegin = offsetOf(p);
+					if (!skipBody(p)) {
+						return false;
+					}
+
+					const source_span body{ bodyBegin + m_base, offsetOf(p) - bodyBegin };
+					punct(p, '}');
+
+					add(flat::node_kind::func_expr, intern(name), intern(returnType), mark, argCount, span(offsetOf(c), p));
+					m_out->addLazyBody(m_stack.back(), body);
+					return true;
+				}
+
+				statements(p);
+				if (!punct(p, '}')) {
+					return false;
+				}
+
+				add(flat::node_kind::func_expr, intern(name), intern(returnType), mark, argCount, span(offsetOf(c), p));
+				return true;
+			});
+		}
+
+		// Moves the cursor to the brace closing the body the cursor is in. Braces only appear around
+		// blocks in the grammar, so in any body that parses this is the brace the statements end at
+		bool skipBody(cursor& c) const {
+			uint32_t depth = 0;
+
+			for (uint32_t i = c.index; m_tokens[i].kind != token_kind::end; ++i) {
+				const token& t = m_tokens[i];
+				if (t.kind != token_kind::punct) {
+					continue;
+				}
+
+				if (m_source[t.begin] == '{') {
+					++depth;
+				} else if (m_source[t.begin] == '}') {
+					if (depth == 0) {
+						c = cursor{ i, 0 };
+						return true;
+					}
+
+					--depth;
+				}
+			}
+
+			return false;
+		}
+
+		const string_view m_source;
+		const vector<token>& m_tokens;
+		flat::ast* m_out;
+		const uint32_t m_base;
+		bool m_lazyBodies = false;
+		vector<flat::node_id> m_stack;
+
+		static const size_t internCacheSize = 4096;
+		interned_string m_internCache[internCacheSize];
+	};
+
+}
+
+namespace marklar {
+
+	namespace descent {
+
+		bool parse(string_view str, flat::ast& out) {
+			vector<token> tokens;
+			if (!tokenize(str, tokens)) {
+				return false;
+			}
+
+			out.clear();
+
+			// Most tokens end up as one node
+			out.reserve(tokens.size(), tokens.size());
+
+			descent_parser parser(str, tokens, &out);
+			const bool parsed = parser.parse();
+
+			out.shrinkToFit();
+			return parsed;
+		}
+
+		bool parseLazily(string_view str, flat::ast& out) {
+			vector<token> tokens;
+			if (!tokenize(str, tokens)) {
+				return false;
+			}
+
+			out.clear();
+			out.setSource(str);
+
+			descent_parser parser(str, tokens, &out);
+			const bool parsed = parser.parse(true);
+
+			out.shrinkToFit();
+			return parsed;
+		}
+
+		bool parseBody(string_view source, source_span body, flat::ast& out) {
+			const string_view str = source.substr(body.offset, body.length);
+
+			vector<token> tokens;
+			if (!tokenize(str, tokens)) {
+				return false;
+			}
+
+			out.clear();
+			out.reserve(tokens.size(), tokens.size());
+
+			descent_parser parser(str, tokens, &out, body.offset);
+			const bool parsed = parser.parseBody();
+
+			out.shrinkToFit();
+			return parsed;
+		}
+
+		bool parseItems(string_view str, const function<bool(flat::ast&&)>& onItem) {
+			vector<token> tokens;
+			if (!tokenize(str, tokens)) {
+				return false;
+			}
+
+			// Each item builds and frees its own arena, it's only the tokens that cover the whole source
+			descent_parser parser(str, tokens);
+			return parser.parseItems(onItem);
+		}
+
+		bool parse(string_view str, base_expr_node& root) {
+			flat::ast flatAst;
+			if (!parse(str, flatAst)) {
+				return false;
+			}
+
+			unflatten(flatAst, root);
+			return true;
+		}
+
+	}
+
+}
+
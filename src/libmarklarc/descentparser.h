@@ -0,0 +1,36 @@
+#pragma once
+
+#include <functional>
+#include <string_view>
+
+#include "flatast.h"
+#include "parser.h"
+
+
+namespace marklar {
+
+	/* Recursive descent parser over the tokens of lexer::tokenize. It implements the same grammar
+	 * as the Spirit X3 parser in parser.cpp, including its ordered choices, but builds the flat
+	 * AST directly so no tree node is allocated while parsing.
+	 */
+	namespace descent {
+
+		bool parse(std::string_view str, parser::flat::ast& out);
+
+		// Skips the function bodies by matching their braces, see marklar::parseLazily
+		bool parseLazily(std::string_view str, parser::flat::ast& out);
+
+		// Parses the statements of a body skipped by parseLazily, the root of out is a base_expr
+		// holding them. Locations are still offsets into the whole source
+		bool parseBody(std::string_view source, parser::source_span body, parser::flat::ast& out);
+
+		// Parses one top level type or function at a time, see marklar::parseItems
+		bool parseItems(std::string_view str, const std::function<bool(parser::flat::ast&&)>& onItem);
+
+		// Parses into the flat AST and unflattens it, the tree is the same as the X3 parser's
+		bool parse(std::string_view str, parser::base_expr_node& root);
+
+	}
+
+}
+
@@ -2,17 +2,48 @@
 
 #include <boost/variant/get.hpp>
 
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
 #include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/IR/IRBuilder.h>
 #include "llvm/IR/LLVMContext.h"
+#include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Module.h>
-#include <llvm/Support/raw_ostream.h>
+#include <llvm/IRReader/IRReader.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
 
 #include "parser.h"
+#include "astdump.h"
+#include "bytecode.h"
+#include "cache.h"
+#include "callgraph.h"
 #include "codegen.h"
+#include "flatast.h"
+#include "jit.h"
+#include "precompiled.h"
+#include "profiler.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
 
 
 using namespace marklar;
@@ -21,91 +52,876 @@ using namespace parser;
 using namespace llvm;
 using namespace std;
 
-namespace marklar {
+namespace {
 
-	namespace driver {
+	// Describes the optimization and code generation settings below, part of the cache key
+	string codegenFlags(unsigned optLevel) {
+		const string flags = "-O" + to_string(optLevel) + " -mcpu=generic -relocation-model=pic";
+		return (optLevel > 1 ? flags + " -loop-unroll -loop-vectorize -slp-vectorizer" : flags);
+	}
+
+	CodeGenOpt::Level codegenOptLevel(unsigned optLevel) {
+		switch (optLevel) {
+			case 0: return CodeGenOpt::None;
+			case 1: return CodeGenOpt::Less;
+			case 2: return CodeGenOpt::Default;
+			default: return CodeGenOpt::Aggressive;
+		}
+	}
+
+	// Builds a target machine for the host, equivalent to what 'llc -relocation-model=pic' would use
+	unique_ptr<TargetMachine> createHostTargetMachine(unsigned optLevel) {
+		static std::once_flag initFlag;
+		std::call_once(initFlag, []() {
+			InitializeNativeTarget();
+			InitializeNativeTargetAsmPrinter();
+		});
+
+		const string triple = sys::getDefaultTargetTriple();
+
+		string error;
+		const Target* target = TargetRegistry::lookupTarget(triple, error);
+		if (!target) {
+			cerr << "Failed to find target for '" << triple << "': " << error << endl;
+			return nullptr;
+		}
+
+		TargetOptions options;
+		return unique_ptr<TargetMachine>(
+			target->createTargetMachine(triple, "generic", "", options, Reloc::PIC_, None, codegenOptLevel(optLevel)));
+	}
+
+	bool parseSource(string_view fileContents, base_expr_node& rootAst) {
+		profiler::scope timer("parse");
+
+		if (!parse(fileContents, rootAst)) {
+			cerr << "Failed to parse source file!" << endl;
+			return false;
+		}
 
-		bool generateOutput(const string& fileContents, const string& outputBitCodeName) {
-			// Parse the source file
-			base_expr_node rootAst;
-			if (!parse(fileContents, rootAst)) {
+		return true;
+	}
+
+	// Number of parsed items the parsing thread may get ahead of codegen by
+	const size_t pipelineDepth = 16;
+
+	// Hands the top level items from the parsing thread to codegen, the parser blocks while the
+	// queue is full so only a few ASTs exist at any time
+	class item_queue {
+	public:
+		void push(flat::ast&& item) {
+			unique_lock<mutex> lock(m_mutex);
+			m_changed.wait(lock, [this]() { return m_items.size() < pipelineDepth; });
+
+			m_items.push_back(std::move(item));
+			m_changed.notify_all();
+		}
+
+		// No more items will be pushed
+		void close() {
+			lock_guard<mutex> lock(m_mutex);
+			m_closed = true;
+			m_changed.notify_all();
+		}
+
+		// Replaces item with the next one, false once the queue is closed and empty
+		bool pop(flat::ast& item) {
+			unique_lock<mutex> lock(m_mutex);
+			m_changed.wait(lock, [this]() { return !m_items.empty() || m_closed; });
+
+			if (m_items.empty()) {
+				return false;
+			}
+
+			item = std::move(m_items.front());
+			m_items.pop_front();
+			m_changed.notify_all();
+
+			return true;
+		}
+
+	private:
+		mutex m_mutex;
+		condition_variable m_changed;
+		deque<flat::ast> m_items;
+		bool m_closed = false;
+	};
+
+	// Parses on a second thread while the items parsed so far are generated, each item's AST is
+	// released as soon as the next one is taken from the queue. A function calling one further down
+	// is held back until the end, when every prototype has been declared
+	bool generatePipelined(string_view fileContents, ast_codegen& codeGenerator) {
+		item_queue queue;
+		bool parsed = false;
+
+		std::thread parserThread([&]() {
+			profiler::scope timer("parse");
+
+			parsed = parseItems(fileContents, [&](flat::ast&& item) {
+				queue.push(std::move(item));
+				return true;
+			});
+
+			queue.close();
+		});
+
+		vector<flat::ast> deferred;
+		bool declared = true;
+		{
+			profiler::scope timer("codegen");
+
+			// The queue is drained after a failure too, the parser would block on it otherwise
+			flat::ast item;
+			while (queue.pop(item)) {
+				const flat::node_ref root = item.root();
+				if (!declared) {
+					continue;
+				}
+
+				if (root.kind() == flat::node_kind::func_expr) {
+					const flat::func_expr func(root);
+					if (!codeGenerator.declareFunction(func)) {
+						declared = false;
+						continue;
+					}
+
+					const set<string> callees = collectCallees(func);
+					if (any_of(callees.begin(), callees.end(), [&](const string& callee) { return !codeGenerator.canCall(callee); })) {
+						deferred.push_back(std::move(item));
+						continue;
+					}
+				}
+
+				flat::apply_visitor(codeGenerator, flat::any_node(root));
+			}
+		}
+
+		parserThread.join();
+
+		if (!parsed) {
+			cerr << "Failed to parse source file!" << endl;
+			return false;
+		}
+
+		if (!declared) {
+			return false;
+		}
+
+		profiler::scope timer("codegen");
+		for (const auto& itr : deferred) {
+			flat::apply_visitor(codeGenerator, flat::any_node(itr.root()));
+		}
+
+		return true;
+	}
+
+	// Bodies of a lazily parsed AST are parsed when they're first needed, one that doesn't parse
+	// fails the module
+	bool materializeFunction(string_view fileContents, flat::ast& flatAst, flat::node_ref func) {
+		if (!flatAst.materialize(func.id)) {
+			const flat::func_expr view(func);
+			cerr << describeLocation(fileContents, view.location) << ": Failed to parse the body of '" << view.functionName << "'" << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// Generates the types and the functions main reaches through calls, the others are never lowered.
+	// Without a main every function is generated. With lazyParse only the bodies reached are parsed
+	bool generateReachable(string_view fileContents, ast_codegen& codeGenerator, bool lazyParse) {
+		// Parse the source file into the flat form codegen walks, only the spirit parser builds a tree first
+		flat::ast flatAst;
+		{
+			profiler::scope timer("parse");
+
+			if (!(lazyParse ? parseLazily(fileContents, flatAst) : parse(fileContents, flatAst))) {
 				cerr << "Failed to parse source file!" << endl;
 				return false;
 			}
+		}
 
-			// Generate the code
-			LLVMContext context;
+		const flat::node_list items = flat::base_expr(flatAst.root()).children;
+
+		multimap<string, flat::node_ref> functions;
+		for (const auto& itr : items) {
+			if (itr.kind() == flat::node_kind::func_expr) {
+				functions.emplace(itr.get().name, itr);
+			}
+		}
+
+		set<string> reachable;
+		if (functions.count("main") > 0) {
+			profiler::scope timer("callgraph");
+
+			bool materialized = true;
+			reachable = reachableFunctions("main", [&](const string& name, set<string>& callees) {
+				const auto range = functions.equal_range(name);
+				for (auto itr = range.first; itr != range.second; ++itr) {
+					materialized = materialized && materializeFunction(fileContents, flatAst, itr->second);
+					if (materialized) {
+						const set<string> calls = collectCallees(flat::func_expr(itr->second));
+						callees.insert(calls.begin(), calls.end());
+					}
+				}
+
+				return range.first != range.second;
+			});
+
+			if (!materialized) {
+				return false;
+			}
+		} else {
+			for (const auto& itr : functions) {
+				reachable.insert(itr.first);
+			}
+		}
+
+		profiler::scope timer("codegen");
+
+		// Every prototype is declared before any body is generated, so a function may call one
+		// defined after it. The sharded and cached builds work the same way
+		for (const auto& itr : items) {
+			if (itr.kind() != flat::node_kind::func_expr || reachable.count(itr.get().name) == 0) {
+				continue;
+			}
+
+			if (!materializeFunction(fileContents, flatAst, itr) || !codeGenerator.declareFunction(flat::func_expr(itr))) {
+				return false;
+			}
+		}
+
+		// Generate code for each expression at the root level
+		for (const auto& itr : items) {
+			if (itr.kind() == flat::node_kind::func_expr && reachable.count(itr.get().name) == 0) {
+				continue;
+			}
+
+			flat::apply_visitor(codeGenerator, itr);
+		}
+
+		return true;
+	}
+
+	// Only main is called from outside an executable built from a single module, internal linkage
+	// lets globaldce and the inliner drop or fold every other function
+	void internalizeFunctions(Module& module) {
+		for (Function& func : module) {
+			if (!func.isDeclaration() && func.getName() != "main") {
+				func.setLinkage(GlobalValue::InternalLinkage);
+			}
+		}
+	}
+
+	// The optimizer and code generator both need the module to agree with the target
+	void setModuleTarget(Module& module, const TargetMachine& targetMachine) {
+		module.setTargetTriple(targetMachine.getTargetTriple().str());
+		module.setDataLayout(targetMachine.createDataLayout());
+	}
+
+	// Perform an LLVM verify as a sanity check
+	bool verifyGeneratedModule(Module& module) {
+		profiler::scope timer("verify");
+
+		string errorInfo;
+		raw_string_ostream errorOut(errorInfo);
+
+		if (verifyModule(module, &errorOut)) {
+			cerr << "Failed to generate LLVM IR: " << errorOut.str() << endl;
+
+			module.print(errorOut, nullptr);
+			cerr << "Module:" << endl << errorOut.str() << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	string functionSignature(const func_expr& func) {
+		string signature = func.returnType.str() + " " + func.functionName.str() + "(";
+		for (const auto& argDef : func.args) {
+			signature += boost::get<def_expr>(argDef).typeName.str() + ",";
+		}
+
+		return signature + ")";
+	}
+
+	// Cache key of a single function, callee signatures are included since they decide how the
+	// arguments of each call are converted
+	string functionCacheKey(const func_expr& func, const map<string, const func_expr*>& functions, unsigned optLevel) {
+		string contents = dumpAst(func);
+		for (const auto& callee : collectCallees(func)) {
+			const auto itr = functions.find(callee);
+			if (itr != functions.end()) {
+				contents += "\n" + functionSignature(*itr->second);
+			}
+		}
+
+		return cache::computeKey(contents, codegenFlags(optLevel) + " " + sys::getDefaultTargetTriple());
+	}
+
+	// Generates, optimizes and emits the given functions into their own object, every other function
+	// is only declared so the calls are resolved by the linker
+	bool compileFunctionObject(string_view fileContents, const base_expr& root, const vector<const func_expr*>& funcs, const string& objName, unsigned optLevel) {
+		LLVMContext context;
+		unique_ptr<Module> module(new Module(funcs.front()->functionName.str(), context));
+		IRBuilder<> builder(context);
+
+		ast_codegen codeGenerator(&context, module.get(), builder, true);
+		codeGenerator.setSource(fileContents);
+
+		{
+			profiler::scope timer("codegen");
+
+			for (auto& itr : root.children) {
+				if (const func_expr* proto = boost::get<func_expr>(&itr)) {
+					if (!codeGenerator.declareFunction(*proto)) {
+						return false;
+					}
+				}
+			}
+
+			for (const func_expr* func : funcs) {
+				codeGenerator(*func);
+			}
+		}
+
+		if (codeGenerator.failed() || !verifyGeneratedModule(*module)) {
+			return false;
+		}
+
+		return driver::optimizeModule(*module, optLevel) && driver::emitObjectFile(*module, objName, optLevel);
+	}
+
+	// Runs job(0) .. job(count - 1) spread over up to 'jobs' threads, false if any job failed
+	template <typename job_t>
+	bool runParallel(size_t count, unsigned jobs, job_t job) {
+		atomic<size_t> next(0);
+		atomic<bool> succeeded(true);
+
+		const auto worker = [&]() {
+			for (size_t i = next++; i < count; i = next++) {
+				if (!job(i)) {
+					succeeded = false;
+				}
+			}
+		};
+
+		vector<std::thread> threads;
+		for (unsigned i = 1; i < min<size_t>(jobs, count); ++i) {
+			threads.emplace_back(worker);
+		}
+
+		worker();
+
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		return succeeded;
+	}
+
+	bool createTemporaryObject(const string& prefix, string& objName) {
+		SmallString<128> tmpObjName;
+		if (std::error_code ec = sys::fs::createTemporaryFile("marklar-" + prefix, "o", tmpObjName)) {
+			cerr << "Failed to create temporary object: " << ec.message() << endl;
+			return false;
+		}
+
+		objName = tmpObjName.str().str();
+		return true;
+	}
+
+	void removeObjects(const vector<string>& objNames) {
+		for (const auto& objName : objNames) {
+			if (!objName.empty()) {
+				sys::fs::remove(objName);
+			}
+		}
+	}
+
+	// Splits the functions into one shard per job, each shard is generated, optimized and emitted
+	// into a temporary object by its own thread with a private context
+	bool compileShardObjects(string_view fileContents, const driver::compile_options& options, vector<string>& objNames) {
+		base_expr_node rootAst;
+		if (!parseSource(fileContents, rootAst)) {
+			return false;
+		}
+
+		const base_expr* root = boost::get<base_expr>(&rootAst);
+
+		// Calls between shards are resolved by the linker, so unlike a single module the functions keep
+		// their external linkage and only the unreachable ones can be left out
+		const vector<const func_expr*> functions = functionsReachedFromMain(*root);
+
+		// Contiguous shards keep neighbouring functions, which tend to call each other, inlinable
+		const size_t shardCount = min<size_t>(options.jobs, functions.size());
+		vector<vector<const func_expr*>> shards(shardCount);
+		for (size_t i = 0; i < functions.size(); ++i) {
+			shards[i * shardCount / functions.size()].push_back(functions[i]);
+		}
+
+		objNames.assign(shardCount, string());
+		for (size_t i = 0; i < shardCount; ++i) {
+			if (!createTemporaryObject("shard", objNames[i])) {
+				removeObjects(objNames);
+				return false;
+			}
+		}
+
+		const bool compiled = runParallel(shardCount, options.jobs, [&](size_t i) {
+			return compileFunctionObject(fileContents, *root, shards[i], objNames[i], options.optLevel);
+		});
+
+		if (!compiled) {
+			removeObjects(objNames);
+		}
+
+		return compiled;
+	}
+
+	// Collects one cached object per function, only the functions missing from the cache are compiled
+	bool compileFunctionObjects(string_view fileContents, const driver::compile_options& options, vector<string>& objNames) {
+		base_expr_node rootAst;
+		if (!parseSource(fileContents, rootAst)) {
+			return false;
+		}
+
+		const base_expr* root = boost::get<base_expr>(&rootAst);
+
+		// Each function is its own object, so a name defined twice has to be caught here rather than by codegen
+		map<string, const func_expr*> functions;
+		for (const func_expr* func : functionsReachedFromMain(*root)) {
+			if (!functions.emplace(func->functionName, func).second) {
+				cerr << describeLocation(fileContents, func->location) << ": Error: Function '" << func->functionName << "' is defined more than once" << endl;
+				return false;
+			}
+		}
+
+		vector<pair<const func_expr*, string>> misses;
+		for (const auto& itr : functions) {
+			const func_expr& func = *itr.second;
+			const string key = functionCacheKey(func, functions, options.optLevel);
+
+			if (!cache::contains(options.cacheDir, key)) {
+				misses.emplace_back(&func, key);
+			}
+
+			objNames.push_back(cache::objectPath(options.cacheDir, key));
+		}
+
+		return runParallel(misses.size(), options.jobs, [&](size_t i) {
+			const func_expr& func = *misses[i].first;
+
+			string tmpObjName;
+			if (!createTemporaryObject(func.functionName, tmpObjName)) {
+				return false;
+			}
+
+			const bool compiled = compileFunctionObject(fileContents, *root, { &func }, tmpObjName, options.optLevel);
+			const bool cached = compiled && cache::insert(options.cacheDir, misses[i].second, tmpObjName);
+			sys::fs::remove(tmpObjName);
+
+			return cached;
+		});
+	}
+
+	// Opens the precompiled modules a source is compiled and run against, the pointers are owned by modules
+	bool openModules(const vector<string>& filenames, vector<unique_ptr<bytecode::precompiled_module>>& modules, vector<const bytecode::precompiled_module*>& libraries) {
+		profiler::scope timer("open modules");
+
+		for (const auto& filename : filenames) {
+			modules.push_back(bytecode::precompiled_module::open(filename));
+			if (!modules.back()) {
+				return false;
+			}
+
+			libraries.push_back(modules.back().get());
+		}
+
+		return true;
+	}
+
+}
+
+namespace marklar {
+
+	namespace driver {
+
+		unique_ptr<source_file> source_file::open(const string& filename) {
+			// Without a null terminator LLVM maps the file unless it's only a few pages
+			ErrorOr<unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(filename, -1, false);
+			if (!buffer) {
+				cerr << "Failed to open '" << filename << "': " << buffer.getError().message() << endl;
+				return nullptr;
+			}
+
+			return unique_ptr<source_file>(new source_file(std::move(*buffer)));
+		}
+
+		source_file::source_file(unique_ptr<MemoryBuffer> buffer)
+		: m_buffer(std::move(buffer)) {}
+
+		source_file::~source_file() = default;
+
+		string_view source_file::text() const {
+			return string_view(m_buffer->getBufferStart(), m_buffer->getBufferSize());
+		}
+
+		unique_ptr<Module> generateModule(string_view fileContents, LLVMContext& context, bool pipeline, bool lazyParse) {
 			unique_ptr<Module> module(new Module("", context));
 			IRBuilder<> builder(context);
 
-			ast_codegen codeGenerator(&context, module.get(), builder);
+			// Locals go straight to SSA form, unoptimized and JIT builds don't depend on mem2reg
+			ast_codegen codeGenerator(&context, module.get(), builder, true);
+			codeGenerator.setSource(fileContents);
 
-			// Generate code for each expression at the root level
-			const base_expr* expr = boost::get<base_expr>(&rootAst);
-			for (auto& itr : expr->children) {
-				boost::apply_visitor(codeGenerator, itr);
+			if (pipeline && !lazyParse) {
+				if (!generatePipelined(fileContents, codeGenerator)) {
+					return nullptr;
+				}
+			} else if (!generateReachable(fileContents, codeGenerator, lazyParse)) {
+				return nullptr;
 			}
 
-			// Perform an LLVM verify as a sanity check
-			string errorInfo;
-			raw_string_ostream errorOut(errorInfo);
+			if (codeGenerator.failed() || !verifyGeneratedModule(*module)) {
+				return nullptr;
+			}
 
-			if (verifyModule(*module, &errorOut)) {
-				cerr << "Failed to generate LLVM IR: " << errorInfo << endl;
+			return module;
+		}
 
-				module->print(errorOut, nullptr);
-				cerr << "Module:" << endl << errorInfo << endl;
+		bool generateOutput(string_view fileContents, const string& outputBitCodeName) {
+			LLVMContext context;
+
+			unique_ptr<Module> module = generateModule(fileContents, context);
+			if (!module) {
 				return false;
 			}
 
+			// The bitcode is only ever linked into an executable on its own
+			internalizeFunctions(*module);
+
 			// Dump the LLVM IR to a file
+			profiler::scope timer("bitcode");
+
 			std::error_code ec;
 			llvm::raw_fd_ostream outStream(outputBitCodeName.c_str(), ec, llvm::sys::fs::F_None);
+			if (ec) {
+				cerr << "Failed to open '" << outputBitCodeName << "': " << ec.message() << endl;
+				return false;
+			}
+
 			llvm::WriteBitcodeToFile(*module, outStream);
 
 			return true;
 		}
 
+		bool optimizeModule(Module& module, unsigned optLevel) {
+			profiler::scope timer("optimize");
+
+			const unique_ptr<TargetMachine> targetMachine = createHostTargetMachine(optLevel);
+			if (!targetMachine) {
+				return false;
+			}
+
+			setModuleTarget(module, *targetMachine);
+
+			// At -O3 this mirrors 'opt -O3 -loop-unroll -loop-vectorize -slp-vectorizer', the builder
+			// takes ownership of the inliner and library info
+			PassManagerBuilder passBuilder;
+			passBuilder.OptLevel = min(optLevel, 3u);
+			passBuilder.SizeLevel = 0;
+			passBuilder.LibraryInfo = new TargetLibraryInfoImpl(targetMachine->getTargetTriple());
+			passBuilder.DisableUnrollLoops = (optLevel == 0);
+			passBuilder.LoopVectorize = (optLevel > 1);
+			passBuilder.SLPVectorize = (optLevel > 1);
+
+			if (optLevel > 0) {
+				passBuilder.Inliner = createFunctionInliningPass(passBuilder.OptLevel, passBuilder.SizeLevel, false);
+			}
+
+			targetMachine->adjustPassManager(passBuilder);
+
+			legacy::FunctionPassManager functionPasses(&module);
+			functionPasses.add(createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
+			passBuilder.populateFunctionPassManager(functionPasses);
+
+			legacy::PassManager modulePasses;
+			modulePasses.add(createTargetTransformInfoWrapperPass(targetMachine->getTargetIRAnalysis()));
+			passBuilder.populateModulePassManager(modulePasses);
+
+			functionPasses.doInitialization();
+			for (Function& func : module) {
+				functionPasses.run(func);
+			}
+			functionPasses.doFinalization();
+
+			modulePasses.run(module);
+
+			return true;
+		}
+
+		bool emitObjectFile(Module& module, const string& objName, unsigned optLevel) {
+			profiler::scope timer("emit");
+
+			const unique_ptr<TargetMachine> targetMachine = createHostTargetMachine(optLevel);
+			if (!targetMachine) {
+				return false;
+			}
+
+			setModuleTarget(module, *targetMachine);
+
+			std::error_code ec;
+			raw_fd_ostream outStream(objName, ec, sys::fs::F_None);
+			if (ec) {
+				cerr << "Failed to open '" << objName << "': " << ec.message() << endl;
+				return false;
+			}
+
+			legacy::PassManager codegenPasses;
+			if (targetMachine->addPassesToEmitFile(codegenPasses, outStream, nullptr, TargetMachine::CGFT_ObjectFile)) {
+				cerr << "Target does not support emitting object files" << endl;
+				return false;
+			}
+
+			codegenPasses.run(module);
+			outStream.flush();
+
+			return true;
+		}
+
+		bool linkExecutable(const string& objName, const string& exeName) {
+			return linkExecutable(vector<string>{ objName }, exeName);
+		}
+
+		bool linkExecutable(const vector<string>& objNames, const string& exeName) {
+			profiler::scope timer("link");
+
+			// Leverage gcc here to link the object file into the final executable
+			// this is mainly to bypass the more complicated options that the system 'ld' needs
+			const string outputExeName = (exeName.empty() ? "a.out" : exeName);
+			string gccCmd = "gcc -o " + outputExeName;
+			for (const auto& objName : objNames) {
+				gccCmd += " " + objName;
+			}
+
+			const int retval = system(gccCmd.c_str());
+			if (retval != 0) {
+				cerr << "Error running 'gcc': \"" << gccCmd << "\"" << " -- returned: " << retval << endl;
+				return false;
+			}
+
+			return true;
+		}
+
 		bool optimizeAndLink(const string& bitCodeFilename, const string& exeName) {
-			const string tmpOptBCName = "output_opt.bc";
-			const string tmpObjName = "output.o";
+			LLVMContext context;
+
+			// Load the bitcode back in, the optimizer and code generator then run in-process
+			SMDiagnostic diag;
+			unique_ptr<Module> module = parseIRFile(bitCodeFilename, diag, context);
+			if (!module) {
+				string errorInfo;
+				raw_string_ostream errorOut(errorInfo);
+				diag.print("marklarc", errorOut);
+
+				cerr << "Failed to load bitcode '" << bitCodeFilename << "': " << errorOut.str() << endl;
+				return false;
+			}
+
+			// Every compile gets its own temporary object so concurrent builds cannot clobber each other
+			string tmpObjName;
+			if (!createTemporaryObject("output", tmpObjName)) {
+				return false;
+			}
+
+			if (!optimizeModule(*module) || !emitObjectFile(*module, tmpObjName)) {
+				sys::fs::remove(tmpObjName);
+				return false;
+			}
+
+			const bool linked = linkExecutable(tmpObjName, exeName);
+			sys::fs::remove(tmpObjName);
+
+			return linked;
+		}
+
+		bool compileExecutable(string_view fileContents, const string& exeName, const compile_options& options, bool* linkFailed) {
+			const auto link = [&](const auto& objNames) {
+				if (!linkExecutable(objNames, exeName)) {
+					if (linkFailed) {
+						*linkFailed = true;
+					}
+
+					return false;
+				}
+
+				return true;
+			};
+
+			// An identical source compiled with the same settings can skip straight to linking
+			const bool useCache = !options.cacheDir.empty();
+			string cacheKey;
 
-			// Optimize the generated bitcode with LLVM 'opt', produces an optimized bitcode file
-			{
-				const string optCmd = "opt -filetype=obj -o " + tmpOptBCName + " -O3 -loop-unroll -loop-vectorize -slp-vectorizer output.bc";
+			if (useCache) {
+				cacheKey = cache::computeKey(fileContents, codegenFlags(options.optLevel) + " " + sys::getDefaultTargetTriple());
 
-				const int retval = system(optCmd.c_str());
-				if (retval != 0) {
-					cerr << "Error running 'opt': \"" << optCmd << "\"" << endl;
+				if (cache::contains(options.cacheDir, cacheKey)) {
+					return link(cache::objectPath(options.cacheDir, cacheKey));
+				}
+
+				if (options.functionCache) {
+					vector<string> objNames;
+					return compileFunctionObjects(fileContents, options, objNames) && link(objNames);
+				}
+			}
+
+			// Shards are linked straight from their temporary objects, the whole-file cache only holds
+			// single objects from serial builds
+			if (options.jobs > 1) {
+				vector<string> objNames;
+				if (!compileShardObjects(fileContents, options, objNames)) {
 					return false;
 				}
+
+				const bool linked = link(objNames);
+				removeObjects(objNames);
+
+				return linked;
+			}
+
+			LLVMContext context;
+
+			unique_ptr<Module> module = generateModule(fileContents, context, options.pipeline, options.lazyParse);
+			if (!module) {
+				return false;
+			}
+
+			internalizeFunctions(*module);
+
+			string tmpObjName;
+			if (!createTemporaryObject("output", tmpObjName)) {
+				return false;
+			}
+
+			if (!optimizeModule(*module, options.optLevel) || !emitObjectFile(*module, tmpObjName, options.optLevel)) {
+				sys::fs::remove(tmpObjName);
+				return false;
+			}
+
+			// Failing to populate the cache only costs a future rebuild, carry on regardless
+			if (useCache) {
+				cache::insert(options.cacheDir, cacheKey, tmpObjName);
 			}
 
-			// Transform the bitcode into an object file with LLVM 'llc'
-			{
-				const string llcCmd = "llc -relocation-model=pic -filetype=obj -o " + tmpObjName + " " + tmpOptBCName;
+			const bool linked = link(tmpObjName);
+			sys::fs::remove(tmpObjName);
 
-				const int retval = system(llcCmd.c_str());
-				if (retval != 0) {
-					cerr << "Error running 'llc': \"" << llcCmd << "\"" << endl;
+			return linked;
+		}
+
+		bool compileExecutables(const vector<batch_input>& inputs, const compile_options& options, bool* linkFailed) {
+			// Two inputs writing the same executable would race, so the batch is refused up front
+			set<string> exeNames;
+			for (const auto& input : inputs) {
+				if (!exeNames.insert(input.exeName).second) {
+					cerr << "More than one input would produce '" << input.exeName << "'" << endl;
 					return false;
 				}
 			}
 
-			// Leverage gcc here to link the object file into the final executable
-			// this is mainly to bypass the more complicated options that the system 'ld' needs
-			{
-				const string outputExeName = (exeName.empty() ? "a.out" : exeName);
-				const string gccCmd = "gcc -o " + outputExeName + " " + tmpObjName;
-				
-				const int retval = system(gccCmd.c_str());
-				if (retval != 0) {
-					cerr << "Error running 'gcc': \"" << gccCmd << "\"" << " -- returned: " << retval << endl;
+			// Inputs are spread over the threads first, any threads left over shard each input
+			compile_options inputOptions = options;
+			inputOptions.jobs = max<size_t>(1, options.jobs / max<size_t>(1, inputs.size()));
+
+			atomic<bool> compileFailed(false);
+			atomic<bool> anyLinkFailed(false);
+
+			const bool compiled = runParallel(inputs.size(), options.jobs, [&](size_t i) {
+				bool inputLinkFailed = false;
+				if (!compileExecutable(inputs[i].input, inputs[i].exeName, inputOptions, &inputLinkFailed)) {
+					cerr << "Failed to " << (inputLinkFailed ? "link" : "compile") << " '" << inputs[i].exeName << "'" << endl;
+					(inputLinkFailed ? anyLinkFailed : compileFailed) = true;
 					return false;
 				}
+
+				return true;
+			});
+
+			if (linkFailed && anyLinkFailed && !compileFailed) {
+				*linkFailed = true;
 			}
 
-			return true;
+			return compiled;
+		}
+
+		bool runJIT(string_view fileContents, int& exitCode, const jit::jit_options& options) {
+			if (options.lazy) {
+				flat::ast flatAst;
+				{
+					profiler::scope timer("parse");
+
+					if (!parseLazily(fileContents, flatAst)) {
+						cerr << "Failed to parse source file!" << endl;
+						return false;
+					}
+				}
+
+				return jit::runMainLazily(flatAst, fileContents, exitCode);
+			}
+
+			// The JIT takes ownership of the context along with the module
+			unique_ptr<LLVMContext> context(new LLVMContext());
+
+			unique_ptr<Module> module = generateModule(fileContents, *context);
+			if (!module) {
+				return false;
+			}
+
+			return jit::runMain(std::move(module), std::move(context), exitCode, options);
+		}
+
+		bool runInterpreter(string_view fileContents, int& exitCode, ostream& out, const vector<string>& moduleNames) {
+			vector<unique_ptr<bytecode::precompiled_module>> modules;
+			vector<const bytecode::precompiled_module*> libraries;
+			if (!openModules(moduleNames, modules, libraries)) {
+				return false;
+			}
+
+			base_expr_node root;
+			if (!parseSource(fileContents, root)) {
+				return false;
+			}
+
+			bytecode::module program;
+			if (!bytecode::compile(root, program, fileContents, libraries)) {
+				return false;
+			}
+
+			return bytecode::run(program, exitCode, out, 1, libraries);
+		}
+
+		bool precompileModule(string_view fileContents, const string& outputName, const vector<string>& moduleNames) {
+			vector<unique_ptr<bytecode::precompiled_module>> modules;
+			vector<const bytecode::precompiled_module*> libraries;
+			if (!openModules(moduleNames, modules, libraries)) {
+				return false;
+			}
+
+			base_expr_node root;
+			if (!parseSource(fileContents, root)) {
+				return false;
+			}
+
+			// Without a main every function is compiled, which is what a library wants
+			bytecode::module program;
+			if (!bytecode::compile(root, program, fileContents, libraries)) {
+				return false;
+			}
+
+			profiler::scope timer("write module");
+			return bytecode::precompiled_module::create(program)->write(outputName);
 		}
 
 	}
@@ -1,18 +1,119 @@
 #pragma once
 
+#include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#include "jit.h"
+
+
+namespace llvm {
+	class LLVMContext;
+	class MemoryBuffer;
+	class Module;
+}
 
 namespace marklar {
 
 	namespace driver {
 
+		struct compile_options {
+			// Directory of the content-addressed object cache, caching is disabled when empty
+			std::string cacheDir;
+
+			// Cache one object per function so only edited functions are regenerated and optimized,
+			// this gives up inlining across functions
+			bool functionCache = false;
+
+			// Number of threads generating and optimizing code, above one the functions are split into
+			// shards compiled into separate objects which gives up inlining across shards
+			unsigned jobs = 1;
+
+			// Optimization level from 0 to 3, as with 'opt' and 'llc'
+			unsigned optLevel = 3;
+
+			// Parse and generate the top level items concurrently, see generateModule
+			bool pipeline = false;
+
+			// Parse each function body only when it's generated, see generateModule
+			bool lazyParse = false;
+		};
+
+		// Read-only view of a source file, anything but small files is memory mapped instead of copied
+		class source_file {
+		public:
+			// Reports the error and returns nullptr when the file can't be opened
+			static std::unique_ptr<source_file> open(const std::string& filename);
+
+			~source_file();
+
+			// Valid for the lifetime of the source_file
+			std::string_view text() const;
+
+		private:
+			explicit source_file(std::unique_ptr<llvm::MemoryBuffer> buffer);
+
+			std::unique_ptr<llvm::MemoryBuffer> m_buffer;
+		};
+
+		struct batch_input {
+			// Marklar source, only viewed so it has to outlive the compile
+			std::string_view input;
+
+			// Executable produced from the source
+			std::string exeName;
+		};
+
+		// Parses the Marklar source and generates a verified LLVM module, returns nullptr on failure.
+		// Functions may call ones defined after them in every mode.
+		// Functions main can't reach through calls aren't generated, unless there's no main.
+		// With pipeline a second thread parses one top level type or function at a time while codegen
+		// lowers the ones already parsed, so only the ASTs of a few items are held at once, every
+		// function is generated then. With lazyParse the descent parser only brace matches the
+		// function bodies up front and parses those main reaches. It takes precedence over pipeline
+		std::unique_ptr<llvm::Module> generateModule(std::string_view input, llvm::LLVMContext& context, bool pipeline = false, bool lazyParse = false);
+
 		// Intermediate step that will accept Marklar source and output LLVM bitcode
-		bool generateOutput(const std::string& input, const std::string& outputBitCodeName);
+		bool generateOutput(std::string_view input, const std::string& outputBitCodeName);
+
+		// Runs the optimization pipeline in-process on the module, -O3 adds loop and SLP vectorization
+		bool optimizeModule(llvm::Module& module, unsigned optLevel = 3);
+
+		// Lowers the module to a native object file for the host
+		bool emitObjectFile(llvm::Module& module, const std::string& objName, unsigned optLevel = 3);
+
+		// Links the object file into the final executable, this is the only step using an external tool
+		bool linkExecutable(const std::string& objName, const std::string& exeName = "");
+		bool linkExecutable(const std::vector<std::string>& objNames, const std::string& exeName = "");
 
 		// Find step that accepts the LLVM bitcode filename and produces an optimized executable
 		bool optimizeAndLink(const std::string& bitCodeFilename, const std::string& exeName = "");
 
+		// Full pipeline from Marklar source to executable without any intermediate bitcode files.
+		// linkFailed is set when the source compiled but the executable couldn't be linked
+		bool compileExecutable(std::string_view input, const std::string& exeName = "", const compile_options& options = compile_options(),
+		                       bool* linkFailed = nullptr);
+
+		// Compiles every input into its own executable with up to options.jobs inputs in flight at once,
+		// returns false if any of them failed or two share an exeName. linkFailed is set when every
+		// input compiled but some didn't link
+		bool compileExecutables(const std::vector<batch_input>& inputs, const compile_options& options = compile_options(),
+		                        bool* linkFailed = nullptr);
+
+		// Compiles the source with the in-process JIT and runs main(), nothing is written to disk
+		bool runJIT(std::string_view input, int& exitCode, const jit::jit_options& options = jit::jit_options());
+
+		// Compiles the source to bytecode and interprets main(), nothing goes through LLVM so it starts
+		// right away but runs slower than the JIT. printf writes to out. Functions the source calls
+		// without defining them come from the precompiled modules, in the order they're given
+		bool runInterpreter(std::string_view input, int& exitCode, std::ostream& out = std::cout, const std::vector<std::string>& modules = {});
+
+		// Compiles every function of the source to bytecode and writes it as a precompiled module, which
+		// later runs map instead of parsing the source again. It may call into the given modules itself
+		bool precompileModule(std::string_view input, const std::string& outputName, const std::vector<std::string>& modules = {});
+
 	}
 
 }
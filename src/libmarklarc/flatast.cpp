@@ -0,0 +1,334 @@
+#include "flatast.h"
+
+#include "descentparser.h"
+
+#include <algorithm>
+
+#include <boost/variant/apply_visitor.hpp>
+#include <boost/variant/static_visitor.hpp>
+
+
+using namespace parser;
+using namespace std;
+
+namespace parser {
+
+	namespace flat {
+
+		void ast::reserve(size_t nodes, size_t links) {
+			m_nodes.reserve(nodes);
+			m_links.reserve(links);
+		}
+
+		void ast::shrinkToFit() {
+			m_nodes.shrink_to_fit();
+			m_links.shrink_to_fit();
+			m_lazyBodies.shrink_to_fit();
+		}
+
+		void ast::clear() {
+			m_nodes.clear();
+			m_links.clear();
+			m_root = 0;
+			m_lazyBodies.clear();
+			m_source = string_view();
+		}
+
+		size_t ast::memoryUsage() const {
+			size_t bytes = m_nodes.capacity() * sizeof(node) + m_links.capacity() * sizeof(node_id) + m_lazyBodies.capacity() * sizeof(lazy_body);
+			for (const auto& itr : m_lazyBodies) {
+				if (itr.tree) {
+					bytes += itr.tree->memoryUsage();
+				}
+			}
+
+			return bytes;
+		}
+
+		node_list ast::body(node_id id) const {
+			const lazy_body* lazy = findLazyBody(id);
+			if (!lazy) {
+				return children(id, at(id).split, at(id).childCount);
+			}
+
+			if (!lazy->tree) {
+				return node_list(this, nullptr, nullptr);
+			}
+
+			// The statements live in the body's own ast, their views refer to it rather than this one
+			return lazy->tree->children(lazy->tree->m_root);
+		}
+
+		void ast::addLazyBody(node_id function, source_span span) {
+			assert(at(function).kind == node_kind::func_expr && at(function).childCount == at(function).split);
+			assert((m_lazyBodies.empty() || m_lazyBodies.back().function < function) && "Functions are added in order");
+
+			m_lazyBodies.push_back(lazy_body{ function, span, nullptr });
+		}
+
+		bool ast::materialize(node_id function) {
+			lazy_body* lazy = const_cast<lazy_body*>(findLazyBody(function));
+			if (!lazy || lazy->tree) {
+				return true;
+			}
+
+			unique_ptr<ast> tree(new ast());
+			if (!marklar::descent::parseBody(m_source, lazy->span, *tree)) {
+				return false;
+			}
+
+			lazy->tree = std::move(tree);
+			return true;
+		}
+
+		const ast::lazy_body* ast::findLazyBody(node_id function) const {
+			if (m_lazyBodies.empty()) {
+				return nullptr;
+			}
+
+			const auto itr = lower_bound(m_lazyBodies.begin(), m_lazyBodies.end(), function, [](const lazy_body& body, node_id id) {
+				return body.function < id;
+			});
+
+			return (itr != m_lazyBodies.end() && itr->function == function ? &*itr : nullptr);
+		}
+
+	}
+
+}
+
+namespace {
+
+	/* Adds the children of a node before the node itself, their ids are collected on one
+	 * shared stack so building a node doesn't allocate a list of its own.
+	 */
+	class flattener : public boost::static_visitor<flat::node_id> {
+	public:
+		explicit flattener(flat::ast& out)
+		: m_out(out) {}
+
+		flat::node_id operator()(const base_expr& expr) {
+			const size_t mark = m_stack.size();
+			push(expr.children);
+
+			return add(flat::node_kind::base_expr, interned_string(), interned_string(), mark);
+		}
+
+		flat::node_id operator()(const interned_string& expr) {
+			return m_out.add(flat::node_kind::value, expr, interned_string());
+		}
+
+		flat::node_id operator()(const func_expr& expr) {
+			const size_t mark = m_stack.size();
+			push(expr.args);
+			push(expr.expressions);
+
+			return add(flat::node_kind::func_expr, expr.functionName, expr.returnType, mark, static_cast<uint32_t>(expr.args.size()), expr.location);
+		}
+
+		flat::node_id operator()(const decl_expr& expr) {
+			const size_t mark = m_stack.size();
+			push(expr.val);
+
+			return add(flat::node_kind::decl_expr, expr.declName, expr.typeName, mark, 0, expr.location);
+		}
+
+		flat::node_id operator()(const def_expr& expr) {
+			return m_out.add(flat::node_kind::def_expr, expr.defName, expr.typeName, nullptr, 0, 0, expr.location);
+		}
+
+		flat::node_id operator()(const operator_expr& expr) {
+			const size_t mark = m_stack.size();
+			for (const auto& itr : expr.op_and_valRHS) {
+				m_stack.push_back((*this)(itr));
+			}
+
+			return add(flat::node_kind::operator_expr, expr.valLHS, interned_string(), mark);
+		}
+
+		flat::node_id operator()(const call_expr& expr) {
+			const size_t mark = m_stack.size();
+			push(expr.values);
+
+			return add(flat::node_kind::call_expr, expr.funcName, interned_string(), mark, 0, expr.location);
+		}
+
+		flat::node_id operator()(const return_expr& expr) {
+			const size_t mark = m_stack.size();
+			push(expr.ret);
+
+			return add(flat::node_kind::return_expr, interned_string(), interned_string(), mark, 0, expr.location);
+		}
+
+		flat::node_id operator()(const if_expr& expr) {
+			const size_t mark = m_stack.size();
+			m_stack.push_back((*this)(expr.condition));
+			push(expr.thenBranch);
+			push(expr.elseBranch);
+
+			return add(flat::node_kind::if_expr, interned_string(), interned_string(), mark, static_cast<uint32_t>(expr.thenBranch.size()), expr.location);
+		}
+
+		flat::node_id operator()(const binary_op& expr) {
+			const size_t mark = m_stack.size();
+			push(expr.lhs);
+
+			for (const auto& itr : expr.operation) {
+				const size_t operationMark = m_stack.size();
+				push(itr.rhs);
+
+				m_stack.push_back(add(flat::node_kind::operation, itr.op, interned_string(), operationMark));
+			}
+
+			return add(flat::node_kind::binary_op, interned_string(), interned_string(), mark, 0, expr.location);
+		}
+
+		flat::node_id operator()(const while_loop& expr) {
+			const size_t mark = m_stack.size();
+			m_stack.push_back((*this)(expr.condition));
+			push(expr.loopBody);
+
+			return add(flat::node_kind::while_loop, interned_string(), interned_string(), mark, 0, expr.location);
+		}
+
+		flat::node_id operator()(const var_assign& expr) {
+			const size_t mark = m_stack.size();
+			push(expr.varRhs);
+
+			return add(flat::node_kind::var_assign, expr.varName, interned_string(), mark, 0, expr.location);
+		}
+
+		flat::node_id operator()(const udf_type& expr) {
+			const size_t mark = m_stack.size();
+			push(expr.internalVars);
+
+			return add(flat::node_kind::udf_type, expr.typeName, interned_string(), mark, 0, expr.location);
+		}
+
+	private:
+		void push(const base_expr_node& node) {
+			m_stack.push_back(boost::apply_visitor(*this, node));
+		}
+
+		void push(const vector<base_expr_node>& nodes) {
+			for (const auto& itr : nodes) {
+				push(itr);
+			}
+		}
+
+		// Adds the node with the children pushed since mark and pops them
+		flat::node_id add(flat::node_kind kind, interned_string name, interned_string typeName, size_t mark, uint32_t split = 0, source_span location = source_span()) {
+			const uint32_t childCount = static_cast<uint32_t>(m_stack.size() - mark);
+			const flat::node_id id = m_out.add(kind, name, typeName, m_stack.data() + mark, childCount, split, location);
+
+			m_stack.resize(mark);
+			return id;
+		}
+
+		flat::ast& m_out;
+		vector<flat::node_id> m_stack;
+	};
+
+	// Builds the tree back from the views, each node is created from its already built children
+	class unflattener : public boost::static_visitor<base_expr_node> {
+	public:
+		base_expr_node operator()(const flat::base_expr& expr) const {
+			return base_expr{ list(expr.children) };
+		}
+
+		base_expr_node operator()(const interned_string& expr) const {
+			return expr;
+		}
+
+		base_expr_node operator()(const flat::func_expr& expr) const {
+			return func_expr{ expr.returnType, expr.functionName, list(expr.args), list(expr.expressions), expr.location };
+		}
+
+		base_expr_node operator()(const flat::decl_expr& expr) const {
+			return decl_expr{ expr.typeName, expr.declName, flat::apply_visitor(*this, expr.val), expr.location };
+		}
+
+		base_expr_node operator()(const flat::def_expr& expr) const {
+			return def_expr{ expr.typeName, expr.defName, expr.location };
+		}
+
+		base_expr_node operator()(const flat::operator_expr& expr) const {
+			operator_expr result{ expr.valLHS, {} };
+			for (const auto& itr : expr.op_and_valRHS) {
+				result.op_and_valRHS.push_back(itr.get().name);
+			}
+
+			return result;
+		}
+
+		base_expr_node operator()(const flat::call_expr& expr) const {
+			return call_expr{ expr.funcName, list(expr.values), expr.location };
+		}
+
+		base_expr_node operator()(const flat::return_expr& expr) const {
+			return return_expr{ flat::apply_visitor(*this, expr.ret), expr.location };
+		}
+
+		base_expr_node operator()(const flat::if_expr& expr) const {
+			return if_expr{ binaryOp(flat::binary_op(expr.condition)), list(expr.thenBranch), list(expr.elseBranch), expr.location };
+		}
+
+		base_expr_node operator()(const flat::binary_op& expr) const {
+			return binaryOp(expr);
+		}
+
+		base_expr_node operator()(const flat::while_loop& expr) const {
+			return while_loop{ binaryOp(flat::binary_op(expr.condition)), list(expr.loopBody), expr.location };
+		}
+
+		base_expr_node operator()(const flat::var_assign& expr) const {
+			return var_assign{ expr.varName, flat::apply_visitor(*this, expr.varRhs), expr.location };
+		}
+
+		base_expr_node operator()(const flat::udf_type& expr) const {
+			return udf_type{ expr.typeName, list(expr.internalVars), expr.location };
+		}
+
+	private:
+		binary_op binaryOp(const flat::binary_op& expr) const {
+			binary_op result{ flat::apply_visitor(*this, expr.lhs), {}, expr.location };
+			result.operation.reserve(expr.operation.size());
+
+			for (const auto& itr : expr.operation) {
+				result.operation.push_back(operation{ itr.op, flat::apply_visitor(*this, itr.rhs) });
+			}
+
+			return result;
+		}
+
+		vector<base_expr_node> list(const flat::node_list& nodes) const {
+			vector<base_expr_node> result;
+			result.reserve(nodes.size());
+
+			for (const auto& itr : nodes) {
+				result.push_back(flat::apply_visitor(*this, itr));
+			}
+
+			return result;
+		}
+	};
+
+}
+
+namespace marklar {
+
+	void flatten(const base_expr_node& tree, flat::ast& out) {
+		out.clear();
+
+		flattener builder(out);
+		out.setRoot(boost::apply_visitor(builder, tree));
+		out.shrinkToFit();
+	}
+
+	void unflatten(const flat::ast& flatAst, base_expr_node& tree) {
+		const unflattener builder;
+		tree = flat::apply_visitor(builder, flatAst.root());
+	}
+
+}
+
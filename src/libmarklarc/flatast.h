@@ -0,0 +1,486 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "parser.h"
+#include "stringtable.h"
+
+
+namespace parser {
+
+	/* Alternative to the base_expr_node tree where every node lives in one contiguous array and
+	 * refers to its children by index. The arrays act as the arena of the AST, nothing is allocated
+	 * per node and all of it is released at once with the ast.
+	 *
+	 * The views below mirror the parser structs field for field so visitors like ast_codegen can
+	 * share their code between both representations.
+	 */
+	namespace flat {
+
+		typedef uint32_t node_id;
+
+		enum class node_kind : uint8_t {
+			base_expr,
+			func_expr,
+			decl_expr,
+			def_expr,
+			operator_expr,
+			call_expr,
+			return_expr,
+			if_expr,
+			binary_op,
+			operation,
+			while_loop,
+			var_assign,
+			udf_type,
+			value
+		};
+
+		struct node {
+			node_kind kind : 8;
+
+			// Children are the links [firstChild, firstChild + childCount), nodes with two lists of
+			// children (e.g. the arguments and body of a function) store the first list's size in split
+			uint32_t split : 24;
+			uint32_t firstChild;
+			uint32_t childCount;
+
+			// Name, operator or literal depending on the kind
+			interned_string name;
+
+			// Type of functions, declarations and definitions
+			interned_string typeName;
+
+			// Range of the source the node was parsed from, inline since a side table costs an
+			// extra allocation and store per node
+			source_span location;
+		};
+
+		static_assert(sizeof(node) == 28, "Nodes are packed into seven words");
+
+		class ast;
+
+		// Handle to a node of an ast, only valid while the ast is alive and unchanged
+		struct node_ref {
+			const ast* tree;
+			node_id id;
+
+			const node& get() const;
+			source_span location() const;
+
+			node_kind kind() const {
+				return get().kind;
+			}
+		};
+
+		// Children of a node seen as view_t, e.g. node_range<def_expr> for the arguments of a function
+		template <typename view_t>
+		class node_range {
+		public:
+			class iterator {
+			public:
+				typedef std::forward_iterator_tag iterator_category;
+				typedef view_t value_type;
+				typedef std::ptrdiff_t difference_type;
+				typedef const view_t* pointer;
+				typedef view_t reference;
+
+				iterator(const ast* tree, const node_id* itr)
+				: m_tree(tree), m_itr(itr) {}
+
+				view_t operator*() const {
+					return view_t(node_ref{ m_tree, *m_itr });
+				}
+
+				iterator& operator++() {
+					++m_itr;
+					return *this;
+				}
+
+				bool operator==(const iterator& rhs) const {
+					return m_itr == rhs.m_itr;
+				}
+
+				bool operator!=(const iterator& rhs) const {
+					return m_itr != rhs.m_itr;
+				}
+
+			private:
+				const ast* m_tree;
+				const node_id* m_itr;
+			};
+
+			node_range(const ast* tree, const node_id* begin, const node_id* end)
+			: m_tree(tree), m_begin(begin), m_end(end) {}
+
+			iterator begin() const {
+				return iterator(m_tree, m_begin);
+			}
+
+			iterator end() const {
+				return iterator(m_tree, m_end);
+			}
+
+			size_t size() const {
+				return m_end - m_begin;
+			}
+
+			bool empty() const {
+				return m_begin == m_end;
+			}
+
+			view_t operator[](size_t i) const {
+				return view_t(node_ref{ m_tree, m_begin[i] });
+			}
+
+		private:
+			const ast* m_tree;
+			const node_id* m_begin;
+			const node_id* m_end;
+		};
+
+		// A node_ref is its own view, it can stand for any node
+		struct any_node : node_ref {
+			explicit any_node(node_ref ref)
+			: node_ref(ref) {}
+		};
+
+		typedef node_range<any_node> node_list;
+
+		class ast {
+		public:
+			ast() = default;
+
+			ast(const ast&) = delete;
+			ast& operator=(const ast&) = delete;
+
+			ast(ast&&) = default;
+			ast& operator=(ast&&) = default;
+
+			node_ref root() const {
+				return node_ref{ this, m_root };
+			}
+
+			const node& at(node_id id) const {
+				assert(id < m_nodes.size());
+				return m_nodes[id];
+			}
+
+			template <typename view_t = any_node>
+			node_range<view_t> children(node_id id, uint32_t begin, uint32_t end) const {
+				const node_id* first = m_links.data() + at(id).firstChild;
+				return node_range<view_t>(this, first + begin, first + end);
+			}
+
+			template <typename view_t = any_node>
+			node_range<view_t> children(node_id id) const {
+				return children<view_t>(id, 0, at(id).childCount);
+			}
+
+			// Appends a node whose children were already added, they are copied into the node's links
+			node_id add(node_kind kind, interned_string name, interned_string typeName, const node_id* children = nullptr, uint32_t childCount = 0, uint32_t split = 0,
+			            source_span location = source_span()) {
+				const node_id id = static_cast<node_id>(m_nodes.size());
+
+				assert(split < (1u << 24) && "Too many children for a node");
+
+				node n;
+				n.kind = kind;
+				n.name = name;
+				n.typeName = typeName;
+				n.firstChild = static_cast<uint32_t>(m_links.size());
+				n.childCount = childCount;
+				n.split = split;
+				n.location = location;
+
+				m_links.insert(m_links.end(), children, children + childCount);
+				m_nodes.push_back(n);
+
+				return id;
+			}
+
+			source_span location(node_id id) const {
+				return at(id).location;
+			}
+
+			void setRoot(node_id id) {
+				m_root = id;
+			}
+
+			// Statements of a function, empty while a lazily parsed body isn't materialized
+			node_list body(node_id id) const;
+
+			// Bodies skipped by parseLazily are parsed from the source on demand, it's only viewed so
+			// it has to outlive the ast
+			void setSource(std::string_view source) {
+				m_source = source;
+			}
+
+			// Marks the function, whose children are only its arguments, as having its statements in
+			// the given range of the source
+			void addLazyBody(node_id function, source_span span);
+
+			bool isMaterialized(node_id function) const {
+				const lazy_body* lazy = findLazyBody(function);
+				return !lazy || lazy->tree;
+			}
+
+			// Parses the body of a lazily parsed function unless that already happened, false if it
+			// doesn't parse. Views of the function taken before don't see the new body
+			bool materialize(node_id function);
+
+			// Sizes of the arena, rolling back to them drops every node added since
+			struct checkpoint {
+				size_t nodes;
+				size_t links;
+			};
+
+			checkpoint mark() const {
+				return checkpoint{ m_nodes.size(), m_links.size() };
+			}
+
+			void rollback(const checkpoint& to) {
+				m_nodes.resize(to.nodes);
+				m_links.resize(to.links);
+
+				while (!m_lazyBodies.empty() && m_lazyBodies.back().function >= to.nodes) {
+					m_lazyBodies.pop_back();
+				}
+			}
+
+			void reserve(size_t nodes, size_t links);
+			void clear();
+
+			// Releases the unused capacity once the AST is complete
+			void shrinkToFit();
+
+			size_t size() const {
+				return m_nodes.size();
+			}
+
+			// Bytes held by the arena, including the bodies materialized so far
+			size_t memoryUsage() const;
+
+		private:
+			// Statements of one function, the tree holds them under a base_expr root once materialized
+			struct lazy_body {
+				node_id function;
+				source_span span;
+				std::unique_ptr<ast> tree;
+			};
+
+			const lazy_body* findLazyBody(node_id function) const;
+
+			std::vector<node> m_nodes;
+			std::vector<node_id> m_links;
+			node_id m_root = 0;
+
+			// Ordered by function, empty unless the ast was parsed lazily
+			std::vector<lazy_body> m_lazyBodies;
+			std::string_view m_source;
+		};
+
+		inline const node& node_ref::get() const {
+			return tree->at(id);
+		}
+
+		inline source_span node_ref::location() const {
+			return tree->location(id);
+		}
+
+
+		// Views over the nodes named after the parser struct they stand for
+
+		struct base_expr {
+			explicit base_expr(node_ref ref)
+			: children(ref.tree->children(ref.id)) {}
+
+			node_list children;
+		};
+
+		struct def_expr {
+			explicit def_expr(node_ref ref)
+			: typeName(ref.get().typeName), defName(ref.get().name),
+			  location(ref.location()) {}
+
+			interned_string typeName;
+			interned_string defName;
+			source_span location;
+		};
+
+		struct func_expr {
+			explicit func_expr(node_ref ref)
+			: returnType(ref.get().typeName), functionName(ref.get().name),
+			  args(ref.tree->children(ref.id, 0, ref.get().split)),
+			  expressions(ref.tree->body(ref.id)),
+			  location(ref.location()) {}
+
+			interned_string returnType;
+			interned_string functionName;
+			node_list args;
+			node_list expressions;
+			source_span location;
+		};
+
+		struct decl_expr {
+			explicit decl_expr(node_ref ref)
+			: typeName(ref.get().typeName), declName(ref.get().name), val(ref.tree->children(ref.id)[0]),
+			  location(ref.location()) {}
+
+			interned_string typeName;
+			interned_string declName;
+			any_node val;
+			source_span location;
+		};
+
+		struct operator_expr {
+			explicit operator_expr(node_ref ref)
+			: valLHS(ref.get().name), op_and_valRHS(ref.tree->children(ref.id)) {}
+
+			interned_string valLHS;
+			node_list op_and_valRHS;
+		};
+
+		struct call_expr {
+			explicit call_expr(node_ref ref)
+			: funcName(ref.get().name), values(ref.tree->children(ref.id)),
+			  location(ref.location()) {}
+
+			interned_string funcName;
+			node_list values;
+			source_span location;
+		};
+
+		struct return_expr {
+			explicit return_expr(node_ref ref)
+			: ret(ref.tree->children(ref.id)[0]),
+			  location(ref.location()) {}
+
+			any_node ret;
+			source_span location;
+		};
+
+		struct operation {
+			explicit operation(node_ref ref)
+			: op(ref.get().name), rhs(ref.tree->children(ref.id)[0]) {}
+
+			interned_string op;
+			any_node rhs;
+		};
+
+		struct binary_op {
+			explicit binary_op(node_ref ref)
+			: lhs(ref.tree->children(ref.id)[0]), operation(ref.tree->children<flat::operation>(ref.id, 1, ref.get().childCount)),
+			  location(ref.location()) {}
+
+			any_node lhs;
+			node_range<flat::operation> operation;
+			source_span location;
+		};
+
+		// The condition is the first child, followed by both branches
+		struct if_expr {
+			explicit if_expr(node_ref ref)
+			: condition(ref.tree->children(ref.id)[0]),
+			  thenBranch(ref.tree->children(ref.id, 1, 1 + ref.get().split)),
+			  elseBranch(ref.tree->children(ref.id, 1 + ref.get().split, ref.get().childCount)),
+			  location(ref.location()) {}
+
+			any_node condition;
+			node_list thenBranch;
+			node_list elseBranch;
+			source_span location;
+		};
+
+		struct while_loop {
+			explicit while_loop(node_ref ref)
+			: condition(ref.tree->children(ref.id)[0]), loopBody(ref.tree->children(ref.id, 1, ref.get().childCount)),
+			  location(ref.location()) {}
+
+			any_node condition;
+			node_list loopBody;
+			source_span location;
+		};
+
+		struct var_assign {
+			explicit var_assign(node_ref ref)
+			: varName(ref.get().name), varRhs(ref.tree->children(ref.id)[0]),
+			  location(ref.location()) {}
+
+			interned_string varName;
+			any_node varRhs;
+			source_span location;
+		};
+
+		struct udf_type {
+			explicit udf_type(node_ref ref)
+			: typeName(ref.get().name), internalVars(ref.tree->children(ref.id)),
+			  location(ref.location()) {}
+
+			interned_string typeName;
+			node_list internalVars;
+			source_span location;
+		};
+
+		// Calls the visitor with the view of the node, as boost::apply_visitor does for base_expr_node
+		template <typename visitor_t>
+		typename visitor_t::result_type apply_visitor(visitor_t& visitor, node_ref ref) {
+			switch (ref.kind()) {
+				case node_kind::base_expr:     return visitor(base_expr(ref));
+				case node_kind::func_expr:     return visitor(func_expr(ref));
+				case node_kind::decl_expr:     return visitor(decl_expr(ref));
+				case node_kind::def_expr:      return visitor(def_expr(ref));
+				case node_kind::operator_expr: return visitor(operator_expr(ref));
+				case node_kind::call_expr:     return visitor(call_expr(ref));
+				case node_kind::return_expr:   return visitor(return_expr(ref));
+				case node_kind::if_expr:       return visitor(if_expr(ref));
+				case node_kind::binary_op:     return visitor(binary_op(ref));
+				case node_kind::while_loop:    return visitor(while_loop(ref));
+				case node_kind::var_assign:    return visitor(var_assign(ref));
+				case node_kind::udf_type:      return visitor(udf_type(ref));
+				case node_kind::value:         return visitor(ref.get().name);
+				case node_kind::operation:     break;
+			}
+
+			assert(false && "Operations are only visited through their binary_op");
+			return typename visitor_t::result_type();
+		}
+
+	}
+
+}
+
+namespace marklar {
+
+	// Converts the parsed tree into the flat AST, the tree isn't referenced afterwards
+	void flatten(const parser::base_expr_node& tree, parser::flat::ast& out);
+
+	// The reverse of flatten, rebuilds the tree from the root of the flat AST. Lazily parsed bodies
+	// that weren't materialized come out empty
+	void unflatten(const parser::flat::ast& flatAst, parser::base_expr_node& tree);
+
+	// Parses straight into the flat AST, only the spirit backend goes through the tree
+	bool parse(std::string_view str, parser::flat::ast& out, parser_backend backend);
+
+	bool parse(std::string_view str, parser::flat::ast& out);
+
+	// Parses the types and function signatures but only brace matches the function bodies, each is
+	// parsed once ast::materialize is called for its function. A syntax error in a body is only
+	// found then. Always uses the descent parser
+	bool parseLazily(std::string_view str, parser::flat::ast& out);
+
+	// Parses the top level types and functions one at a time, each goes into its own flat AST rooted
+	// at the item and is handed to onItem as soon as it's complete. Parsing stops when onItem returns
+	// false, true only if every item was accepted and the whole source parsed
+	bool parseItems(std::string_view str, const std::function<bool(parser::flat::ast&&)>& onItem, parser_backend backend);
+
+	bool parseItems(std::string_view str, const std::function<bool(parser::flat::ast&&)>& onItem);
+
+}
+
@@ -0,0 +1,389 @@
+#include "bytecode.h"
+#include "precompiled.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#include "profiler.h"
+
+
+using namespace marklar;
+using namespace marklar::bytecode;
+using namespace std;
+
+
+// GCC and Clang can jump through a table of label addresses, which gives each handler its own
+// indirect branch instead of sharing the one of a switch
+#if defined(__GNUC__)
+#define MARKLAR_COMPUTED_GOTO 1
+#endif
+
+namespace {
+
+	// Registers shared by every call, only the pages in use are ever touched
+	const size_t stackRegisters = 1 << 20;
+
+	// LLVM leaves INT_MIN / -1 undefined, here it wraps like the other arithmetic does
+	template <typename signed_t>
+	signed_t divide(signed_t lhs, signed_t rhs) {
+		return (rhs == -1 ? static_cast<signed_t>(0 - static_cast<make_unsigned_t<signed_t>>(lhs)) : lhs / rhs);
+	}
+
+	template <typename signed_t>
+	signed_t remainder(signed_t lhs, signed_t rhs) {
+		return (rhs == -1 ? 0 : lhs % rhs);
+	}
+
+	template <typename value_t>
+	void appendFormatted(string& text, const string& spec, value_t value) {
+		const int length = snprintf(nullptr, 0, spec.c_str(), value);
+		if (length <= 0) {
+			return;
+		}
+
+		const size_t offset = text.size();
+		text.resize(offset + length + 1);
+		snprintf(&text[offset], length + 1, spec.c_str(), value);
+		text.resize(offset + length);
+	}
+
+	// printf with the arguments taken from registers, string literals are held as their index in the
+	// module. compile() checked that each conversion gets an argument of the right kind, an image that
+	// doesn't keep to it gives false instead of reading anything it doesn't own. Integers are passed
+	// as int unless the length asks for more
+	bool formatPrintf(const precompiled_module& strings, const uint64_t* args, unsigned argCount, ostream& out, int& written) {
+		const auto stringArg = [&](uint64_t index) {
+			return (index < strings.stringCount() ? strings.stringAt(static_cast<uint32_t>(index)) : nullptr);
+		};
+
+		const char* const format = stringArg(args[0]);
+		if (!format) {
+			return false;
+		}
+
+		string text;
+		unsigned arg = 1;
+		for (const char* c = format; *c; ++c) {
+			if (*c != '%') {
+				text += *c;
+				continue;
+			}
+
+			const char* const conversion = c + 1 + strspn(c + 1, "-+ #0123456789.hljzt");
+			if (*conversion == '%') {
+				text += '%';
+				c = conversion;
+				continue;
+			}
+
+			if (*conversion == '\0' || !strchr("diouxXcs", *conversion)) {
+				return false;
+			}
+
+			string spec(c, conversion);
+			const uint64_t value = (arg < argCount ? args[arg++] : 0);
+
+			if (*conversion == 's') {
+				const char* const str = stringArg(value);
+				if (!str) {
+					return false;
+				}
+
+				appendFormatted(text, spec + 's', str);
+			} else if (spec.find_first_of("ljzt") != string::npos) {
+				spec.erase(remove_if(spec.begin(), spec.end(), [](char ch) { return strchr("hljzt", ch) != nullptr; }), spec.end());
+				appendFormatted(text, spec + "ll" + *conversion, static_cast<long long>(value));
+			} else {
+				appendFormatted(text, spec + *conversion, static_cast<int>(static_cast<uint32_t>(value)));
+			}
+
+			c = conversion;
+		}
+
+		out << text;
+		written = static_cast<int>(text.size());
+		return true;
+	}
+
+	struct linked_module;
+
+	// Where a call leads, a function of the same module or one it imports
+	struct call_target {
+		const linked_module* module;
+		const instruction* code;
+		uint32_t registerCount;
+		const char* name;
+	};
+
+	// Precompiled module with its imports resolved, calls index these targets
+	struct linked_module {
+		const precompiled_module* image;
+		vector<call_target> calls;
+	};
+
+	bool signaturesMatch(const precompiled_module& importer, const precompiled_import& imported, const precompiled_module& library, const precompiled_function& func) {
+		if (imported.returnType != func.returnType || imported.argCount != func.argCount) {
+			return false;
+		}
+
+		for (uint32_t i = 0; i < func.argCount; ++i) {
+			if (importer.argType(imported.firstArgType + i) != library.argType(func.firstArgType + i)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// The first module is the program, the imports of every module are looked up in order in the
+	// libraries other than itself. Only the targets are built, the precompiled modules are used as they are
+	bool link(vector<linked_module>& modules) {
+		for (auto& mod : modules) {
+			for (uint32_t i = 0; i < mod.image->functionCount(); ++i) {
+				const precompiled_function& func = mod.image->function(i);
+				mod.calls.push_back(call_target{ &mod, mod.image->code(func), func.registerCount, mod.image->stringAt(func.name) });
+			}
+		}
+
+		for (size_t m = 0; m < modules.size(); ++m) {
+			const precompiled_module& importer = *modules[m].image;
+
+			for (uint32_t i = 0; i < importer.importCount(); ++i) {
+				const precompiled_import& imported = importer.import(i);
+				const char* const name = importer.stringAt(imported.name);
+
+				bool found = false;
+				for (size_t l = 1; l < modules.size() && !found; ++l) {
+					const precompiled_function* func = (l != m ? modules[l].image->findFunction(name) : nullptr);
+					if (!func) {
+						continue;
+					}
+
+					if (!signaturesMatch(importer, imported, *modules[l].image, *func)) {
+						cerr << "Error: '" << name << "' in '" << modules[l].image->name() << "' no longer has the signature it was compiled against" << endl;
+						return false;
+					}
+
+					modules[m].calls.push_back(modules[l].calls[func - &modules[l].image->function(0)]);
+					found = true;
+				}
+
+				if (!found) {
+					cerr << "Error: No precompiled module defines '" << name << "'" << endl;
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	struct frame {
+		const call_target* func;
+		const instruction* pc;
+		uint64_t* registers;
+	};
+
+	bool execute(const call_target& entry, bool takesArgCount, int32_t argCount, ostream& out, uint64_t& result) {
+		unique_ptr<uint64_t[]> stack(new uint64_t[stackRegisters]);
+		const uint64_t* const stackEnd = stack.get() + stackRegisters;
+
+		vector<frame> frames;
+		frames.reserve(64);
+
+		const call_target* func = &entry;
+		const instruction* code = func->code;
+		const instruction* pc = code;
+		uint64_t* r = stack.get();
+
+		if (takesArgCount) {
+			r[0] = static_cast<uint32_t>(argCount);
+		}
+
+#define A r[pc->a]
+#define B r[pc->b]
+#define C r[pc->c]
+#define NEXT() ++pc; DISPATCH()
+
+#ifdef MARKLAR_COMPUTED_GOTO
+		static const void* const handlers[] = {
+#define MARKLAR_BYTECODE_LABEL(name, operands) &&op_##name,
+			MARKLAR_BYTECODE_OPCODES(MARKLAR_BYTECODE_LABEL)
+#undef MARKLAR_BYTECODE_LABEL
+		};
+
+#define DISPATCH() goto *handlers[static_cast<size_t>(pc->op)]
+#define HANDLER(name) op_##name:
+
+		DISPATCH();
+#else
+#define DISPATCH() continue
+#define HANDLER(name) case opcode::name:
+
+		for (;;) switch (pc->op) {
+#endif
+			HANDLER(move)           A = B; NEXT();
+			HANDLER(loadConstant)   A = pc->imm; NEXT();
+			HANDLER(loadString)     A = pc->imm; NEXT();
+			HANDLER(truncate1)      A = B & 1; NEXT();
+			HANDLER(truncate32)     A = static_cast<uint32_t>(B); NEXT();
+
+			HANDLER(add32)          A = static_cast<uint32_t>(B + C); NEXT();
+			HANDLER(add64)          A = B + C; NEXT();
+			HANDLER(sub32)          A = static_cast<uint32_t>(B - C); NEXT();
+			HANDLER(sub64)          A = B - C; NEXT();
+			HANDLER(mult32)         A = static_cast<uint32_t>(B * C); NEXT();
+			HANDLER(mult64)         A = B * C; NEXT();
+
+			HANDLER(div32)
+				if (static_cast<uint32_t>(C) == 0) goto divisionByZero;
+				A = static_cast<uint32_t>(divide<int32_t>(B, C)); NEXT();
+			HANDLER(div64)
+				if (C == 0) goto divisionByZero;
+				A = divide<int64_t>(B, C); NEXT();
+			HANDLER(rem32)
+				if (static_cast<uint32_t>(C) == 0) goto divisionByZero;
+				A = static_cast<uint32_t>(remainder<int32_t>(B, C)); NEXT();
+			HANDLER(rem64)
+				if (C == 0) goto divisionByZero;
+				A = remainder<int64_t>(B, C); NEXT();
+
+			// Shifting by the width or more gives poison in LLVM, zero here
+			HANDLER(shiftLeft32)    A = (C < 32 ? static_cast<uint32_t>(B << C) : 0); NEXT();
+			HANDLER(shiftLeft64)    A = (C < 64 ? B << C : 0); NEXT();
+			HANDLER(shiftRight32)   A = (C < 32 ? B >> C : 0); NEXT();
+			HANDLER(shiftRight64)   A = (C < 64 ? B >> C : 0); NEXT();
+			HANDLER(bitAnd)         A = B & C; NEXT();
+			HANDLER(bitOr)          A = B | C; NEXT();
+
+			HANDLER(equal)          A = (B == C); NEXT();
+			HANDLER(notEqual)       A = (B != C); NEXT();
+			HANDLER(lessThan32)     A = (static_cast<int32_t>(B) < static_cast<int32_t>(C)); NEXT();
+			HANDLER(lessThan64)     A = (static_cast<int64_t>(B) < static_cast<int64_t>(C)); NEXT();
+			HANDLER(greaterThan32)  A = (static_cast<int32_t>(B) > static_cast<int32_t>(C)); NEXT();
+			HANDLER(greaterThan64)  A = (static_cast<int64_t>(B) > static_cast<int64_t>(C)); NEXT();
+			HANDLER(lessEqual32)    A = (static_cast<int32_t>(B) <= static_cast<int32_t>(C)); NEXT();
+			HANDLER(lessEqual64)    A = (static_cast<int64_t>(B) <= static_cast<int64_t>(C)); NEXT();
+			HANDLER(greaterEqual32) A = (static_cast<int32_t>(B) >= static_cast<int32_t>(C)); NEXT();
+			HANDLER(greaterEqual64) A = (static_cast<int64_t>(B) >= static_cast<int64_t>(C)); NEXT();
+
+			HANDLER(jump)
+				pc = code + pc->imm; DISPATCH();
+			HANDLER(jumpIfZero)
+				pc = (A == 0 ? code + pc->imm : pc + 1); DISPATCH();
+			HANDLER(jumpIfNotZero)
+				pc = (A != 0 ? code + pc->imm : pc + 1); DISPATCH();
+
+			HANDLER(call) {
+				const call_target& callee = func->module->calls[pc->b];
+				uint64_t* const window = r + pc->c;
+				if (window + callee.registerCount > stackEnd) {
+					cerr << "Error: Stack overflow calling '" << callee.name << "'" << endl;
+					return false;
+				}
+
+				frames.push_back(frame{ func, pc, r });
+
+				func = &callee;
+				code = pc = callee.code;
+				r = window;
+				DISPATCH();
+			}
+
+			HANDLER(printf) {
+				int written = 0;
+				if (!formatPrintf(*func->module->image, &B, pc->c, out, written)) {
+					cerr << "Error: Invalid printf call in '" << func->name << "'" << endl;
+					return false;
+				}
+
+				A = static_cast<uint32_t>(written); NEXT();
+			}
+
+			HANDLER(ret) {
+				const uint64_t value = A;
+				if (frames.empty()) {
+					result = value;
+					return true;
+				}
+
+				const frame& caller = frames.back();
+				func = caller.func;
+				code = func->code;
+				pc = caller.pc;
+				r = caller.registers;
+				frames.pop_back();
+
+				A = value; NEXT();
+			}
+#ifndef MARKLAR_COMPUTED_GOTO
+			default:
+				return false;
+		}
+#endif
+
+#undef A
+#undef B
+#undef C
+#undef NEXT
+#undef DISPATCH
+#undef HANDLER
+
+	divisionByZero:
+		cerr << "Error: Division by zero in '" << func->name << "'" << endl;
+		return false;
+	}
+
+}
+
+namespace marklar {
+
+	namespace bytecode {
+
+		bool run(const precompiled_module& program, int& exitCode, ostream& out, int32_t argCount, const vector<const precompiled_module*>& libraries) {
+			profiler::scope timer("interpret");
+
+			const precompiled_function* mainFunc = program.findFunction("main");
+			if (!mainFunc) {
+				cerr << "Error: No 'main' function to run" << endl;
+				return false;
+			}
+
+			if (mainFunc->argCount > 1) {
+				cerr << "Error: Unsupported 'main' signature, expected at most one argument" << endl;
+				return false;
+			}
+
+			// Targets point at their module, which therefore mustn't move once linking starts
+			vector<linked_module> modules(libraries.size() + 1);
+			modules[0].image = &program;
+			for (size_t i = 0; i < libraries.size(); ++i) {
+				modules[i + 1].image = libraries[i];
+			}
+
+			if (!link(modules)) {
+				return false;
+			}
+
+			uint64_t result = 0;
+			if (!execute(modules[0].calls[mainFunc - &program.function(0)], mainFunc->argCount > 0, argCount, out, result)) {
+				return false;
+			}
+
+			out.flush();
+
+			exitCode = (mainFunc->returnType == value_type::i64 ? static_cast<int>(static_cast<int64_t>(result)) : static_cast<int32_t>(result));
+			return true;
+		}
+
+		bool run(const module& program, int& exitCode, ostream& out, int32_t argCount, const vector<const precompiled_module*>& libraries) {
+			return run(*precompiled_module::create(program), exitCode, out, argCount, libraries);
+		}
+
+	}
+
+}
+
@@ -0,0 +1,744 @@
+#include "jit.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/SmallVectorMemoryBuffer.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "callgraph.h"
+#include "codegen.h"
+#include "driver.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using namespace llvm;
+using namespace parser;
+using namespace std;
+
+namespace {
+
+	const char* const g_tierUpHookName = "__marklar_tier_up";
+
+	// Marklar's main may take argc and may return either i32 or i64
+	template <typename ret_t>
+	int64_t callMain(JITTargetAddress addr, unsigned argCount) {
+		if (argCount == 0) {
+			return reinterpret_cast<ret_t(*)()>(addr)();
+		} else {
+			// Behave as if the program was started without any arguments
+			return reinterpret_cast<ret_t(*)(int32_t)>(addr)(1);
+		}
+	}
+
+	/* Tiered execution on top of LLJIT.
+	 *
+	 * Every function is called through an indirection stub carrying its original name. The stubs
+	 * first point at the -O0 body, which counts its calls and reports to tierUp() once it becomes
+	 * hot. A background thread then rebuilds that function at -O3 from the pristine bitcode and
+	 * repoints the stub, so subsequent calls run the optimized code.
+	 */
+	class tiered_jit {
+	public:
+		tiered_jit(orc::LLJIT& jit, unsigned hotCallThreshold, bool waitForRecompile)
+		: m_jit(jit), m_hotCallThreshold(hotCallThreshold), m_waitForRecompile(waitForRecompile) {}
+
+		~tiered_jit() {
+			stop();
+		}
+
+		// Instruments the module and adds it to the JIT, must be called before 'main' is looked up
+		bool addModule(unique_ptr<Module> module, unique_ptr<LLVMContext> context);
+
+		void start() {
+			m_worker = std::thread([this]() { workerLoop(); });
+		}
+
+		// Abandons any outstanding recompiles, the program must have finished running
+		void stop() {
+			{
+				lock_guard<mutex> lock(m_mutex);
+				m_stopping = true;
+			}
+			m_wakeup.notify_all();
+			m_recompiled.notify_all();
+
+			if (m_worker.joinable()) {
+				m_worker.join();
+			}
+		}
+
+		// Number of functions whose optimized version has been swapped in so far
+		unsigned tierUps() const {
+			return m_tierUps;
+		}
+
+	private:
+		// Called from the instrumented code when a function reaches the threshold
+		static void tierUp(tiered_jit* self, int32_t funcId) {
+			unique_lock<mutex> lock(self->m_mutex);
+			self->m_pending.push_back(funcId);
+			const unsigned ticket = ++self->m_queued;
+			self->m_wakeup.notify_one();
+
+			if (self->m_waitForRecompile) {
+				self->m_recompiled.wait(lock, [self, ticket]() { return self->m_stopping || self->m_finished >= ticket; });
+			}
+		}
+
+		// Nothing will be recompiled anymore, releases any caller waiting on a recompile
+		void giveUp() {
+			{
+				lock_guard<mutex> lock(m_mutex);
+				m_stopping = true;
+			}
+			m_recompiled.notify_all();
+		}
+
+		void instrumentFunction(Function& func, unsigned funcId, Function* hook);
+		void workerLoop();
+		bool recompile(unsigned funcId, TargetMachine& targetMachine);
+
+		orc::LLJIT& m_jit;
+		const unsigned m_hotCallThreshold;
+		const bool m_waitForRecompile;
+
+		unique_ptr<orc::IndirectStubsManager> m_stubs;
+
+		// Unmodified IR, each recompile parses its own copy so it can use a private context
+		SmallVector<char, 0> m_bitcode;
+		vector<string> m_functionNames;
+
+		std::thread m_worker;
+		mutex m_mutex;
+		condition_variable m_wakeup;
+		deque<unsigned> m_pending;
+		bool m_stopping = false;
+
+		// Recompiles asked for and those done with, whether they succeeded or not
+		condition_variable m_recompiled;
+		unsigned m_queued = 0;
+		unsigned m_finished = 0;
+
+		atomic<unsigned> m_tierUps{ 0 };
+	};
+
+	bool tiered_jit::addModule(unique_ptr<Module> module, unique_ptr<LLVMContext> context) {
+		{
+			raw_svector_ostream bitcodeOut(m_bitcode);
+			WriteBitcodeToFile(*module, bitcodeOut);
+		}
+
+		vector<Function*> bodies;
+		for (Function& func : *module) {
+			if (!func.isDeclaration()) {
+				bodies.push_back(&func);
+			}
+		}
+
+		// void __marklar_tier_up(i8* self, i32 funcId)
+		LLVMContext& ctx = module->getContext();
+		FunctionType* hookType = FunctionType::get(Type::getVoidTy(ctx), { Type::getInt8PtrTy(ctx), Type::getInt32Ty(ctx) }, false);
+		Function* hook = Function::Create(hookType, Function::ExternalLinkage, g_tierUpHookName, module.get());
+
+		// Move each body aside and route every call through a declaration with the original name,
+		// that name is later bound to the function's stub
+		orc::IndirectStubsManager::StubInitsMap stubInits;
+		for (Function* func : bodies) {
+			const string name = func->getName().str();
+			const unsigned funcId = m_functionNames.size();
+			m_functionNames.push_back(name);
+
+			func->setName(name + "$tier0");
+			Function* callable = Function::Create(func->getFunctionType(), Function::ExternalLinkage, name, module.get());
+			func->replaceAllUsesWith(callable);
+
+			instrumentFunction(*func, funcId, hook);
+
+			stubInits[name] = make_pair(JITTargetAddress(0), JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+		}
+
+		auto stubsBuilder = orc::createLocalIndirectStubsManagerBuilder(Triple(sys::getProcessTriple()));
+		if (!stubsBuilder) {
+			cerr << "Error: Tiered JIT is not supported on this host" << endl;
+			return false;
+		}
+
+		m_stubs = stubsBuilder();
+		if (Error err = m_stubs->createStubs(stubInits)) {
+			cerr << "Failed to create JIT stubs: " << toString(std::move(err)) << endl;
+			return false;
+		}
+
+		// Publish the stubs under the original names along with the runtime hook
+		orc::MangleAndInterner mangle(m_jit.getExecutionSession(), m_jit.getDataLayout());
+
+		orc::SymbolMap symbols;
+		for (const auto& name : m_functionNames) {
+			symbols[mangle(name)] = m_stubs->findStub(name, true);
+		}
+		symbols[mangle(g_tierUpHookName)] =
+			JITEvaluatedSymbol(pointerToJITTargetAddress(&tiered_jit::tierUp), JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+
+		if (Error err = m_jit.getMainJITDylib().define(orc::absoluteSymbols(std::move(symbols)))) {
+			cerr << "Failed to define JIT stubs: " << toString(std::move(err)) << endl;
+			return false;
+		}
+
+		module->setDataLayout(m_jit.getDataLayout());
+		if (Error err = m_jit.addIRModule(orc::ThreadSafeModule(std::move(module), std::move(context)))) {
+			cerr << "Failed to add module to the JIT: " << toString(std::move(err)) << endl;
+			return false;
+		}
+
+		// Compile the -O0 tier up front and point every stub at it
+		for (const auto& name : m_functionNames) {
+			auto sym = m_jit.lookup(name + "$tier0");
+			if (!sym) {
+				cerr << "Failed to compile '" << name << "': " << toString(sym.takeError()) << endl;
+				return false;
+			}
+
+			if (Error err = m_stubs->updatePointer(name, sym->getAddress())) {
+				cerr << "Failed to update stub for '" << name << "': " << toString(std::move(err)) << endl;
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void tiered_jit::instrumentFunction(Function& func, unsigned funcId, Function* hook) {
+		LLVMContext& ctx = func.getContext();
+		Module* module = func.getParent();
+
+		GlobalVariable* counter =
+			new GlobalVariable(*module, Type::getInt32Ty(ctx), false, GlobalValue::InternalLinkage,
+			                   ConstantInt::get(Type::getInt32Ty(ctx), 0), func.getName() + ".calls");
+
+		// Keep the allocas in the entry block so they stay static, the counter goes right after them
+		BasicBlock& entry = func.getEntryBlock();
+		BasicBlock::iterator insertPt = entry.begin();
+		while (isa<AllocaInst>(*insertPt)) {
+			++insertPt;
+		}
+
+		BasicBlock* body = entry.splitBasicBlock(insertPt, "tier.body");
+		entry.getTerminator()->eraseFromParent();
+
+		BasicBlock* hotBB = BasicBlock::Create(ctx, "tier.up", &func, body);
+
+		IRBuilder<> builder(&entry);
+		Value* const calls = builder.CreateAdd(builder.CreateLoad(counter), builder.getInt32(1), "calls");
+		builder.CreateStore(calls, counter);
+		builder.CreateCondBr(builder.CreateICmpEQ(calls, builder.getInt32(m_hotCallThreshold)), hotBB, body);
+
+		builder.SetInsertPoint(hotBB);
+		Value* const self = ConstantExpr::getIntToPtr(builder.getInt64(reinterpret_cast<uint64_t>(this)), builder.getInt8PtrTy());
+		builder.CreateCall(hook, { self, builder.getInt32(funcId) });
+		builder.CreateBr(body);
+	}
+
+	void tiered_jit::workerLoop() {
+		auto targetBuilder = orc::JITTargetMachineBuilder::detectHost();
+		if (!targetBuilder) {
+			cerr << "Failed to detect host for tiered JIT: " << toString(targetBuilder.takeError()) << endl;
+			giveUp();
+			return;
+		}
+		targetBuilder->setCodeGenOptLevel(CodeGenOpt::Aggressive);
+
+		auto targetMachine = targetBuilder->createTargetMachine();
+		if (!targetMachine) {
+			cerr << "Failed to create target for tiered JIT: " << toString(targetMachine.takeError()) << endl;
+			giveUp();
+			return;
+		}
+
+		for (;;) {
+			unsigned funcId = 0;
+			{
+				unique_lock<mutex> lock(m_mutex);
+				m_wakeup.wait(lock, [this]() { return m_stopping || !m_pending.empty(); });
+
+				if (m_stopping) {
+					return;
+				}
+
+				funcId = m_pending.front();
+				m_pending.pop_front();
+			}
+
+			if (!recompile(funcId, **targetMachine)) {
+				cerr << "Warning: '" << m_functionNames[funcId] << "' stays unoptimized" << endl;
+			}
+
+			{
+				lock_guard<mutex> lock(m_mutex);
+				++m_finished;
+			}
+			m_recompiled.notify_all();
+		}
+	}
+
+	bool tiered_jit::recompile(unsigned funcId, TargetMachine& targetMachine) {
+		const string& name = m_functionNames[funcId];
+
+		unique_ptr<LLVMContext> context(new LLVMContext());
+		auto moduleOrErr = parseBitcodeFile(MemoryBufferRef(StringRef(m_bitcode.data(), m_bitcode.size()), name), *context);
+		if (!moduleOrErr) {
+			cerr << "Failed to reload IR for '" << name << "': " << toString(moduleOrErr.takeError()) << endl;
+			return false;
+		}
+		unique_ptr<Module> module = std::move(*moduleOrErr);
+
+		// Only the hot function is emitted, the others are kept around for the inliner and any
+		// call left after optimization still goes through their stubs
+		Function* hot = module->getFunction(name);
+		for (Function& func : *module) {
+			if (&func != hot && !func.isDeclaration()) {
+				func.setLinkage(GlobalValue::AvailableExternallyLinkage);
+			}
+		}
+		hot->setName(name + "$tier1");
+
+		if (!marklar::driver::optimizeModule(*module)) {
+			return false;
+		}
+		module->setDataLayout(m_jit.getDataLayout());
+
+		// Generate the object ourselves, the JIT's own compiler runs at -O0 for the first tier
+		SmallVector<char, 0> objBuffer;
+		{
+			raw_svector_ostream objOut(objBuffer);
+
+			legacy::PassManager codegenPasses;
+			if (targetMachine.addPassesToEmitFile(codegenPasses, objOut, nullptr, TargetMachine::CGFT_ObjectFile)) {
+				cerr << "Target does not support emitting object files" << endl;
+				return false;
+			}
+
+			codegenPasses.run(*module);
+		}
+
+		if (Error err = m_jit.addObjectFile(unique_ptr<MemoryBuffer>(new SmallVectorMemoryBuffer(std::move(objBuffer))))) {
+			cerr << "Failed to add optimized '" << name << "': " << toString(std::move(err)) << endl;
+			return false;
+		}
+
+		auto sym = m_jit.lookup(name + "$tier1");
+		if (!sym) {
+			cerr << "Failed to link optimized '" << name << "': " << toString(sym.takeError()) << endl;
+			return false;
+		}
+
+		if (Error err = m_stubs->updatePointer(name, sym->getAddress())) {
+			cerr << "Failed to update stub for '" << name << "': " << toString(std::move(err)) << endl;
+			return false;
+		}
+		++m_tierUps;
+
+		return true;
+	}
+
+	// Where the stub of a function whose compile failed points. The lazy_jit of the run has recorded
+	// the failure, so the run is reported as failed once main returns
+	int64_t lazyCompileFailed() {
+		return 0;
+	}
+
+	/* Lazy execution on top of LLJIT.
+	 *
+	 * Every function is called through an indirection stub carrying its original name, which
+	 * starts out pointing at a compile callback. The first call lowers just that function from
+	 * the flat AST into a module of its own, parsing its body first if it was skipped, compiles
+	 * it and repoints the stub. Functions the run never calls are never generated.
+	 */
+	class lazy_jit {
+	public:
+		lazy_jit(orc::LLJIT& jit, flat::ast& tree, string_view source)
+		: m_jit(jit), m_tree(tree), m_source(source) {}
+
+		// The session may still report errors while the JIT is torn down
+		~lazy_jit() {
+			m_jit.getExecutionSession().setErrorReporter([](Error err) {
+				logAllUnhandledErrors(std::move(err), errs(), "JIT error: ");
+			});
+		}
+
+		// Creates the stubs of the top level functions, must be called before 'main' is looked up.
+		// A name defined more than once is reported, as the verifier does for eager runs
+		bool addFunctions();
+
+		// Whether a function the run called failed to compile
+		bool failed() const {
+			return m_failed;
+		}
+
+	private:
+		// Address the stub is pointed at from now on
+		JITTargetAddress compile(const string& name);
+		unique_ptr<Module> generate(const string& name, LLVMContext& context);
+
+		orc::LLJIT& m_jit;
+		flat::ast& m_tree;
+		const string_view m_source;
+
+		map<string, flat::node_ref> m_functions;
+
+		unique_ptr<orc::JITCompileCallbackManager> m_callbacks;
+		unique_ptr<orc::IndirectStubsManager> m_stubs;
+
+		// Calls may come from any thread the program runs on
+		mutex m_mutex;
+		atomic<bool> m_failed{ false };
+	};
+
+	bool lazy_jit::addFunctions() {
+		for (const auto& itr : flat::base_expr(m_tree.root()).children) {
+			if (itr.kind() == flat::node_kind::func_expr && !m_functions.emplace(itr.get().name, itr).second) {
+				cerr << marklar::describeLocation(m_source, itr.location()) << ": Error: Function '" << itr.get().name << "' is defined more than once" << endl;
+				return false;
+			}
+		}
+
+		// The callbacks report their own errors to the session, whose run is then failed as well
+		m_jit.getExecutionSession().setErrorReporter([this](Error err) {
+			logAllUnhandledErrors(std::move(err), errs(), "JIT error: ");
+			m_failed = true;
+		});
+
+		const Triple triple(sys::getProcessTriple());
+		const JITTargetAddress failed = pointerToJITTargetAddress(&lazyCompileFailed);
+
+		auto callbacks = orc::createLocalCompileCallbackManager(triple, m_jit.getExecutionSession(), failed);
+		if (!callbacks) {
+			cerr << "Error: Lazy JIT is not supported on this host: " << toString(callbacks.takeError()) << endl;
+			return false;
+		}
+		m_callbacks = std::move(*callbacks);
+
+		auto stubsBuilder = orc::createLocalIndirectStubsManagerBuilder(triple);
+		if (!stubsBuilder) {
+			cerr << "Error: Lazy JIT is not supported on this host" << endl;
+			return false;
+		}
+		m_stubs = stubsBuilder();
+
+		orc::IndirectStubsManager::StubInitsMap stubInits;
+		for (const auto& itr : m_functions) {
+			const string name = itr.first;
+
+			auto callback = m_callbacks->getCompileCallback([this, name]() {
+				return compile(name);
+			});
+			if (!callback) {
+				cerr << "Failed to create compile callback for '" << name << "': " << toString(callback.takeError()) << endl;
+				return false;
+			}
+
+			stubInits[name] = make_pair(*callback, JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+		}
+
+		if (Error err = m_stubs->createStubs(stubInits)) {
+			cerr << "Failed to create JIT stubs: " << toString(std::move(err)) << endl;
+			return false;
+		}
+
+		// Calls between functions are resolved against the stubs under the original names
+		orc::MangleAndInterner mangle(m_jit.getExecutionSession(), m_jit.getDataLayout());
+
+		orc::SymbolMap symbols;
+		for (const auto& itr : m_functions) {
+			symbols[mangle(itr.first)] = m_stubs->findStub(itr.first, true);
+		}
+
+		if (Error err = m_jit.getMainJITDylib().define(orc::absoluteSymbols(std::move(symbols)))) {
+			cerr << "Failed to define JIT stubs: " << toString(std::move(err)) << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	JITTargetAddress lazy_jit::compile(const string& name) {
+		lock_guard<mutex> lock(m_mutex);
+		marklar::profiler::scope timer("lazy compile", name);
+
+		const JITTargetAddress failed = pointerToJITTargetAddress(&lazyCompileFailed);
+
+		unique_ptr<LLVMContext> context(new LLVMContext());
+		unique_ptr<Module> module = generate(name, *context);
+		if (!module) {
+			m_failed = true;
+			return failed;
+		}
+
+		module->setDataLayout(m_jit.getDataLayout());
+		if (Error err = m_jit.addIRModule(orc::ThreadSafeModule(std::move(module), std::move(context)))) {
+			cerr << "Failed to add '" << name << "' to the JIT: " << toString(std::move(err)) << endl;
+			m_failed = true;
+			return failed;
+		}
+
+		auto sym = m_jit.lookup(name + "$lazy");
+		if (!sym) {
+			cerr << "Failed to compile '" << name << "': " << toString(sym.takeError()) << endl;
+			m_failed = true;
+			return failed;
+		}
+
+		if (Error err = m_stubs->updatePointer(name, sym->getAddress())) {
+			cerr << "Failed to update stub for '" << name << "': " << toString(std::move(err)) << endl;
+			m_failed = true;
+			return failed;
+		}
+
+		return sym->getAddress();
+	}
+
+	unique_ptr<Module> lazy_jit::generate(const string& name, LLVMContext& context) {
+		const flat::node_ref func = m_functions.at(name);
+		if (!m_tree.materialize(func.id)) {
+			const flat::func_expr view(func);
+			cerr << marklar::describeLocation(m_source, view.location) << ": Failed to parse the body of '" << name << "'" << endl;
+			return nullptr;
+		}
+
+		unique_ptr<Module> module(new Module(name, context));
+		IRBuilder<> builder(context);
+
+		marklar::ast_codegen codeGenerator(&context, module.get(), builder, true);
+		codeGenerator.setSource(m_source);
+
+		// Only the callees are declared, calling one goes through its stub. Wherever they're defined in
+		// the source, as every prototype is declared up front by the eager modes too
+		const flat::func_expr view(func);
+		for (const auto& callee : marklar::collectCallees(view)) {
+			const auto itr = m_functions.find(callee);
+			if (itr != m_functions.end() && callee != name && !codeGenerator.declareFunction(flat::func_expr(itr->second))) {
+				return nullptr;
+			}
+		}
+
+		codeGenerator(view);
+
+		string errorInfo;
+		raw_string_ostream errorOut(errorInfo);
+		if (verifyModule(*module, &errorOut)) {
+			cerr << "Failed to generate LLVM IR for '" << name << "': " << errorOut.str() << endl;
+			return nullptr;
+		}
+
+		Function* body = module->getFunction(name);
+		if (!body || body->isDeclaration()) {
+			return nullptr;
+		}
+
+		// The body moves aside so its name stays bound to the stub, recursive calls go to it directly
+		body->setName(name + "$lazy");
+
+		return module;
+	}
+
+
+	// Marklar's main takes at most argc and returns an integer, main is null if it wasn't found
+	bool checkMainSignature(const Function* mainFunc, unsigned& argCount, unsigned& retBits) {
+		if (!mainFunc) {
+			cerr << "Error: No 'main' function to run" << endl;
+			return false;
+		}
+
+		argCount = mainFunc->arg_size();
+		retBits = mainFunc->getReturnType()->getIntegerBitWidth();
+		if (argCount > 1) {
+			cerr << "Error: Unsupported 'main' signature, expected at most one argument" << endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// LLJIT for the host that resolves calls such as printf against the symbols of this process
+	unique_ptr<orc::LLJIT> createJIT(bool unoptimized) {
+		static std::once_flag initFlag;
+		std::call_once(initFlag, []() {
+			InitializeNativeTarget();
+			InitializeNativeTargetAsmPrinter();
+		});
+
+		auto targetBuilder = orc::JITTargetMachineBuilder::detectHost();
+		if (!targetBuilder) {
+			cerr << "Failed to detect host: " << toString(targetBuilder.takeError()) << endl;
+			return nullptr;
+		}
+
+		if (unoptimized) {
+			targetBuilder->setCodeGenOptLevel(CodeGenOpt::None);
+		}
+
+		auto jitOrErr = orc::LLJITBuilder().setJITTargetMachineBuilder(std::move(*targetBuilder)).create();
+		if (!jitOrErr) {
+			cerr << "Failed to create JIT: " << toString(jitOrErr.takeError()) << endl;
+			return nullptr;
+		}
+		unique_ptr<orc::LLJIT> jit = std::move(*jitOrErr);
+
+		auto generator = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(jit->getDataLayout().getGlobalPrefix());
+		if (!generator) {
+			cerr << "Failed to expose process symbols to the JIT: " << toString(generator.takeError()) << endl;
+			return nullptr;
+		}
+		jit->getMainJITDylib().setGenerator(std::move(*generator));
+
+		return jit;
+	}
+
+	int runMainAt(JITTargetAddress addr, unsigned argCount, unsigned retBits) {
+		const int64_t result = (retBits == 64 ? callMain<int64_t>(addr, argCount) : callMain<int32_t>(addr, argCount));
+
+		// The program shares our stdio buffers, make sure its output is visible before we return
+		fflush(stdout);
+
+		return static_cast<int>(result);
+	}
+
+}
+
+namespace marklar {
+
+	namespace jit {
+
+		bool runMain(unique_ptr<Module> module, unique_ptr<LLVMContext> context, int& exitCode, const jit_options& options) {
+			const Function* mainFunc = module->getFunction("main");
+
+			unsigned argCount = 0, retBits = 0;
+			if (!checkMainSignature(mainFunc && !mainFunc->isDeclaration() ? mainFunc : nullptr, argCount, retBits)) {
+				return false;
+			}
+
+			// The first tier favours compile speed, hot functions are recompiled separately
+			unique_ptr<orc::LLJIT> jit = createJIT(options.tiered);
+			if (!jit) {
+				return false;
+			}
+
+			unique_ptr<tiered_jit> tiers;
+			if (options.tiered) {
+				tiers.reset(new tiered_jit(*jit, options.hotCallThreshold, options.waitForRecompile));
+
+				if (!tiers->addModule(std::move(module), std::move(context))) {
+					return false;
+				}
+			} else {
+				module->setDataLayout(jit->getDataLayout());
+				if (Error err = jit->addIRModule(orc::ThreadSafeModule(std::move(module), std::move(context)))) {
+					cerr << "Failed to add module to the JIT: " << toString(std::move(err)) << endl;
+					return false;
+				}
+			}
+
+			auto mainSym = jit->lookup("main");
+			if (!mainSym) {
+				cerr << "Failed to compile 'main': " << toString(mainSym.takeError()) << endl;
+				return false;
+			}
+
+			if (tiers) {
+				tiers->start();
+			}
+
+			exitCode = runMainAt(mainSym->getAddress(), argCount, retBits);
+
+			// Background compiles must not outlive the JIT
+			if (tiers) {
+				tiers->stop();
+			}
+
+			if (options.tierUps) {
+				*options.tierUps = (tiers ? tiers->tierUps() : 0);
+			}
+
+			return true;
+		}
+
+		bool runMainLazily(flat::ast& tree, string_view source, int& exitCode) {
+			const flat::node_list items = flat::base_expr(tree.root()).children;
+			const auto mainItr = find_if(items.begin(), items.end(), [](flat::any_node item) {
+				return item.kind() == flat::node_kind::func_expr && item.get().name == "main";
+			});
+
+			// main's signature is checked as codegen lowers it, without generating its body yet
+			LLVMContext signatureContext;
+			Module signatureModule("main", signatureContext);
+			IRBuilder<> signatureBuilder(signatureContext);
+			ast_codegen signatureGenerator(&signatureContext, &signatureModule, signatureBuilder);
+
+			const Function* mainFunc = (mainItr != items.end() ? signatureGenerator.declareFunction(flat::func_expr(*mainItr)) : nullptr);
+
+			unsigned argCount = 0, retBits = 0;
+			if (!checkMainSignature(mainFunc, argCount, retBits)) {
+				return false;
+			}
+
+			unique_ptr<orc::LLJIT> jit = createJIT(false);
+			if (!jit) {
+				return false;
+			}
+
+			lazy_jit functions(*jit, tree, source);
+			if (!functions.addFunctions()) {
+				return false;
+			}
+
+			auto mainSym = jit->lookup("main");
+			if (!mainSym) {
+				cerr << "Failed to look up 'main': " << toString(mainSym.takeError()) << endl;
+				return false;
+			}
+
+			exitCode = runMainAt(mainSym->getAddress(), argCount, retBits);
+
+			if (functions.failed()) {
+				cerr << "Error: A function called by the program failed to compile" << endl;
+				return false;
+			}
+
+			return true;
+		}
+
+	}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+
+#include "flatast.h"
+
+
+namespace llvm {
+	class LLVMContext;
+	class Module;
+}
+
+namespace marklar {
+
+	namespace jit {
+
+		struct jit_options {
+			// Start every function unoptimized and recompile the hot ones at -O3 on a background thread
+			bool tiered = false;
+
+			// Number of calls after which a function is considered hot when tiered
+			unsigned hotCallThreshold = 1000;
+
+			// Make the call that turns a function hot wait for its recompile instead of carrying on
+			// unoptimized, so tier-up doesn't depend on how long the program runs
+			bool waitForRecompile = false;
+
+			// When set, receives how many hot functions had their optimized version swapped in
+			unsigned* tierUps = nullptr;
+
+			// Parse, generate and compile each function when it's first called, see runMainLazily.
+			// Functions are never recompiled then, tiered is ignored
+			bool lazy = false;
+		};
+
+		// Compiles the module in-process through ORC and calls its 'main', the value main returns is
+		// stored in exitCode. Returns false if the module could not be compiled or has no main.
+		bool runMain(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context, int& exitCode,
+		             const jit_options& options = jit_options());
+
+		// Same as runMain, but every function starts out as a stub and is only generated and compiled
+		// when the program first calls it, along with parsing its body if the tree was parsed lazily.
+		// The tree and the source it was parsed from have to outlive the call. False as well when a
+		// function the program called failed to compile, that call returned 0
+		bool runMainLazily(parser::flat::ast& tree, std::string_view source, int& exitCode);
+
+	}
+
+}
+
@@ -0,0 +1,36 @@
+#include "literal.h"
+
+#include <algorithm>
+
+#include <boost/algorithm/string.hpp>
+
+
+using namespace std;
+
+namespace marklar {
+
+	bool isNumberLiteral(const string& s) {
+		return !s.empty() && find_if(s.begin(),
+			s.end(), [](char c) { return !isdigit(c); }) == s.end();
+	}
+
+	bool isStringLiteral(const string& s) {
+		const auto sz = s.size();
+
+		if (sz < 2) {
+			return false;
+		}
+
+		return (s[0] == '"' && s[sz-1] == '"');
+	}
+
+	string stringLiteralValue(const string& s) {
+		string newStr(s);
+
+		boost::trim_if(newStr, boost::is_any_of("\""));
+
+		return boost::replace_all_copy(newStr, "\\n", "\n");
+	}
+
+}
+
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+
+namespace marklar {
+
+	// Literals are kept as the source text of a name, these tell them apart and decode them
+
+	// Decimal digits only, the value is an i32
+	bool isNumberLiteral(const std::string& s);
+
+	// Enclosed in double quotes, only printf takes these
+	bool isStringLiteral(const std::string& s);
+
+	// Characters of a string literal without the quotes and with its escapes replaced
+	std::string stringLiteralValue(const std::string& s);
+
+}
+
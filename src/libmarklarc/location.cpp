@@ -0,0 +1,27 @@
+#include "location.h"
+
+#include <algorithm>
+
+
+using namespace parser;
+using namespace std;
+
+namespace marklar {
+
+	line_column lineColumn(string_view source, uint32_t offset) {
+		const string_view before = source.substr(0, offset);
+		const size_t lineStart = before.rfind('\n');
+
+		line_column result;
+		result.line = static_cast<uint32_t>(count(before.begin(), before.end(), '\n')) + 1;
+		result.column = static_cast<uint32_t>(lineStart == string_view::npos ? offset : offset - lineStart - 1) + 1;
+
+		return result;
+	}
+
+	string describeLocation(string_view source, source_span location) {
+		const line_column position = lineColumn(source, location.offset);
+		return to_string(position.line) + ":" + to_string(position.column);
+	}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+
+namespace parser {
+
+	// Byte range of the source a node was parsed from, nodes built any other way have no location
+	struct source_span {
+		uint32_t offset = 0;
+		uint32_t length = 0;
+
+		bool valid() const {
+			return length != 0;
+		}
+	};
+
+}
+
+namespace marklar {
+
+	// Both start at one, the column counts bytes
+	struct line_column {
+		uint32_t line;
+		uint32_t column;
+	};
+
+	// Only used for diagnostics, this counts the lines before the offset every time
+	line_column lineColumn(std::string_view source, uint32_t offset);
+
+	// "line:column" of the start of the span
+	std::string describeLocation(std::string_view source, parser::source_span location);
+
+}
@@ -0,0 +1,43 @@
+#include "operators.h"
+
+
+namespace marklar {
+
+	binary_operator lookupBinaryOperator(parser::interned_string op) {
+		// Interned once so matching an operator compares ids
+		static const struct {
+			parser::interned_string token;
+			binary_operator op;
+		} operators[] = {
+			{ "+",  binary_operator::add },
+			{ "-",  binary_operator::sub },
+			{ "<",  binary_operator::lessThan },
+			{ ">",  binary_operator::greaterThan },
+			{ "%",  binary_operator::rem },
+			{ "/",  binary_operator::div },
+			{ "*",  binary_operator::mult },
+			{ ">=", binary_operator::greaterEqual },
+			{ "<=", binary_operator::lessEqual },
+			{ "==", binary_operator::equal },
+			{ "!=", binary_operator::notEqual },
+			{ "&",  binary_operator::bitAnd },
+			{ "||", binary_operator::logicalOr },
+			{ "&&", binary_operator::logicalAnd },
+			{ ">>", binary_operator::shiftRight },
+			{ "<<", binary_operator::shiftLeft },
+		};
+
+		for (const auto& itr : operators) {
+			if (op == itr.token) {
+				return itr.op;
+			}
+		}
+
+		return binary_operator::unknown;
+	}
+
+	bool isComparison(binary_operator op) {
+		return (op >= binary_operator::lessThan && op <= binary_operator::notEqual);
+	}
+
+}
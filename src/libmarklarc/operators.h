@@ -0,0 +1,24 @@
+#pragma once
+
+#include "stringtable.h"
+
+
+namespace marklar {
+
+	// Binary operators the language has, codegen and the bytecode compiler both map them from here
+	// so they can't disagree on which tokens exist
+	enum class binary_operator {
+		add, sub, mult, div, rem,
+		lessThan, greaterThan, lessEqual, greaterEqual, equal, notEqual,
+		bitAnd, logicalAnd, logicalOr,
+		shiftLeft, shiftRight,
+		unknown
+	};
+
+	// unknown when the token isn't an operator
+	binary_operator lookupBinaryOperator(parser::interned_string op);
+
+	// The comparisons give an i1 whatever the width of their operands
+	bool isComparison(binary_operator op);
+
+}
@@ -1,6 +1,9 @@
 //#define BOOST_SPIRIT_X3_DEBUG
 
 #include "parser.h"
+#include "descentparser.h"
+#include "flatast.h"
+#include "scan.h"
 
 #include <boost/spirit/home/x3.hpp>
 #include <boost/fusion/include/std_pair.hpp>
@@ -17,11 +20,24 @@ using namespace std;
 namespace x3 = boost::spirit::x3;
 
 
+// Names are parsed into a std::string and interned when moved into the AST, this lets X3 treat
+// the two as the same attribute when matching sequences against the structs
+namespace boost { namespace spirit { namespace x3 { namespace traits {
+
+	template <>
+	struct is_substitute<std::string, ::parser::interned_string> : mpl::true_ {};
+
+	template <>
+	struct is_substitute<::parser::interned_string, std::string> : mpl::true_ {};
+
+}}}}
+
+
 // The following Boost Fusion macros tie the custom structs of ours to the Boost X3 parser types.
 
 BOOST_FUSION_ADAPT_STRUCT(
 	parser::operation,
-	(std::string, op)
+	(parser::interned_string, op)
 	(parser::base_expr_node, rhs)
 )
 
@@ -38,29 +54,29 @@ BOOST_FUSION_ADAPT_STRUCT(
 
 BOOST_FUSION_ADAPT_STRUCT(
 	parser::decl_expr,
-	(std::string, typeName)
-	(std::string, declName)
+	(parser::interned_string, typeName)
+	(parser::interned_string, declName)
 	(parser::base_expr_node, val)
 )
 
 BOOST_FUSION_ADAPT_STRUCT(
 	parser::def_expr,
-	(std::string, typeName)
-	(std::string, defName)
+	(parser::interned_string, typeName)
+	(parser::interned_string, defName)
 )
 
 BOOST_FUSION_ADAPT_STRUCT(
 	parser::func_expr,
-	(std::string, returnType)
-	(std::string, functionName)
+	(parser::interned_string, returnType)
+	(parser::interned_string, functionName)
 	(std::vector<parser::base_expr_node>, args)
 	(std::vector<parser::base_expr_node>, expressions)
 )
 
 BOOST_FUSION_ADAPT_STRUCT(
 	parser::operator_expr,
-	(std::string, valLHS)
-	(std::vector<std::string>, op_and_valRHS)
+	(parser::interned_string, valLHS)
+	(std::vector<parser::interned_string>, op_and_valRHS)
 )
 
 BOOST_FUSION_ADAPT_STRUCT(
@@ -70,7 +86,7 @@ BOOST_FUSION_ADAPT_STRUCT(
 
 BOOST_FUSION_ADAPT_STRUCT(
 	parser::call_expr,
-	(std::string, funcName)
+	(parser::interned_string, funcName)
 	(std::vector<parser::base_expr_node>, values)
 )
 
@@ -89,13 +105,13 @@ BOOST_FUSION_ADAPT_STRUCT(
 
 BOOST_FUSION_ADAPT_STRUCT(
 	parser::var_assign,
-	(std::string, varName)
+	(parser::interned_string, varName)
 	(parser::base_expr_node, varRhs)
 )
 
 BOOST_FUSION_ADAPT_STRUCT(
 	parser::udf_type,
-	(std::string, typeName)
+	(parser::interned_string, typeName)
 	(std::vector<parser::base_expr_node>, internalVars)
 )
 
@@ -105,13 +121,56 @@ namespace parser {
 	// Skip parser for handling comments
 	namespace skipper {
 
+		// Runs of whitespace are skipped a block at a time by the scanners of scan.h
+		struct spaces_parser : x3::parser<spaces_parser> {
+			typedef x3::unused_type attribute_type;
+			static bool const has_attribute = false;
+
+			template <typename Iterator, typename Context, typename RContext, typename Attribute>
+			bool parse(Iterator& first, const Iterator& last, const Context&, RContext&, Attribute&) const {
+				if (first == last) {
+					return false;
+				}
+
+				const char* begin = &*first;
+				const char* end = ::marklar::scan::skipSpaces(begin, begin + (last - first));
+
+				first += (end - begin);
+				return end != begin;
+			}
+		};
+
+		// '//' up to and including the end of the line, there's no comment without one
+		struct comment_parser : x3::parser<comment_parser> {
+			typedef x3::unused_type attribute_type;
+			static bool const has_attribute = false;
+
+			template <typename Iterator, typename Context, typename RContext, typename Attribute>
+			bool parse(Iterator& first, const Iterator& last, const Context&, RContext&, Attribute&) const {
+				if (last - first < 2 || first[0] != '/' || first[1] != '/') {
+					return false;
+				}
+
+				const char* begin = &*first;
+				const char* end = begin + (last - first);
+				const char* eol = ::marklar::scan::findLineEnd(begin + 2, end);
+				if (eol == end) {
+					return false;
+				}
+
+				first += (eol + 1 - begin);
+				return true;
+			}
+		};
+
 		const x3::rule<class startSkip, std::string> 		startSkip = "startSkip";
 		
-		const auto comment = x3::confix("//", x3::eol);
+		const spaces_parser spaces = {};
+		const comment_parser comment = {};
 
 		const auto startSkip_def = 
-			  x3::space
-			| comment[*(x3::char_ - x3::eol)]
+			  spaces
+			| comment
 			;
 
 		BOOST_SPIRIT_DEFINE(startSkip);
@@ -119,30 +178,46 @@ namespace parser {
 
 	// Grammar and parser for the Marklar language.
 	namespace marklar {
+		// Start of the source in the parse context, locations are offsets from it
+		struct source_begin_tag;
+
+		// Sets the location of the node a rule produced, the range has the leading whitespace skipped
+		struct annotate_location {
+			template <typename Iterator, typename Attribute, typename Context>
+			void on_success(const Iterator& first, const Iterator& last, Attribute& node, const Context& context) const {
+				const char* const begin = x3::get<source_begin_tag>(context);
+
+				node.location.offset = static_cast<uint32_t>(first - begin);
+				node.location.length = static_cast<uint32_t>(last - first);
+			}
+		};
+
 		// Rules decls
 		#define BUILD_RULE(name, type) const x3::rule<class name, type> name = "name"
+		#define BUILD_LOCATED_RULE(name, type) struct name : annotate_location {}; BUILD_RULE(name, type)
 
 		BUILD_RULE(start, base_expr_node);
 		BUILD_RULE(rootNode, base_expr);
-		BUILD_RULE(funcExpr, func_expr);
+		BUILD_LOCATED_RULE(funcExpr, func_expr);
 		BUILD_RULE(baseExpr, base_expr_node);
 		BUILD_RULE(callBaseExpr, base_expr_node);
-		BUILD_RULE(returnExpr, return_expr);
-		BUILD_RULE(op_expr, binary_op);
+		BUILD_LOCATED_RULE(returnExpr, return_expr);
+		BUILD_LOCATED_RULE(op_expr, binary_op);
 		BUILD_RULE(op, std::string);
-		BUILD_RULE(callExpr, call_expr);
-		BUILD_RULE(ifExpr, if_expr);
-		BUILD_RULE(whileLoop, while_loop);
+		BUILD_LOCATED_RULE(callExpr, call_expr);
+		BUILD_LOCATED_RULE(ifExpr, if_expr);
+		BUILD_LOCATED_RULE(whileLoop, while_loop);
 		BUILD_RULE(varName, std::string);
-		BUILD_RULE(varDef, def_expr);
-		BUILD_RULE(varDecl, decl_expr);
-		BUILD_RULE(varAssign, var_assign);
+		BUILD_LOCATED_RULE(varDef, def_expr);
+		BUILD_LOCATED_RULE(varDecl, decl_expr);
+		BUILD_LOCATED_RULE(varAssign, var_assign);
 		BUILD_RULE(value, std::string);
 		BUILD_RULE(factor, base_expr_node);
 		BUILD_RULE(intLiteral, std::string);
 		BUILD_RULE(quotedString, std::string);
 		BUILD_RULE(typeName, std::string);
-		BUILD_RULE(udfType, udf_type);
+		BUILD_LOCATED_RULE(udfType, udf_type);
+		BUILD_RULE(topItem, base_expr_node);
 		
 
 		// Rule defs
@@ -151,6 +226,10 @@ namespace parser {
 		const auto rootNode_def =
 			  *(udfType | funcExpr);
 
+		// One element of rootNode, parseItems reads the source one of these at a time
+		const auto topItem_def =
+			  udfType | funcExpr;
+
 		const auto udfType_def =
 			   "type"
 			>> varName
@@ -240,7 +319,9 @@ namespace parser {
 			;
 
 		const auto varName_def = x3::lexeme[x3::char_("a-zA-Z_") >> *x3::char_("a-zA-Z_0-9'")];
-		const auto intLiteral_def = +x3::char_("0-9");
+		// The digits may be separated by whitespace, each one is in a sequence so the whitespace
+		// after the last digit is left unconsumed and the locations end at the literal
+		const auto intLiteral_def = +(x3::eps >> x3::char_("0-9"));
 		const auto value_def = (varName | intLiteral);
 
 		// '>>' before the next '>' or else it will be matched as greater-than
@@ -261,6 +342,7 @@ namespace parser {
 		BOOST_SPIRIT_DEFINE(
 			start,
 			rootNode,
+			topItem,
 			udfType,
 			funcExpr,
 			baseExpr,
@@ -284,13 +366,91 @@ namespace parser {
 	}
 }
 
+namespace {
+
+	marklar::parser_backend s_backend = marklar::parser_backend::spirit;
+
+}
+
 namespace marklar {
 
-	bool parse(const std::string& str, parser::base_expr_node& root) {
-		return x3::phrase_parse(str.begin(), str.end(), parser::marklar::start, parser::skipper::startSkip, root);
+	void setParserBackend(parser_backend backend) {
+		s_backend = backend;
+	}
+
+	parser_backend parserBackend() {
+		return s_backend;
+	}
+
+	bool parse(std::string_view str, parser::base_expr_node& root) {
+		return parse(str, root, s_backend);
+	}
+
+	bool parse(std::string_view str, parser::base_expr_node& root, parser_backend backend) {
+		if (backend == parser_backend::descent) {
+			return descent::parse(str, root);
+		}
+
+		const auto grammar = x3::with<parser::marklar::source_begin_tag>(str.data())[parser::marklar::start];
+		return x3::phrase_parse(str.begin(), str.end(), grammar, parser::skipper::startSkip, root);
+	}
+
+	bool parse(std::string_view str, parser::flat::ast& out) {
+		return parse(str, out, s_backend);
+	}
+
+	bool parse(std::string_view str, parser::flat::ast& out, parser_backend backend) {
+		if (backend == parser_backend::descent) {
+			return descent::parse(str, out);
+		}
+
+		parser::base_expr_node root;
+		if (!parse(str, root, backend)) {
+			return false;
+		}
+
+		flatten(root, out);
+		return true;
+	}
+
+	bool parseLazily(std::string_view str, parser::flat::ast& out) {
+		return descent::parseLazily(str, out);
+	}
+
+	bool parseItems(std::string_view str, const std::function<bool(parser::flat::ast&&)>& onItem) {
+		return parseItems(str, onItem, s_backend);
+	}
+
+	bool parseItems(std::string_view str, const std::function<bool(parser::flat::ast&&)>& onItem, parser_backend backend) {
+		if (backend == parser_backend::descent) {
+			return descent::parseItems(str, onItem);
+		}
+
+		// Each item is parsed on its own, the tree is only kept until it has been flattened
+		const auto grammar = x3::with<parser::marklar::source_begin_tag>(str.data())[parser::marklar::topItem];
+		auto first = str.begin();
+		const auto last = str.end();
+
+		while (true) {
+			parser::flat::ast item;
+			{
+				parser::base_expr_node tree;
+				if (!x3::phrase_parse(first, last, grammar, parser::skipper::startSkip, tree)) {
+					break;
+				}
+
+				flatten(tree, item);
+			}
+
+			if (!onItem(std::move(item))) {
+				return false;
+			}
+		}
+
+		return x3::phrase_parse(first, last, x3::eoi, parser::skipper::startSkip);
 	}
 
-	bool parse(const std::string& str) {
+	bool parse(std::string_view str) {
 		parser::base_expr_node root;
 
 		return parse(str, root);
@@ -3,8 +3,12 @@
 #include <boost/variant/recursive_variant.hpp>
 
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "location.h"
+#include "stringtable.h"
+
 namespace parser {
 
 	struct base_expr;
@@ -34,17 +38,20 @@ namespace parser {
 		boost::recursive_wrapper<while_loop>,
 		boost::recursive_wrapper<var_assign>,
 		boost::recursive_wrapper<udf_type>,
-		std::string
+		interned_string
 	> base_expr_node;
 
+	// The location member of the structs below is set by both parsers and left out of the AST
+	// dumps, names and literals only have the location of the node holding them
 	struct operation {
-		std::string op;
+		interned_string op;
 		base_expr_node rhs;
 	};
 
 	struct binary_op {
 		base_expr_node lhs;
 		std::vector<parser::operation> operation;
+		source_span location;
 	};
 
 	struct base_expr {
@@ -53,55 +60,64 @@ namespace parser {
 
 	struct return_expr {
 		base_expr_node ret;
+		source_span location;
 	};
 	
 	struct func_expr {
-		std::string returnType;
-		std::string functionName;
+		interned_string returnType;
+		interned_string functionName;
 		std::vector<base_expr_node> args;
 		std::vector<base_expr_node> expressions;
+		source_span location;
 	};
 
 	struct decl_expr {
-		std::string typeName;
-		std::string declName;
+		interned_string typeName;
+		interned_string declName;
 		base_expr_node val;
+		source_span location;
 	};
 
 	struct def_expr {
-		std::string typeName;
-		std::string defName;
+		interned_string typeName;
+		interned_string defName;
+		source_span location;
 	};
 
 	struct operator_expr {
-		std::string valLHS;
-		std::vector<std::string> op_and_valRHS;
+		interned_string valLHS;
+		std::vector<interned_string> op_and_valRHS;
 	};
 
 	struct call_expr {
-		std::string funcName;
+		interned_string funcName;
 		std::vector<base_expr_node> values;
+		source_span location;
 	};
 
 	struct if_expr {
 		binary_op condition;
 		std::vector<base_expr_node> thenBranch;
 		std::vector<base_expr_node> elseBranch;
+		source_span location;
 	};
 
 	struct while_loop {
 		binary_op condition;
 		std::vector<base_expr_node> loopBody;
+		source_span location;
 	};
 
 	struct var_assign {
-		std::string varName;
+		interned_string varName;
 		base_expr_node varRhs;
+		source_span location;
 	};
 
 	struct udf_type {
-		std::string typeName;
+		interned_string typeName;
 		std::vector<base_expr_node> internalVars;
+		source_span location;
 	};
 
 }
@@ -109,10 +125,23 @@ namespace parser {
 
 namespace marklar {
 
-	// Main parse routine, upon successfully parsing the str argument will return the AST in root
-	bool parse(const std::string& str, parser::base_expr_node& root);
+	// Both build the same AST, descent is the hand written parser in descentparser.cpp
+	enum class parser_backend {
+		spirit,
+		descent
+	};
+
+	// Backend used by the parse overloads that don't take one, spirit unless changed
+	void setParserBackend(parser_backend backend);
+	parser_backend parserBackend();
+
+	// Main parse routine, upon successfully parsing the str argument will return the AST in root.
+	// The characters are only read while parsing, they may be a mapped file
+	bool parse(std::string_view str, parser::base_expr_node& root);
+
+	bool parse(std::string_view str, parser::base_expr_node& root, parser_backend backend);
 
-	bool parse(const std::string& str);
+	bool parse(std::string_view str);
 
 }
 
@@ -0,0 +1,373 @@
+#include "precompiled.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+
+using namespace marklar;
+using namespace marklar::bytecode;
+
+using namespace llvm;
+using namespace std;
+
+
+namespace {
+
+	const char precompiledMagic[8] = { 'M', 'A', 'R', 'K', 'L', 'A', 'R', 'M' };
+
+	const size_t sectionAlignment = 8;
+
+	// Strings are stored once however often the module refers to them
+	class string_interner {
+	public:
+		uint32_t intern(const string& str) {
+			const auto inserted = m_ids.emplace(str, static_cast<uint32_t>(m_offsets.size()));
+			if (inserted.second) {
+				m_offsets.push_back(static_cast<uint32_t>(m_data.size()));
+				m_data.append(str.c_str(), str.size() + 1);
+			}
+
+			return inserted.first->second;
+		}
+
+		const vector<uint32_t>& offsets() const {
+			return m_offsets;
+		}
+
+		const string& data() const {
+			return m_data;
+		}
+
+	private:
+		unordered_map<string, uint32_t> m_ids;
+		vector<uint32_t> m_offsets;
+		string m_data;
+	};
+
+	template <typename entry_t>
+	uint32_t appendSection(string& bytes, const entry_t* entries, size_t count) {
+		bytes.resize((bytes.size() + sectionAlignment - 1) / sectionAlignment * sectionAlignment, '\0');
+
+		const uint32_t offset = static_cast<uint32_t>(bytes.size());
+		bytes.append(reinterpret_cast<const char*>(entries), count * sizeof(entry_t));
+
+		return offset;
+	}
+
+	const char* const opcodeOperands[] = {
+#define MARKLAR_BYTECODE_OPERANDS(name, operands) operands,
+		MARKLAR_BYTECODE_OPCODES(MARKLAR_BYTECODE_OPERANDS)
+#undef MARKLAR_BYTECODE_OPERANDS
+	};
+
+	bool isValueType(value_type type) {
+		return (static_cast<uint8_t>(type) <= static_cast<uint8_t>(value_type::string));
+	}
+
+	// Whether count entries at offset are aligned and within the size
+	template <typename entry_t>
+	bool sectionFits(uint32_t offset, uint64_t count, size_t size) {
+		return (offset % sectionAlignment == 0 && offset + count * sizeof(entry_t) <= size);
+	}
+
+}
+
+namespace marklar {
+
+	namespace bytecode {
+
+		precompiled_module::precompiled_module(string name, const char* data, size_t size)
+		: m_name(std::move(name)), m_data(data), m_size(size) {}
+
+		precompiled_module::~precompiled_module() = default;
+
+		unique_ptr<precompiled_module> precompiled_module::open(const string& filename) {
+			// Without a null terminator LLVM maps the file unless it's only a few pages
+			ErrorOr<unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(filename, -1, false);
+			if (!buffer) {
+				cerr << "Failed to open '" << filename << "': " << buffer.getError().message() << endl;
+				return nullptr;
+			}
+
+			unique_ptr<precompiled_module> result(new precompiled_module(filename, (*buffer)->getBufferStart(), (*buffer)->getBufferSize()));
+			result->m_buffer = std::move(*buffer);
+
+			if (!result->validate()) {
+				return nullptr;
+			}
+
+			return result;
+		}
+
+		unique_ptr<precompiled_module> precompiled_module::create(const module& program) {
+			string_interner strings;
+			vector<value_type> argTypes;
+
+			vector<precompiled_function> functions;
+			vector<instruction> code;
+			for (const auto& func : program.functions) {
+				precompiled_function entry;
+				entry.name = strings.intern(func.name);
+				entry.firstArgType = static_cast<uint32_t>(argTypes.size());
+				entry.firstInstruction = static_cast<uint32_t>(code.size());
+				entry.instructionCount = static_cast<uint32_t>(func.code.size());
+				entry.registerCount = func.registerCount;
+				entry.argCount = static_cast<uint16_t>(func.argTypes.size());
+				entry.returnType = func.returnType;
+				entry.reserved = 0;
+				functions.push_back(entry);
+
+				argTypes.insert(argTypes.end(), func.argTypes.begin(), func.argTypes.end());
+
+				// Field by field so the padding is zero and the same module always gives the same bytes
+				for (const auto& inst : func.code) {
+					instruction copy;
+					memset(&copy, 0, sizeof(copy));
+					copy.op = inst.op;
+					copy.a = inst.a;
+					copy.b = inst.b;
+					copy.c = inst.c;
+					copy.imm = (inst.op == opcode::loadString ? strings.intern(program.strings[inst.imm]) : inst.imm);
+
+					code.push_back(copy);
+				}
+			}
+
+			vector<precompiled_import> imports;
+			for (const auto& imported : program.imports) {
+				precompiled_import entry;
+				entry.name = strings.intern(imported.name);
+				entry.firstArgType = static_cast<uint32_t>(argTypes.size());
+				entry.argCount = static_cast<uint16_t>(imported.argTypes.size());
+				entry.returnType = imported.returnType;
+				entry.reserved = 0;
+				imports.push_back(entry);
+
+				argTypes.insert(argTypes.end(), imported.argTypes.begin(), imported.argTypes.end());
+			}
+
+			// The signature index is searched by name
+			vector<uint32_t> index(functions.size());
+			for (uint32_t i = 0; i < index.size(); ++i) {
+				index[i] = i;
+			}
+
+			const string& stringData = strings.data();
+			std::sort(index.begin(), index.end(), [&](uint32_t lhs, uint32_t rhs) {
+				return strcmp(stringData.c_str() + strings.offsets()[functions[lhs].name], stringData.c_str() + strings.offsets()[functions[rhs].name]) < 0;
+			});
+
+			precompiled_header header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, precompiledMagic, sizeof(header.magic));
+			header.version = version;
+			header.functionCount = static_cast<uint32_t>(functions.size());
+			header.importCount = static_cast<uint32_t>(imports.size());
+			header.argTypeCount = static_cast<uint32_t>(argTypes.size());
+			header.instructionCount = static_cast<uint32_t>(code.size());
+			header.stringCount = static_cast<uint32_t>(strings.offsets().size());
+			header.stringDataSize = static_cast<uint32_t>(stringData.size());
+
+			string bytes;
+			appendSection(bytes, &header, 1);
+			header.functionsOffset = appendSection(bytes, functions.data(), functions.size());
+			header.indexOffset = appendSection(bytes, index.data(), index.size());
+			header.importsOffset = appendSection(bytes, imports.data(), imports.size());
+			header.argTypesOffset = appendSection(bytes, argTypes.data(), argTypes.size());
+			header.instructionsOffset = appendSection(bytes, code.data(), code.size());
+			header.stringOffsetsOffset = appendSection(bytes, strings.offsets().data(), strings.offsets().size());
+			header.stringDataOffset = appendSection(bytes, stringData.data(), stringData.size());
+			header.size = static_cast<uint32_t>(bytes.size());
+
+			// The offsets are only known now
+			memcpy(&bytes[0], &header, sizeof(header));
+
+			unique_ptr<precompiled_module> result(new precompiled_module("", nullptr, bytes.size()));
+			result->m_storage.resize((bytes.size() + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+			memcpy(result->m_storage.data(), bytes.data(), bytes.size());
+			result->m_data = reinterpret_cast<const char*>(result->m_storage.data());
+
+			return result;
+		}
+
+		bool precompiled_module::write(const string& filename) const {
+			SmallString<128> tmpPath;
+			int fd = -1;
+			if (std::error_code ec = sys::fs::createUniqueFile(filename + "-%%%%%%%%.tmp", fd, tmpPath)) {
+				cerr << "Failed to create '" << filename << "': " << ec.message() << endl;
+				return false;
+			}
+
+			{
+				raw_fd_ostream out(fd, true);
+				out.write(m_data, m_size);
+
+				if (out.has_error()) {
+					cerr << "Failed to write '" << filename << "': " << out.error().message() << endl;
+					out.clear_error();
+					sys::fs::remove(tmpPath);
+					return false;
+				}
+			}
+
+			if (std::error_code ec = sys::fs::rename(tmpPath, filename)) {
+				cerr << "Failed to finalize '" << filename << "': " << ec.message() << endl;
+				sys::fs::remove(tmpPath);
+				return false;
+			}
+
+			return true;
+		}
+
+		const precompiled_function* precompiled_module::findFunction(string_view name) const {
+			const uint32_t* const index = section<uint32_t>(header().indexOffset);
+			const uint32_t* const end = index + functionCount();
+
+			const uint32_t* itr = std::lower_bound(index, end, name, [&](uint32_t func, string_view value) {
+				return string_view(stringAt(function(func).name)) < value;
+			});
+
+			if (itr == end || string_view(stringAt(function(*itr).name)) != name) {
+				return nullptr;
+			}
+
+			return &function(*itr);
+		}
+
+		bool precompiled_module::validate() const {
+			const auto invalid = [&](const char* reason) {
+				cerr << "'" << m_name << "' is not a valid precompiled module: " << reason << endl;
+				return false;
+			};
+
+			if (m_size < sizeof(precompiled_header) || memcmp(header().magic, precompiledMagic, sizeof(precompiledMagic)) != 0) {
+				return invalid("unknown format");
+			}
+
+			if (header().version != version) {
+				return invalid("unsupported version, it has to be precompiled again");
+			}
+
+			if (header().size != m_size) {
+				return invalid("the file is truncated");
+			}
+
+			const precompiled_header& h = header();
+			if (reinterpret_cast<uintptr_t>(m_data) % sectionAlignment != 0 ||
+			    !sectionFits<precompiled_function>(h.functionsOffset, h.functionCount, m_size) ||
+			    !sectionFits<uint32_t>(h.indexOffset, h.functionCount, m_size) ||
+			    !sectionFits<precompiled_import>(h.importsOffset, h.importCount, m_size) ||
+			    !sectionFits<value_type>(h.argTypesOffset, h.argTypeCount, m_size) ||
+			    !sectionFits<instruction>(h.instructionsOffset, h.instructionCount, m_size) ||
+			    !sectionFits<uint32_t>(h.stringOffsetsOffset, h.stringCount, m_size) ||
+			    !sectionFits<char>(h.stringDataOffset, h.stringDataSize, m_size)) {
+				return invalid("a section is out of bounds");
+			}
+
+			if (h.stringDataSize > 0 && section<char>(h.stringDataOffset)[h.stringDataSize - 1] != '\0') {
+				return invalid("the strings aren't terminated");
+			}
+
+			for (uint32_t i = 0; i < h.stringCount; ++i) {
+				if (section<uint32_t>(h.stringOffsetsOffset)[i] >= h.stringDataSize) {
+					return invalid("a string is out of bounds");
+				}
+			}
+
+			for (uint32_t i = 0; i < h.functionCount; ++i) {
+				const precompiled_function& func = function(i);
+				if (func.name >= h.stringCount || section<uint32_t>(h.indexOffset)[i] >= h.functionCount ||
+				    uint64_t(func.firstArgType) + func.argCount > h.argTypeCount ||
+				    func.instructionCount == 0 || uint64_t(func.firstInstruction) + func.instructionCount > h.instructionCount) {
+					return invalid("a function is out of bounds");
+				}
+			}
+
+			for (uint32_t i = 0; i < h.importCount; ++i) {
+				const precompiled_import& imported = import(i);
+				if (imported.name >= h.stringCount || uint64_t(imported.firstArgType) + imported.argCount > h.argTypeCount) {
+					return invalid("an import is out of bounds");
+				}
+			}
+
+			for (uint32_t i = 0; i < h.argTypeCount; ++i) {
+				if (!isValueType(argType(i))) {
+					return invalid("an argument has an unknown type");
+				}
+			}
+
+			for (uint32_t i = 0; i < h.functionCount; ++i) {
+				const precompiled_function& func = function(i);
+				if (!isValueType(func.returnType) || func.registerCount < func.argCount) {
+					return invalid("a function has an invalid signature");
+				}
+
+				if (!validateCode(func)) {
+					return invalid("a function has invalid instructions");
+				}
+			}
+
+			for (uint32_t i = 0; i < h.importCount; ++i) {
+				if (!isValueType(import(i).returnType)) {
+					return invalid("an import has an invalid signature");
+				}
+			}
+
+			return true;
+		}
+
+		// The interpreter checks none of this while running, it's done once here instead
+		bool precompiled_module::validateCode(const precompiled_function& func) const {
+			const precompiled_header& h = header();
+			const instruction* const code = this->code(func);
+
+			for (uint32_t pc = 0; pc < func.instructionCount; ++pc) {
+				const instruction& inst = code[pc];
+				if (static_cast<size_t>(inst.op) >= static_cast<size_t>(opcode::count)) {
+					return false;
+				}
+
+				for (const char* operand = opcodeOperands[static_cast<size_t>(inst.op)]; *operand; ++operand) {
+					bool valid = true;
+					switch (*operand) {
+						case 'a': valid = (inst.a < func.registerCount); break;
+						case 'b': valid = (inst.b < func.registerCount); break;
+						case 'c': valid = (inst.c < func.registerCount); break;
+						case 'n': valid = (inst.c > 0 && uint32_t(inst.b) + inst.c <= func.registerCount); break;
+						case 'f': valid = (inst.b < uint64_t(h.functionCount) + h.importCount); break;
+						case 'i': break;
+						case 't': valid = (inst.imm < func.instructionCount); break;
+						case 's': valid = (inst.imm < h.stringCount); break;
+
+						// The arguments are in the caller's registers, the rest of the window is
+						// checked against the stack when calling
+						case 'w': {
+							const uint32_t argCount = (inst.b < h.functionCount ? function(inst.b).argCount : import(inst.b - h.functionCount).argCount);
+							valid = (uint32_t(inst.c) + argCount <= func.registerCount);
+							break;
+						}
+
+						default: valid = false; break;
+					}
+
+					if (!valid) {
+						return false;
+					}
+				}
+			}
+
+			// Execution can't run past the end of the function
+			const opcode last = code[func.instructionCount - 1].op;
+			return (last == opcode::ret || last == opcode::jump);
+		}
+
+	}
+
+}
+
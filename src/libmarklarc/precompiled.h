@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bytecode.h"
+
+
+namespace llvm {
+	class MemoryBuffer;
+}
+
+namespace marklar {
+
+	namespace bytecode {
+
+		/* Layout of a precompiled module. Every section is an array at an 8-byte aligned offset
+		 * from the start of the file, and entries refer to each other by index, so the file is used
+		 * as mapped without parsing it or fixing up pointers. Integers are in the byte order of the
+		 * machine that wrote it, a file from another one fails the version check.
+		 */
+		struct precompiled_header {
+			char magic[8];
+			uint32_t version;
+
+			// Size of the whole file, anything shorter was truncated
+			uint32_t size;
+
+			// precompiled_function entries, followed by their indices ordered by name
+			uint32_t functionCount;
+			uint32_t functionsOffset;
+			uint32_t indexOffset;
+
+			// precompiled_import entries, the calls to them come after the module's own functions
+			uint32_t importCount;
+			uint32_t importsOffset;
+
+			// value_type entries of the arguments of the functions and imports
+			uint32_t argTypeCount;
+			uint32_t argTypesOffset;
+
+			uint32_t instructionCount;
+			uint32_t instructionsOffset;
+
+			// Deduplicated names and string literals. The offsets point into the data, where each
+			// string is null terminated
+			uint32_t stringCount;
+			uint32_t stringOffsetsOffset;
+			uint32_t stringDataSize;
+			uint32_t stringDataOffset;
+		};
+
+		struct precompiled_function {
+			uint32_t name;
+			uint32_t firstArgType;
+			uint32_t firstInstruction;
+			uint32_t instructionCount;
+			uint32_t registerCount;
+			uint16_t argCount;
+			value_type returnType;
+			uint8_t reserved;
+		};
+
+		struct precompiled_import {
+			uint32_t name;
+			uint32_t firstArgType;
+			uint16_t argCount;
+			value_type returnType;
+			uint8_t reserved;
+		};
+
+		// Every opcode with its operands, an image only means the same to a build with the same list
+#define MARKLAR_BYTECODE_SIGNATURE(name, operands) #name ":" operands ";"
+		constexpr const char opcodeList[] = MARKLAR_BYTECODE_OPCODES(MARKLAR_BYTECODE_SIGNATURE);
+#undef MARKLAR_BYTECODE_SIGNATURE
+
+		// FNV-1a, evaluated while compiling
+		constexpr uint32_t hashOpcodeList(uint32_t seed) {
+			uint32_t hash = 2166136261u ^ seed;
+			for (const char* c = opcodeList; *c; ++c) {
+				hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+			}
+
+			return hash;
+		}
+
+		static_assert(sizeof(instruction) == 12, "Instructions are written as they are");
+		static_assert(sizeof(precompiled_function) == 24, "Functions are written as they are");
+		static_assert(sizeof(precompiled_import) == 12, "Imports are written as they are");
+
+		// A module in the precompiled format, either mapped from a file or laid out in memory
+		class precompiled_module {
+		public:
+			// Bump the revision whenever the layout changes, changes to the opcodes are picked up by the
+			// hash. Other versions are rejected
+			static constexpr uint32_t layoutRevision = 2;
+			static constexpr uint32_t version = hashOpcodeList(layoutRevision);
+
+			// Maps the file and checks the header, the bounds of the sections and every instruction's
+			// operands, so running it can't leave the image or a register window whatever the file holds.
+			// Errors are reported and give nullptr
+			static std::unique_ptr<precompiled_module> open(const std::string& filename);
+
+			// Lays out a compiled module, its string literals are interned along with the names
+			static std::unique_ptr<precompiled_module> create(const module& program);
+
+			~precompiled_module();
+
+			// Writes to a unique name first and renames it into place, so programs that have the
+			// previous version mapped keep running from it
+			bool write(const std::string& filename) const;
+
+			const std::string& name() const {
+				return m_name;
+			}
+
+			uint32_t functionCount() const {
+				return header().functionCount;
+			}
+
+			const precompiled_function& function(uint32_t index) const {
+				return section<precompiled_function>(header().functionsOffset)[index];
+			}
+
+			// Looks the name up in the signature index, nullptr when the module doesn't define it
+			const precompiled_function* findFunction(std::string_view name) const;
+
+			uint32_t importCount() const {
+				return header().importCount;
+			}
+
+			const precompiled_import& import(uint32_t index) const {
+				return section<precompiled_import>(header().importsOffset)[index];
+			}
+
+			value_type argType(uint32_t index) const {
+				return section<value_type>(header().argTypesOffset)[index];
+			}
+
+			const instruction* code(const precompiled_function& func) const {
+				return section<instruction>(header().instructionsOffset) + func.firstInstruction;
+			}
+
+			uint32_t stringCount() const {
+				return header().stringCount;
+			}
+
+			const char* stringAt(uint32_t index) const {
+				return section<char>(header().stringDataOffset) + section<uint32_t>(header().stringOffsetsOffset)[index];
+			}
+
+		private:
+			precompiled_module(std::string name, const char* data, size_t size);
+
+			// Checks everything the accessors above and the interpreter rely on
+			bool validate() const;
+			bool validateCode(const precompiled_function& func) const;
+
+			const precompiled_header& header() const {
+				return *reinterpret_cast<const precompiled_header*>(m_data);
+			}
+
+			template <typename entry_t>
+			const entry_t* section(uint32_t offset) const {
+				return reinterpret_cast<const entry_t*>(m_data + offset);
+			}
+
+			std::string m_name;
+
+			// Only one of them owns the bytes
+			std::unique_ptr<llvm::MemoryBuffer> m_buffer;
+			std::vector<uint64_t> m_storage;
+
+			const char* m_data;
+			size_t m_size;
+		};
+
+	}
+
+}
+
@@ -0,0 +1,157 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+	struct span {
+		const char* phase;
+		string detail;
+		unsigned threadId;
+		steady_clock::time_point start;
+		steady_clock::duration duration;
+	};
+
+	atomic<bool> g_enabled(false);
+
+	mutex g_spansMutex;
+	vector<span> g_spans;
+	steady_clock::time_point g_epoch;
+
+	// Small sequential ids read better in the trace viewer than the native thread ids
+	unsigned currentThreadId() {
+		static atomic<unsigned> nextId(0);
+		thread_local const unsigned threadId = nextId++;
+		return threadId;
+	}
+
+	void writeJsonString(ostream& out, const string& str) {
+		out << '"';
+		for (const char c : str) {
+			if (c == '"' || c == '\\') {
+				out << '\\' << c;
+			} else if (static_cast<unsigned char>(c) < 0x20) {
+				out << "\\u" << hex << setw(4) << setfill('0') << static_cast<int>(c) << dec << setfill(' ');
+			} else {
+				out << c;
+			}
+		}
+		out << '"';
+	}
+
+}
+
+namespace marklar {
+
+	namespace profiler {
+
+		void enable() {
+			lock_guard<mutex> lock(g_spansMutex);
+			g_spans.clear();
+			g_epoch = steady_clock::now();
+			g_enabled = true;
+		}
+
+		void disable() {
+			g_enabled = false;
+		}
+
+		bool isEnabled() {
+			return g_enabled;
+		}
+
+		scope::scope(const char* phase, string_view detail)
+			: m_phase(phase)
+			, m_enabled(g_enabled)
+		{
+			if (m_enabled) {
+				m_detail = detail;
+				m_start = steady_clock::now();
+			}
+		}
+
+		scope::~scope() {
+			if (!m_enabled) {
+				return;
+			}
+
+			const steady_clock::duration duration = steady_clock::now() - m_start;
+
+			lock_guard<mutex> lock(g_spansMutex);
+			g_spans.push_back(span{ m_phase, std::move(m_detail), currentThreadId(), m_start, duration });
+		}
+
+		void printReport(ostream& out) {
+			lock_guard<mutex> lock(g_spansMutex);
+
+			struct phase_total {
+				size_t count = 0;
+				steady_clock::duration total = steady_clock::duration::zero();
+			};
+
+			map<string, phase_total> totals;
+			for (const auto& itr : g_spans) {
+				phase_total& phase = totals[itr.phase];
+				++phase.count;
+				phase.total += itr.duration;
+			}
+
+			// Slowest phases first
+			vector<pair<string, phase_total>> phases(totals.begin(), totals.end());
+			sort(phases.begin(), phases.end(), [](const pair<string, phase_total>& a, const pair<string, phase_total>& b) {
+				return a.second.total > b.second.total;
+			});
+
+			// Formatted separately so the caller's stream keeps its own flags and precision
+			ostringstream report;
+			report << left << setw(16) << "Phase" << right << setw(10) << "Count" << setw(14) << "Total (ms)" << endl;
+			for (const auto& itr : phases) {
+				report << left << setw(16) << itr.first << right << setw(10) << itr.second.count
+				       << setw(14) << fixed << setprecision(3) << duration<double, milli>(itr.second.total).count() << endl;
+			}
+
+			out << report.str() << flush;
+		}
+
+		bool writeTrace(const string& fileName) {
+			ofstream out(fileName.c_str());
+			if (!out) {
+				cerr << "Failed to open '" << fileName << "'" << endl;
+				return false;
+			}
+
+			lock_guard<mutex> lock(g_spansMutex);
+
+			out << "{\"traceEvents\":[";
+			for (size_t i = 0; i < g_spans.size(); ++i) {
+				const span& itr = g_spans[i];
+
+				out << (i > 0 ? "," : "") << "\n{\"name\":";
+				writeJsonString(out, itr.detail.empty() ? itr.phase : itr.detail);
+				out << ",\"cat\":";
+				writeJsonString(out, itr.phase);
+				out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << itr.threadId
+				    << ",\"ts\":" << duration_cast<microseconds>(itr.start - g_epoch).count()
+				    << ",\"dur\":" << duration_cast<microseconds>(itr.duration).count() << "}";
+			}
+			out << "\n]}" << endl;
+
+			return static_cast<bool>(out);
+		}
+
+	}
+
+}
+
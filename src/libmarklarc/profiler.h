@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "stringtable.h"
+
+
+namespace marklar {
+
+	/* Records how long each compiler phase takes, phases are timed with a scope object
+	 * and cost nothing beyond a flag check while recording is disabled.
+	 */
+	namespace profiler {
+
+		// Starts recording, any previously recorded spans are discarded
+		void enable();
+		void disable();
+		bool isEnabled();
+
+		// Times the enclosing block as one span of the phase, the detail (e.g. a function name)
+		// only shows up in the trace
+		class scope {
+		public:
+			explicit scope(const char* phase, std::string_view detail = std::string_view());
+
+			// Interned names are only looked up when recording, other strings go to the one above
+			template <typename name_t, typename = std::enable_if_t<std::is_same_v<name_t, parser::interned_string>>>
+			scope(const char* phase, name_t detail)
+				: scope(phase)
+			{
+				if (m_enabled) {
+					m_detail = detail.str();
+				}
+			}
+			~scope();
+
+			scope(const scope&) = delete;
+			scope& operator=(const scope&) = delete;
+
+		private:
+			const char* m_phase;
+			std::string m_detail;
+			std::chrono::steady_clock::time_point m_start;
+			bool m_enabled;
+		};
+
+		// Summary table with the number of spans and the total time per phase, nested phases are
+		// counted in their parent as well
+		void printReport(std::ostream& out);
+
+		// Writes every span in the Chrome trace_event format, viewable in chrome://tracing
+		bool writeTrace(const std::string& fileName);
+
+	}
+
+}
+
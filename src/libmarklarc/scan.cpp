@@ -0,0 +1,190 @@
+#include "scan.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <cstdint>
+
+
+using namespace marklar::scan;
+
+namespace {
+
+	// Compares are signed, bytes from 0x80 up are negative and never fall into one of the ranges
+
+#if defined(__AVX2__)
+
+	typedef __m256i block_t;
+	const int blockSize = 32;
+	const uint32_t fullBlock = 0xffffffffu;
+
+	block_t load(const char* p) {
+		return _mm256_loadu_si256(reinterpret_cast<const block_t*>(p));
+	}
+
+	// Bytes of the block within [lo, hi]
+	block_t inRange(block_t block, char lo, char hi) {
+		return _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8(lo - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), block));
+	}
+
+	block_t equals(block_t block, char c) {
+		return _mm256_cmpeq_epi8(block, _mm256_set1_epi8(c));
+	}
+
+	block_t either(block_t lhs, block_t rhs) {
+		return _mm256_or_si256(lhs, rhs);
+	}
+
+	uint32_t bits(block_t mask) {
+		return static_cast<uint32_t>(_mm256_movemask_epi8(mask));
+	}
+
+#elif defined(__SSE2__)
+
+	typedef __m128i block_t;
+	const int blockSize = 16;
+	const uint32_t fullBlock = 0xffffu;
+
+	block_t load(const char* p) {
+		return _mm_loadu_si128(reinterpret_cast<const block_t*>(p));
+	}
+
+	// Bytes of the block within [lo, hi]
+	block_t inRange(block_t block, char lo, char hi) {
+		return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(block, _mm_set1_epi8(hi + 1)));
+	}
+
+	block_t equals(block_t block, char c) {
+		return _mm_cmpeq_epi8(block, _mm_set1_epi8(c));
+	}
+
+	block_t either(block_t lhs, block_t rhs) {
+		return _mm_or_si128(lhs, rhs);
+	}
+
+	uint32_t bits(block_t mask) {
+		return static_cast<uint32_t>(_mm_movemask_epi8(mask));
+	}
+
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+	// Function objects rather than functions so the masks are inlined into the loops
+
+	const struct {
+		block_t operator()(block_t block) const {
+			return either(equals(block, ' '), inRange(block, '\t', '\r'));
+		}
+	} spaceMask = {};
+
+	const struct {
+		block_t operator()(block_t block) const {
+			return either(
+				either(inRange(block, 'a', 'z'), inRange(block, 'A', 'Z')),
+				either(inRange(block, '0', '9'), either(equals(block, '_'), equals(block, '\''))));
+		}
+	} identifierMask = {};
+
+	const struct {
+		block_t operator()(block_t block) const {
+			return inRange(block, '0', '9');
+		}
+	} digitMask = {};
+
+	const struct {
+		block_t operator()(block_t block) const {
+			return either(equals(block, '\r'), equals(block, '\n'));
+		}
+	} lineEndMask = {};
+
+	// Skips whole blocks while every byte is in the run, the partial block at the end is left
+	// for the scalar loop
+	template <typename mask_t>
+	const char* skipBlocks(const char* p, const char* end, mask_t mask) {
+		while (end - p >= blockSize) {
+			const uint32_t inRun = bits(mask(load(p)));
+			if (inRun != fullBlock) {
+				return p + __builtin_ctz(~inRun);
+			}
+
+			p += blockSize;
+		}
+
+		return p;
+	}
+
+	// Like skipBlocks but stops at the first byte that is in the mask
+	template <typename mask_t>
+	const char* findInBlocks(const char* p, const char* end, mask_t mask) {
+		while (end - p >= blockSize) {
+			const uint32_t found = bits(mask(load(p)));
+			if (found != 0) {
+				return p + __builtin_ctz(found);
+			}
+
+			p += blockSize;
+		}
+
+		return p;
+	}
+
+#else
+
+	// Without SIMD everything is left for the scalar loops
+
+	template <typename mask_t>
+	const char* skipBlocks(const char* p, const char* end, mask_t mask) {
+		return p;
+	}
+
+	template <typename mask_t>
+	const char* findInBlocks(const char* p, const char* end, mask_t mask) {
+		return p;
+	}
+
+	struct no_mask {};
+
+	const no_mask spaceMask, identifierMask, digitMask, lineEndMask;
+
+#endif
+
+	template <typename predicate_t>
+	const char* skipScalar(const char* p, const char* end, predicate_t predicate) {
+		while (p < end && predicate(*p)) {
+			++p;
+		}
+
+		return p;
+	}
+
+}
+
+namespace marklar {
+
+	namespace scan {
+
+		namespace detail {
+
+			const char* skipSpaceBlocks(const char* begin, const char* end) {
+				return skipScalar(skipBlocks(begin, end, spaceMask), end, isSpace);
+			}
+
+			const char* skipIdentifierBlocks(const char* begin, const char* end) {
+				return skipScalar(skipBlocks(begin, end, identifierMask), end, isIdentifierChar);
+			}
+
+			const char* skipDigitBlocks(const char* begin, const char* end) {
+				return skipScalar(skipBlocks(begin, end, digitMask), end, isDigit);
+			}
+
+			const char* findLineEndBlocks(const char* begin, const char* end) {
+				return skipScalar(findInBlocks(begin, end, lineEndMask), end, [](char c) { return !isLineEnd(c); });
+			}
+
+		}
+
+	}
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+
+namespace marklar {
+
+	/* Scanning of character runs for the tokenizer. Each function returns the first position in
+	 * [begin, end) that doesn't belong to the run, or end.
+	 *
+	 * The first few characters are checked inline since most runs are short, longer runs continue
+	 * out of line where blocks of 32 (AVX2) or 16 (SSE2) bytes are classified at once when the
+	 * compiler targets those instruction sets. Whatever is left is scanned one character at a time.
+	 */
+	namespace scan {
+
+		inline bool isSpace(char c) {
+			return c == ' ' || (c >= '\t' && c <= '\r');
+		}
+
+		inline bool isIdentifierChar(char c) {
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '\'';
+		}
+
+		inline bool isDigit(char c) {
+			return c >= '0' && c <= '9';
+		}
+
+		inline bool isLineEnd(char c) {
+			return c == '\r' || c == '\n';
+		}
+
+		namespace detail {
+
+			// Characters checked before switching to blocks
+			const int inlineLength = 8;
+
+			const char* skipSpaceBlocks(const char* begin, const char* end);
+			const char* skipIdentifierBlocks(const char* begin, const char* end);
+			const char* skipDigitBlocks(const char* begin, const char* end);
+			const char* findLineEndBlocks(const char* begin, const char* end);
+
+		}
+
+		// ' ' and '\t' to '\r', the same set as x3::space
+		inline const char* skipSpaces(const char* begin, const char* end) {
+			for (int i = 0; i < detail::inlineLength; ++i, ++begin) {
+				if (begin == end || !isSpace(*begin)) {
+					return begin;
+				}
+			}
+
+			return detail::skipSpaceBlocks(begin, end);
+		}
+
+		// [a-zA-Z_0-9']
+		inline const char* skipIdentifierChars(const char* begin, const char* end) {
+			for (int i = 0; i < detail::inlineLength; ++i, ++begin) {
+				if (begin == end || !isIdentifierChar(*begin)) {
+					return begin;
+				}
+			}
+
+			return detail::skipIdentifierBlocks(begin, end);
+		}
+
+		// [0-9]
+		inline const char* skipDigits(const char* begin, const char* end) {
+			for (int i = 0; i < detail::inlineLength; ++i, ++begin) {
+				if (begin == end || !isDigit(*begin)) {
+					return begin;
+				}
+			}
+
+			return detail::skipDigitBlocks(begin, end);
+		}
+
+		// First '\r' or '\n', where a '//' comment ends. Comments tend to be long so this goes
+		// straight to the blocks
+		inline const char* findLineEnd(const char* begin, const char* end) {
+			return detail::findLineEndBlocks(begin, end);
+		}
+
+	}
+
+}
+
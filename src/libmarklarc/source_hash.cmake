@@ -0,0 +1,22 @@
+# Run with -DSOURCE_DIR=<libmarklarc> -DOUTPUT=<header>, writes a hash of every source of the
+# compiler to the header. It's only rewritten when the hash changes so cache.cpp isn't rebuilt for nothing
+
+file(GLOB sources RELATIVE "${SOURCE_DIR}" "${SOURCE_DIR}/*.h" "${SOURCE_DIR}/*.cpp")
+list(SORT sources)
+
+set(hashes "")
+foreach(source ${sources})
+	file(SHA1 "${SOURCE_DIR}/${source}" sourceHash)
+	set(hashes "${hashes}${source}:${sourceHash}\n")
+endforeach()
+
+string(SHA1 sourcesHash "${hashes}")
+set(content "#pragma once\n\n#define MARKLAR_SOURCE_HASH \"${sourcesHash}\"\n")
+
+if(EXISTS "${OUTPUT}")
+	file(READ "${OUTPUT}" previous)
+endif()
+
+if(NOT "${previous}" STREQUAL "${content}")
+	file(WRITE "${OUTPUT}" "${content}")
+endif()
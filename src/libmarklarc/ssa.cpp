@@ -0,0 +1,132 @@
+#include "ssa.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Constants.h>
+
+
+using namespace llvm;
+using namespace std;
+
+namespace marklar {
+
+	unsigned ssa_builder::addVariable(Type* type, const string& name) {
+		m_variables.push_back(variable{ type, name });
+		return static_cast<unsigned>(m_variables.size() - 1);
+	}
+
+	Type* ssa_builder::variableType(unsigned var) const {
+		return m_variables[var].type;
+	}
+
+	void ssa_builder::writeVariable(unsigned var, BasicBlock* block, Value* value) {
+		m_currentDef[block][var] = value;
+	}
+
+	Value* ssa_builder::readVariable(unsigned var, BasicBlock* block) {
+		const auto blockItr = m_currentDef.find(block);
+		if (blockItr != m_currentDef.end()) {
+			const auto varItr = blockItr->second.find(var);
+			if (varItr != blockItr->second.end() && varItr->second) {
+				return varItr->second;
+			}
+		}
+
+		return readVariableRecursive(var, block);
+	}
+
+	void ssa_builder::sealBlock(BasicBlock* block) {
+		// Copy first, completing a phi can read through this block again
+		const auto incomplete = m_incompletePhis.lookup(block);
+		m_incompletePhis.erase(block);
+
+		m_sealedBlocks.insert(block);
+
+		for (const auto& itr : incomplete) {
+			addPhiOperands(itr.first, itr.second);
+		}
+	}
+
+	Value* ssa_builder::readVariableRecursive(unsigned var, BasicBlock* block) {
+		const variable& v = m_variables[var];
+		Value* value = nullptr;
+
+		if (!m_sealedBlocks.count(block)) {
+			// More predecessors may still be added, complete the phi when the block is sealed
+			PHINode* phi = block->empty()
+				? PHINode::Create(v.type, 0, v.name, block)
+				: PHINode::Create(v.type, 0, v.name, &block->front());
+
+			m_incompletePhis[block].emplace_back(var, phi);
+			value = phi;
+		} else if (BasicBlock* pred = block->getSinglePredecessor()) {
+			// No phi is needed with a single predecessor
+			value = readVariable(var, pred);
+		} else if (pred_empty(block)) {
+			// Read before any definition, e.g. an uninitialized variable
+			value = UndefValue::get(v.type);
+		} else {
+			// Break potential cycles with an operandless phi first
+			PHINode* phi = block->empty()
+				? PHINode::Create(v.type, 0, v.name, block)
+				: PHINode::Create(v.type, 0, v.name, &block->front());
+
+			writeVariable(var, block, phi);
+			value = addPhiOperands(var, phi);
+		}
+
+		writeVariable(var, block, value);
+		return value;
+	}
+
+	Value* ssa_builder::addPhiOperands(unsigned var, PHINode* phi) {
+		for (BasicBlock* pred : predecessors(phi->getParent())) {
+			phi->addIncoming(readVariable(var, pred), pred);
+		}
+
+		return tryRemoveTrivialPhi(phi);
+	}
+
+	Value* ssa_builder::tryRemoveTrivialPhi(PHINode* phi) {
+		Value* same = nullptr;
+		for (Value* op : phi->incoming_values()) {
+			if (op == same || op == phi) {
+				continue;
+			}
+
+			if (same) {
+				// Merges at least two values, the phi is needed
+				return phi;
+			}
+
+			same = op;
+		}
+
+		if (!same) {
+			// Unreachable or only referencing itself
+			same = UndefValue::get(phi->getType());
+		}
+
+		// Removing this phi can make the phis using it trivial as well, those may in turn be
+		// erased by the recursion so only weak handles are kept
+		SmallVector<WeakVH, 8> phiUsers;
+		for (User* user : phi->users()) {
+			if (user != phi && isa<PHINode>(user)) {
+				phiUsers.push_back(user);
+			}
+		}
+
+		phi->replaceAllUsesWith(same);
+		phi->eraseFromParent();
+
+		for (auto& user : phiUsers) {
+			if (PHINode* userPhi = dyn_cast_or_null<PHINode>(user)) {
+				tryRemoveTrivialPhi(userPhi);
+			}
+		}
+
+		return same;
+	}
+
+}
+
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Type.h>
+#include <llvm/IR/ValueHandle.h>
+
+
+namespace marklar {
+
+	/* Builds SSA form while the IR is generated, following "Simple and Efficient Construction
+	 * of Static Single Assignment Form" (Braun et al.). Each variable keeps its current
+	 * definition per block, reads walk up the predecessors and only place phis where the
+	 * definitions differ. A block must be sealed once all of its predecessors are known, reads
+	 * in unsealed blocks create placeholder phis that are completed when the block is sealed.
+	 */
+	class ssa_builder {
+	public:
+		// Registers a new variable and returns its id, the name is only used for the phis
+		unsigned addVariable(llvm::Type* type, const std::string& name);
+
+		llvm::Type* variableType(unsigned var) const;
+
+		void writeVariable(unsigned var, llvm::BasicBlock* block, llvm::Value* value);
+		llvm::Value* readVariable(unsigned var, llvm::BasicBlock* block);
+
+		void sealBlock(llvm::BasicBlock* block);
+
+	private:
+		struct variable {
+			llvm::Type* type;
+			std::string name;
+		};
+
+		llvm::Value* readVariableRecursive(unsigned var, llvm::BasicBlock* block);
+		llvm::Value* addPhiOperands(unsigned var, llvm::PHINode* phi);
+		llvm::Value* tryRemoveTrivialPhi(llvm::PHINode* phi);
+
+		std::vector<variable> m_variables;
+
+		// Tracking handles follow the phis replaced by tryRemoveTrivialPhi
+		llvm::DenseMap<llvm::BasicBlock*, llvm::DenseMap<unsigned, llvm::WeakTrackingVH>> m_currentDef;
+
+		llvm::DenseSet<llvm::BasicBlock*> m_sealedBlocks;
+		llvm::DenseMap<llvm::BasicBlock*, std::vector<std::pair<unsigned, llvm::PHINode*>>> m_incompletePhis;
+	};
+
+}
+
@@ -0,0 +1,121 @@
+#include "stringtable.h"
+
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+
+
+using namespace std;
+
+namespace parser {
+
+	namespace {
+
+		/* Strings are stored in fixed size chunks that never move, so looking up the characters
+		 * of an id doesn't take the lock even while other threads are parsing. Only interning a
+		 * new string is serialized.
+		 */
+		class string_table {
+		public:
+			string_table() {
+				// Id 0 is the empty string so default constructed strings need no lookup
+				intern("");
+			}
+
+			~string_table() {
+				for (uint32_t i = 0; i < chunkCount; ++i) {
+					delete[] m_chunks[i].load(memory_order_relaxed);
+				}
+			}
+
+			uint32_t intern(string_view str) {
+				{
+					shared_lock<shared_mutex> lock(m_mutex);
+
+					const auto itr = m_ids.find(str);
+					if (itr != m_ids.end()) {
+						return itr->second;
+					}
+				}
+
+				unique_lock<shared_mutex> lock(m_mutex);
+
+				// Another thread may have added it between the two locks
+				const auto itr = m_ids.find(str);
+				if (itr != m_ids.end()) {
+					return itr->second;
+				}
+
+				const uint32_t id = m_count;
+				assert(id / chunkSize < chunkCount && "String table is full");
+
+				string* chunk = m_chunks[id / chunkSize].load(memory_order_relaxed);
+				if (chunk == nullptr) {
+					chunk = new string[chunkSize];
+				}
+
+				string& stored = chunk[id % chunkSize];
+				stored.assign(str.data(), str.size());
+				m_chunks[id / chunkSize].store(chunk, memory_order_release);
+
+				// The key views the stored copy which never moves
+				m_ids.emplace(string_view(stored), id);
+				++m_count;
+
+				return id;
+			}
+
+			const string& lookup(uint32_t id) const {
+				const string* chunk = m_chunks[id / chunkSize].load(memory_order_acquire);
+				assert(chunk != nullptr && "Unknown interned string");
+
+				return chunk[id % chunkSize];
+			}
+
+			size_t size() const {
+				shared_lock<shared_mutex> lock(m_mutex);
+				return m_count;
+			}
+
+		private:
+			static const uint32_t chunkSize = 1 << 16;
+			static const uint32_t chunkCount = 1 << 16;
+
+			mutable shared_mutex m_mutex;
+			unordered_map<string_view, uint32_t> m_ids;
+			uint32_t m_count = 0;
+
+			// Value initialized so every chunk starts out null
+			unique_ptr<atomic<string*>[]> m_chunks{ new atomic<string*>[chunkCount]() };
+		};
+
+		string_table& table() {
+			static string_table instance;
+			return instance;
+		}
+
+	}
+
+	interned_string::interned_string(const string& str)
+	: m_id(str.empty() ? 0 : table().intern(str)) {}
+
+	interned_string::interned_string(const char* str)
+	: m_id(*str == '\0' ? 0 : table().intern(str)) {}
+
+	interned_string::interned_string(string_view str)
+	: m_id(str.empty() ? 0 : table().intern(str)) {}
+
+	const string& interned_string::str() const {
+		return table().lookup(m_id);
+	}
+
+	size_t internedStringCount() {
+		return table().size();
+	}
+
+}
+
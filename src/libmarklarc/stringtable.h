@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+
+namespace parser {
+
+	/* Name or literal from the source, interned into the process wide string table while parsing.
+	 * Only the 32-bit id is stored so copies are free, equal strings have equal ids and comparing
+	 * or hashing never touches the characters.
+	 */
+	class interned_string {
+	public:
+		// Id of the empty string
+		interned_string()
+		: m_id(0) {}
+
+		interned_string(const std::string& str);
+		interned_string(const char* str);
+
+		// Interns the characters directly, e.g. a token of the source
+		explicit interned_string(std::string_view str);
+
+		uint32_t id() const {
+			return m_id;
+		}
+
+		// The characters stay valid for the lifetime of the process
+		const std::string& str() const;
+
+		operator const std::string&() const {
+			return str();
+		}
+
+		const char* c_str() const {
+			return str().c_str();
+		}
+
+		bool empty() const {
+			return m_id == 0;
+		}
+
+		friend bool operator==(interned_string lhs, interned_string rhs) {
+			return lhs.m_id == rhs.m_id;
+		}
+
+		friend bool operator!=(interned_string lhs, interned_string rhs) {
+			return lhs.m_id != rhs.m_id;
+		}
+
+		// Ordered by id, which is the order the strings were first seen rather than alphabetical
+		friend bool operator<(interned_string lhs, interned_string rhs) {
+			return lhs.m_id < rhs.m_id;
+		}
+
+		friend bool operator==(interned_string lhs, const std::string& rhs) {
+			return lhs.str() == rhs;
+		}
+
+		friend bool operator==(interned_string lhs, const char* rhs) {
+			return lhs.str() == rhs;
+		}
+
+		friend bool operator!=(interned_string lhs, const std::string& rhs) {
+			return lhs.str() != rhs;
+		}
+
+		friend bool operator!=(interned_string lhs, const char* rhs) {
+			return lhs.str() != rhs;
+		}
+
+		friend std::ostream& operator<<(std::ostream& out, interned_string str) {
+			return out << str.str();
+		}
+
+	private:
+		uint32_t m_id;
+	};
+
+	// Number of distinct strings interned so far, including the empty string
+	size_t internedStringCount();
+
+}
+
+namespace std {
+
+	template <>
+	struct hash<parser::interned_string> {
+		size_t operator()(parser::interned_string str) const {
+			return hash<uint32_t>()(str.id());
+		}
+	};
+
+}
+
@@ -0,0 +1,69 @@
+#include "symboltable.h"
+
+#include <cassert>
+
+
+using namespace std;
+
+namespace marklar {
+
+	symbol_table::symbol_table() {
+		// The outermost scope holds the functions
+		pushScope();
+	}
+
+	void symbol_table::pushScope() {
+		m_scopeStarts.push_back(m_bindings.size());
+	}
+
+	void symbol_table::popScope() {
+		assert(m_scopeStarts.size() > 1 && "Can't leave the global scope");
+
+		const size_t start = m_scopeStarts.back();
+		m_scopeStarts.pop_back();
+
+		// Newest first, each binding uncovers the one it shadowed
+		while (m_bindings.size() > start) {
+			const binding& last = m_bindings.back();
+
+			if (last.shadowed == noBinding) {
+				m_index.erase(last.name);
+			} else {
+				m_index[last.name] = last.shadowed;
+			}
+
+			m_bindings.pop_back();
+		}
+	}
+
+	void symbol_table::set(parser::interned_string name, const symbol& sym) {
+		const unsigned depth = static_cast<unsigned>(m_scopeStarts.size());
+
+		const auto result = m_index.emplace(name, static_cast<unsigned>(m_bindings.size()));
+		if (!result.second) {
+			binding& current = m_bindings[result.first->second];
+			if (current.depth == depth) {
+				current.sym = sym;
+				return;
+			}
+		}
+
+		const unsigned shadowed = (result.second ? noBinding : result.first->second);
+		result.first->second = static_cast<unsigned>(m_bindings.size());
+
+		m_bindings.push_back(binding{ sym, name, shadowed, depth });
+	}
+
+	void symbol_table::set(parser::interned_string name, llvm::Value* value) {
+		symbol sym;
+		sym.value = value;
+		set(name, sym);
+	}
+
+	const symbol* symbol_table::find(parser::interned_string name) const {
+		const auto itr = m_index.find(name);
+		return (itr == m_index.end() ? nullptr : &m_bindings[itr->second].sym);
+	}
+
+}
+
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "stringtable.h"
+
+
+namespace llvm {
+	class Value;
+}
+
+namespace marklar {
+
+	struct symbol {
+		static const unsigned noSsaVariable = ~0u;
+
+		llvm::Value* value = nullptr;
+
+		// Id in the function's ssa_builder when the variable is kept in SSA form
+		unsigned ssaVariable = noSsaVariable;
+	};
+
+	/* Symbols visible to the code generator, nested scopes shadow the outer ones. Every name
+	 * maps to its innermost binding which links to the one it shadows, so lookups are a single
+	 * hash of the interned id and leaving a scope only touches the bindings it added.
+	 */
+	class symbol_table {
+	public:
+		// Enters a scope for the lifetime of the object
+		class scope {
+		public:
+			explicit scope(symbol_table& table)
+			: m_table(table) {
+				m_table.pushScope();
+			}
+
+			~scope() {
+				m_table.popScope();
+			}
+
+			scope(const scope&) = delete;
+			scope& operator=(const scope&) = delete;
+
+		private:
+			symbol_table& m_table;
+		};
+
+		symbol_table();
+
+		void pushScope();
+		void popScope();
+
+		// Binds the name in the innermost scope, a binding of the same scope is replaced
+		void set(parser::interned_string name, const symbol& sym);
+		void set(parser::interned_string name, llvm::Value* value);
+
+		// Innermost binding of the name, nullptr when it isn't visible
+		const symbol* find(parser::interned_string name) const;
+
+		bool contains(parser::interned_string name) const {
+			return find(name) != nullptr;
+		}
+
+		// Number of visible names
+		size_t size() const {
+			return m_index.size();
+		}
+
+		// Calls func(name, symbol) for every visible name
+		template <typename func_t>
+		void forEach(func_t func) const {
+			for (const auto& itr : m_index) {
+				func(itr.first, m_bindings[itr.second].sym);
+			}
+		}
+
+	private:
+		static const unsigned noBinding = ~0u;
+
+		struct binding {
+			symbol sym;
+			parser::interned_string name;
+			unsigned shadowed;
+			unsigned depth;
+		};
+
+		std::unordered_map<parser::interned_string, unsigned> m_index;
+		std::vector<binding> m_bindings;
+
+		// Number of bindings when each open scope was entered
+		std::vector<size_t> m_scopeStarts;
+	};
+
+}
+
@@ -0,0 +1,81 @@
+#include "tokenizer.h"
+
+#include "scan.h"
+
+#include <cstring>
+
+
+using namespace std;
+
+namespace {
+
+	// Skips whitespace and '//' comments, a comment only counts when it's ended by a newline
+	const char* skip(const char* p, const char* end) {
+		while (true) {
+			p = marklar::scan::skipSpaces(p, end);
+
+			if (end - p < 2 || p[0] != '/' || p[1] != '/') {
+				return p;
+			}
+
+			const char* eol = marklar::scan::findLineEnd(p + 2, end);
+			if (eol == end) {
+				return p;
+			}
+
+			p = eol + 1;
+		}
+	}
+
+}
+
+namespace marklar {
+
+	namespace lexer {
+
+		bool tokenize(string_view source, vector<token>& tokens) {
+			tokens.clear();
+
+			// Dense code has a token every two or three characters, the list is only kept while parsing
+			tokens.reserve(source.size() / 2 + 1);
+
+			const char* const begin = source.data();
+			const char* const end = begin + source.size();
+			const char* p = skip(begin, end);
+
+			while (p < end) {
+				const char c = *p;
+				const char* tokenEnd = p + 1;
+				token_kind kind = token_kind::punct;
+
+				if (isIdentifierStart(c)) {
+					kind = token_kind::identifier;
+					tokenEnd = scan::skipIdentifierChars(tokenEnd, end);
+				} else if (isDigit(c)) {
+					kind = token_kind::number;
+					tokenEnd = scan::skipDigits(tokenEnd, end);
+				} else if (c == '"') {
+					kind = token_kind::string;
+
+					const char* close = static_cast<const char*>(memchr(tokenEnd, '"', end - tokenEnd));
+					if (close == nullptr) {
+						return false;
+					}
+
+					tokenEnd = close + 1;
+				}
+
+				tokens.push_back(token{ static_cast<uint32_t>(p - begin), static_cast<uint32_t>(tokenEnd - begin), kind });
+				p = skip(tokenEnd, end);
+			}
+
+			const size_t size = source.size();
+			tokens.push_back(token{ static_cast<uint32_t>(size), static_cast<uint32_t>(size), token_kind::end });
+
+			return true;
+		}
+
+	}
+
+}
+
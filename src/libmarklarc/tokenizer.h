@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+
+namespace marklar {
+
+	/* Splits Marklar source into tokens in one pass, whitespace and comments are skipped exactly
+	 * where the X3 skipper would skip them.
+	 */
+	namespace lexer {
+
+		enum class token_kind : uint8_t {
+			// [a-zA-Z_][a-zA-Z_0-9']*, keywords are identifiers as well
+			identifier,
+
+			// [0-9]+
+			number,
+
+			// Double quoted and including the quotes, there are no escapes
+			string,
+
+			// Any other single character, operators of two characters are two adjacent tokens
+			punct,
+
+			// Always the last token
+			end
+		};
+
+		struct token {
+			// Characters [begin, end) of the source
+			uint32_t begin;
+			uint32_t end;
+			token_kind kind;
+		};
+
+		// Replaces tokens with those of the source, fails on an unterminated string since no parse
+		// of the source can succeed then
+		bool tokenize(std::string_view source, std::vector<token>& tokens);
+
+		inline bool isIdentifierStart(char c) {
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+		}
+
+		inline bool isDigit(char c) {
+			return c >= '0' && c <= '9';
+		}
+
+		// Type names stop at a quote, variable names may contain them
+		inline bool isTypeNameChar(char c) {
+			return isIdentifierStart(c) || isDigit(c);
+		}
+
+		inline bool isIdentifierChar(char c) {
+			return isTypeNameChar(c) || c == '\'';
+		}
+
+	}
+
+}
+
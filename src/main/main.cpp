@@ -1,14 +1,19 @@
-#include <fstream>
-#include <sstream>
+#include <algorithm>
 #include <string>
 #include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
 
+#include <boost/filesystem/path.hpp>
 #include <boost/program_options/cmdline.hpp>
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/parsers.hpp>
 #include <boost/program_options/variables_map.hpp>
 
 #include "driver.h"
+#include "parser.h"
+#include "profiler.h"
 
 using namespace std;
 namespace po = boost::program_options;
@@ -22,7 +27,24 @@ int main(int argc, char** argv) {
 	desc.add_options()
 		("help", "produce help message")
 		("output-file,o", po::value<string>(), "output file")
-		("input-file,i", po::value<string>(), "input file")
+		("input-file,i", po::value<vector<string>>(), "input files, each is compiled into its own executable")
+		("output-dir", po::value<string>(), "directory of the executables when compiling several input files")
+		("cache-dir", po::value<string>(), "reuse optimized objects from this directory for unchanged sources")
+		("function-cache", "with --cache-dir, cache each function separately so only edited functions are rebuilt")
+		("opt-level,O", po::value<unsigned>(), "optimization level from 0 to 3, defaults to 3")
+		("jobs,j", po::value<unsigned>(), "number of threads compiling input files and functions, 0 uses every core")
+		("time-report", "print how long each compiler phase took")
+		("trace-file", po::value<string>(), "write a Chrome trace of the compiler phases and functions to this file")
+		("run", "JIT compile and run main() in-process instead of producing an executable")
+		("tiered", "with --run, start unoptimized and recompile hot functions at -O3 in the background")
+		("tier-threshold", po::value<unsigned>(), "number of calls before a function is recompiled by --tiered")
+		("lazy", "with --run, parse, generate and compile each function only when it's first called")
+		("interpret", "run main() in the bytecode interpreter, which starts at once but runs slower than --run")
+		("precompile", "compile the input to bytecode and write it as a precompiled module for --module")
+		("module,m", po::value<vector<string>>(), "precompiled module defining functions the input calls, with --interpret and --precompile")
+		("parser", po::value<string>(), "parser to use, either spirit (default) or descent")
+		("pipeline", "parse one function at a time on a second thread while the previous ones are generated")
+		("lazy-parse", "parse each function body only when it's generated, uses the descent parser")
 		;
 
 	po::positional_options_description p;
@@ -37,25 +59,138 @@ int main(int argc, char** argv) {
 		return 1;
 	}
 
+	if (vm.count("parser") > 0) {
+		const string parserName = vm["parser"].as<string>();
+		if (parserName == "descent") {
+			marklar::setParserBackend(marklar::parser_backend::descent);
+		} else if (parserName != "spirit") {
+			cerr << "Unknown parser '" << parserName << "', expected spirit or descent" << endl;
+			return 1;
+		}
+	}
+
+	// Each level is also part of the cache key, so anything out of range is rejected up front
+	if (vm.count("opt-level") > 0 && vm["opt-level"].as<unsigned>() > 3) {
+		cerr << "Unknown optimization level '" << vm["opt-level"].as<unsigned>() << "', expected 0 to 3" << endl;
+		return 1;
+	}
+
+	const bool timeReport = (vm.count("time-report") > 0);
+	const string traceFilename = (vm.count("trace-file") > 0 ? vm["trace-file"].as<string>() : "");
+	if (timeReport || !traceFilename.empty()) {
+		marklar::profiler::enable();
+	}
+
+	// Reports whatever was recorded once compiling finishes, even when it failed
+	const auto reportProfile = [&]() {
+		if (timeReport) {
+			marklar::profiler::printReport(cerr);
+		}
+
+		if (!traceFilename.empty()) {
+			marklar::profiler::writeTrace(traceFilename);
+		}
+	};
+
 	if (vm.count("input-file") > 0) {
-		const string inputFilename = vm["input-file"].as<string>();
-		const string tmpBitCodeFile = "output.bc";
-		string outputFilename = "a.out";
+		const vector<string> inputFilenames = vm["input-file"].as<vector<string>>();
+
+		// Map the source files, they're parsed in place and stay open until compiling is done
+		vector<unique_ptr<source_file>> sourceFiles;
+		vector<batch_input> inputs;
+		for (const auto& inputFilename : inputFilenames) {
+			unique_ptr<source_file> sourceFile = source_file::open(inputFilename);
+			if (!sourceFile) {
+				return 2;
+			}
+
+			inputs.push_back(batch_input{ sourceFile->text(), "" });
+			sourceFiles.push_back(std::move(sourceFile));
+		}
 
-		if (vm.count("output-file") > 0) {
-			outputFilename = vm["output-file"].as<string>();
+		if (inputs.size() == 1) {
+			inputs[0].exeName = (vm.count("output-file") > 0 ? vm["output-file"].as<string>() : "a.out");
+		} else {
+			if (vm.count("output-file") > 0 || vm.count("run") > 0 || vm.count("interpret") > 0 || vm.count("precompile") > 0) {
+				cerr << "--output-file, --run, --interpret and --precompile take a single input file, use --output-dir for several" << endl;
+				return 1;
+			}
+
+			// Each executable is named after its source file
+			const boost::filesystem::path outputDir(vm.count("output-dir") > 0 ? vm["output-dir"].as<string>() : ".");
+			map<string, string> exeSources;
+			for (size_t i = 0; i < inputs.size(); ++i) {
+				inputs[i].exeName = (outputDir / boost::filesystem::path(inputFilenames[i]).stem()).string();
+
+				// Inputs sharing a stem would overwrite each other's executable
+				const auto inserted = exeSources.emplace(inputs[i].exeName, inputFilenames[i]);
+				if (!inserted.second) {
+					cerr << "Inputs '" << inserted.first->second << "' and '" << inputFilenames[i] << "' would both produce '" << inputs[i].exeName << "'" << endl;
+					return 1;
+				}
+			}
 		}
 
-		// Pull in the source file and generate the code
-		ifstream in(inputFilename.c_str());
-		const string fileContents(static_cast<stringstream const&>(stringstream() << in.rdbuf()).str());
+		const vector<string> moduleFilenames = (vm.count("module") > 0 ? vm["module"].as<vector<string>>() : vector<string>());
+
+		if (vm.count("precompile") > 0) {
+			const string moduleName = (vm.count("output-file") > 0 ? vm["output-file"].as<string>() : "a.mrkm");
+			const bool written = precompileModule(inputs[0].input, moduleName, moduleFilenames);
+			reportProfile();
 
-		if (!generateOutput(fileContents, tmpBitCodeFile)) {
-			return 2;
+			return (written ? 0 : 2);
 		}
 
-		if (!optimizeAndLink(tmpBitCodeFile, outputFilename)) {
-			return 3;
+		if (vm.count("interpret") > 0) {
+			int exitCode = 0;
+			const bool ran = runInterpreter(inputs[0].input, exitCode, cout, moduleFilenames);
+			reportProfile();
+
+			return (ran ? exitCode : 2);
+		}
+
+		if (vm.count("run") > 0) {
+			marklar::jit::jit_options jitOptions;
+			jitOptions.tiered = (vm.count("tiered") > 0);
+			jitOptions.lazy = (vm.count("lazy") > 0);
+
+			if (vm.count("tier-threshold") > 0) {
+				jitOptions.hotCallThreshold = vm["tier-threshold"].as<unsigned>();
+			}
+
+			int exitCode = 0;
+			const bool ran = runJIT(inputs[0].input, exitCode, jitOptions);
+			reportProfile();
+
+			return (ran ? exitCode : 2);
+		}
+
+		compile_options compileOptions;
+		if (vm.count("cache-dir") > 0) {
+			compileOptions.cacheDir = vm["cache-dir"].as<string>();
+		}
+		compileOptions.functionCache = (vm.count("function-cache") > 0);
+		compileOptions.pipeline = (vm.count("pipeline") > 0);
+		compileOptions.lazyParse = (vm.count("lazy-parse") > 0);
+
+		if (vm.count("opt-level") > 0) {
+			compileOptions.optLevel = vm["opt-level"].as<unsigned>();
+		}
+
+		if (vm.count("jobs") > 0) {
+			compileOptions.jobs = vm["jobs"].as<unsigned>();
+			if (compileOptions.jobs == 0) {
+				compileOptions.jobs = max(thread::hardware_concurrency(), 1u);
+			}
+		}
+
+		bool linkFailed = false;
+		const bool compiled = compileExecutables(inputs, compileOptions, &linkFailed);
+		reportProfile();
+
+		// Scripts tell a program that doesn't compile from a toolchain that can't link it
+		if (!compiled) {
+			return (linkFailed ? 3 : 2);
 		}
 	}
 
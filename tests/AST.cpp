@@ -1,5 +1,7 @@
 #include "catch.hpp"
 
+#include "ParseBoth.h"
+
 #include <parser.h>
 
 #include <map>
@@ -18,7 +20,7 @@ TEST_CASE("ASTTest_BasicFunction") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	REQUIRE(expr != nullptr);
@@ -39,7 +41,7 @@ TEST_CASE("ASTTest_FunctionSingleDecl") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	REQUIRE(expr != nullptr);
@@ -56,7 +58,7 @@ TEST_CASE("ASTTest_FunctionSingleDecl") {
 	binary_op* opVal = boost::get<binary_op>(&decl->val);
 	REQUIRE(opVal != nullptr);
 
-	string* opValStr = boost::get<string>(&opVal->lhs);
+	interned_string* opValStr = boost::get<interned_string>(&opVal->lhs);
 	REQUIRE(opValStr != nullptr);
 	CHECK("0" == *opValStr);
 }
@@ -70,7 +72,7 @@ TEST_CASE("ASTTest_FunctionMultiDecl") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	REQUIRE(expr);
@@ -99,7 +101,7 @@ TEST_CASE("ASTTest_FunctionMultiDecl") {
 		binary_op* valOp = boost::get<binary_op>(&decl->val);
 		CHECK(valOp);
 
-		string* lhsVal = boost::get<string>(&valOp->lhs);
+		interned_string* lhsVal = boost::get<interned_string>(&valOp->lhs);
 		CHECK(lhsVal);
 		CHECK(itr->second == *lhsVal);
 	}
@@ -112,7 +114,7 @@ TEST_CASE("ASTTest_FunctionDeclAssign") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	func_expr* exprF = boost::get<func_expr>(&expr->children[0]);
@@ -131,7 +133,7 @@ TEST_CASE("ASTTest_FunctionDeclAssign") {
 	// Check decl value
 	CHECK("+" == opExpr->operation[0].op);
 
-	string* rhsVal = boost::get<string>(&opExpr->operation[0].rhs);
+	interned_string* rhsVal = boost::get<interned_string>(&opExpr->operation[0].rhs);
 	CHECK("2" == *rhsVal);
 }
 
@@ -144,7 +146,7 @@ TEST_CASE("ASTTest_FunctionMultiDeclAssign") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	func_expr* exprF = boost::get<func_expr>(&expr->children[0]);
@@ -177,13 +179,13 @@ TEST_CASE("ASTTest_FunctionMultiDeclAssign") {
 
 		CHECK(1u == opExpr->operation.size());
 
-		string* lhsVal = boost::get<string>(&opExpr->lhs);
+		interned_string* lhsVal = boost::get<interned_string>(&opExpr->lhs);
 		CHECK(get<1>(expectedValues) == *lhsVal);
 
 		// Check decl value
 		CHECK(get<2>(expectedValues) == opExpr->operation[0].op);
 
-		string* rhsVal = boost::get<string>(&opExpr->operation[0].rhs);
+		interned_string* rhsVal = boost::get<interned_string>(&opExpr->operation[0].rhs);
 		CHECK(get<3>(expectedValues) == *rhsVal);
 
 		index += 1;
@@ -197,7 +199,7 @@ TEST_CASE("ASTTest_FunctionReturn") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	func_expr* exprF = boost::get<func_expr>(&expr->children[0]);
@@ -211,7 +213,7 @@ TEST_CASE("ASTTest_FunctionReturn") {
 	binary_op* exprRval = boost::get<binary_op>(&exprR->ret);
 	CHECK(exprRval);
 
-	string* exprRvalStr = boost::get<string>(&exprRval->lhs);
+	interned_string* exprRvalStr = boost::get<interned_string>(&exprRval->lhs);
 	CHECK(exprRvalStr);
 	CHECK("1" == *exprRvalStr);
 }
@@ -223,7 +225,7 @@ TEST_CASE("ASTTest_FunctionReturnComplex") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	func_expr* exprF = boost::get<func_expr>(&expr->children[0]);
@@ -241,7 +243,7 @@ TEST_CASE("ASTTest_MultipleFunction") {
 		"i32 main() {}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	CHECK(2u == expr->children.size());
@@ -271,7 +273,7 @@ TEST_CASE("ASTTest_MultipleComplexFunction") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	CHECK(3u == expr->children.size());
@@ -283,7 +285,7 @@ TEST_CASE("ASTTest_FunctionArgs") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	REQUIRE(expr != nullptr);
@@ -312,7 +314,7 @@ TEST_CASE("ASTTest_FunctionCall") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	REQUIRE(expr != nullptr);
@@ -341,7 +343,7 @@ TEST_CASE("ASTTest_FunctionCallArgs") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	REQUIRE(expr != nullptr);
@@ -361,7 +363,7 @@ TEST_CASE("ASTTest_FunctionCallArgs") {
 	binary_op* val = boost::get<binary_op>(&callExpr->values[0]);
 	REQUIRE(val != nullptr);
 
-	string* strVal = boost::get<string>(&val->lhs);
+	interned_string* strVal = boost::get<interned_string>(&val->lhs);
 	REQUIRE(strVal != nullptr);
 	CHECK("45" == *strVal);
 }
@@ -377,7 +379,7 @@ TEST_CASE("ASTTest_FunctionCallArgsComplex") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	CHECK(expr);
@@ -397,14 +399,14 @@ TEST_CASE("ASTTest_FunctionCallArgsComplex") {
 	binary_op* val1 = boost::get<binary_op>(&callExpr->values[0]);
 	CHECK(val1);
 
-	string* val1Str = boost::get<string>(&val1->lhs);
+	interned_string* val1Str = boost::get<interned_string>(&val1->lhs);
 	CHECK(val1Str);
 	CHECK("a" == *val1Str);
 
 	binary_op* val2 = boost::get<binary_op>(&callExpr->values[1]);
 	CHECK(val2);
 
-	string* val2Str = boost::get<string>(&val2->lhs);
+	interned_string* val2Str = boost::get<interned_string>(&val2->lhs);
 	CHECK(val2Str);
 	CHECK("5" == *val2Str);
 }
@@ -417,7 +419,7 @@ TEST_CASE("ASTTest_FunctionIfStmt") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	func_expr* exprF_main = boost::get<func_expr>(&expr->children[0]);
@@ -426,14 +428,14 @@ TEST_CASE("ASTTest_FunctionIfStmt") {
 	REQUIRE(exprIf != nullptr);
 
 	// Check the condition
-	string* exprIfOpLhs = boost::get<string>(&exprIf->condition.lhs);
+	interned_string* exprIfOpLhs = boost::get<interned_string>(&exprIf->condition.lhs);
 	REQUIRE(exprIfOpLhs != nullptr);
 	CHECK("i" == *exprIfOpLhs);
 
 	CHECK(1u == exprIf->condition.operation.size());
 	CHECK("<" == exprIf->condition.operation[0].op);
 
-	string* exprIfOpRhs = boost::get<string>(&exprIf->condition.operation[0].rhs);
+	interned_string* exprIfOpRhs = boost::get<interned_string>(&exprIf->condition.operation[0].rhs);
 	REQUIRE(exprIfOpRhs != nullptr);
 	CHECK("4" == *exprIfOpRhs);
 }
@@ -449,7 +451,7 @@ TEST_CASE("ASTTest_FunctionIfElseStmt") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	func_expr* exprF_main = boost::get<func_expr>(&expr->children[0]);
@@ -469,7 +471,7 @@ TEST_CASE("ASTTest_Assignment") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	func_expr* exprF_main = boost::get<func_expr>(&expr->children[0]);
@@ -485,14 +487,14 @@ TEST_CASE("ASTTest_Assignment") {
 	binary_op* exprRhs = boost::get<binary_op>(&varAssign->varRhs);
 	REQUIRE(exprRhs != nullptr);
 
-	string* exprRhs_Lhs = boost::get<string>(&exprRhs->lhs);
+	interned_string* exprRhs_Lhs = boost::get<interned_string>(&exprRhs->lhs);
 	REQUIRE(exprRhs_Lhs != nullptr);
 	CHECK("a" == *exprRhs_Lhs);
 
 	CHECK(1u == exprRhs->operation.size());
 	CHECK("+" == exprRhs->operation[0].op);
 
-	string* exprRhs_Rhs = boost::get<string>(&exprRhs->operation[0].rhs);
+	interned_string* exprRhs_Rhs = boost::get<interned_string>(&exprRhs->operation[0].rhs);
 	REQUIRE(exprRhs_Rhs != nullptr);
 	CHECK("1" == *exprRhs_Rhs);
 }
@@ -505,7 +507,7 @@ TEST_CASE("ASTTest_WhileStmt") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	func_expr* exprF_main = boost::get<func_expr>(&expr->children[0]);
@@ -514,14 +516,14 @@ TEST_CASE("ASTTest_WhileStmt") {
 	REQUIRE(exprLoop != nullptr);
 
 	// Check the condition
-	string* exprLoopOpLhs = boost::get<string>(&exprLoop->condition.lhs);
+	interned_string* exprLoopOpLhs = boost::get<interned_string>(&exprLoop->condition.lhs);
 	CHECK(exprLoopOpLhs);
 	CHECK("i" == *exprLoopOpLhs);
 
 	CHECK(1u == exprLoop->condition.operation.size());
 	CHECK("<" == exprLoop->condition.operation[0].op);
 
-	string* exprLoopOpRhs = boost::get<string>(&exprLoop->condition.operation[0].rhs);
+	interned_string* exprLoopOpRhs = boost::get<interned_string>(&exprLoop->condition.operation[0].rhs);
 	REQUIRE(exprLoopOpRhs != nullptr);
 	CHECK("4" == *exprLoopOpRhs);
 }
@@ -539,7 +541,7 @@ TEST_CASE("ASTTest_FuncCallInIfStmt") {
 		"}";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	CHECK(expr);
@@ -564,7 +566,7 @@ TEST_CASE("ASTTest_DuplicateDefinition") {
 		)mrk";
 
 	base_expr_node root;
-	REQUIRE(parse(testProgram, root));
+	REQUIRE(parseBoth(testProgram, root));
 
 	base_expr* expr = boost::get<base_expr>(&root);
 	REQUIRE(expr);
@@ -23,11 +23,11 @@ using namespace std;
 
 namespace {
 
-	unique_ptr<Module> codegenTest(LLVMContext& context, const base_expr_node& root) {
+	unique_ptr<Module> codegenTest(LLVMContext& context, const base_expr_node& root, bool directSsa = false) {
 		unique_ptr<Module> module(new Module("", context));
 		IRBuilder<> builder(context);
 
-		ast_codegen codeGenerator(&context, module.get(), builder);
+		ast_codegen codeGenerator(&context, module.get(), builder, directSsa);
 
 		// Codegen for each expression we've found in the root AST
 		const base_expr* expr = boost::get<base_expr>(&root);
@@ -38,6 +38,19 @@ namespace {
 		return module;
 	}
 
+	size_t countInstructions(const Module& module, unsigned opcode) {
+		size_t count = 0;
+		for (const auto& func : module) {
+			for (const auto& block : func) {
+				for (const auto& inst : block) {
+					count += (inst.getOpcode() == opcode ? 1 : 0);
+				}
+			}
+		}
+
+		return count;
+	}
+
 
 	class CodegenTestFixture {
 	public:
@@ -618,3 +631,82 @@ TEST_CASE_METHOD(CodegenTestFixture, "InvalidType") {
 	INFO(m_errorInfo);
 	CHECK_FALSE(verifyModule(*module, &m_errorOut));
 }
+
+TEST_CASE_METHOD(CodegenTestFixture, "DirectSsaIfElse") {
+	const auto testProgram = R"mrk(
+		i32 main(i32 a) {
+			i32 b = 1;
+			if (a > 2) {
+				b = a + 1;
+			} else {
+				b = 5;
+			}
+			return b;
+		}
+		)mrk";
+
+	CHECK(parse(testProgram, m_root));
+
+	LLVMContext context;
+	auto module = codegenTest(context, m_root, true);
+	INFO(m_errorInfo);
+	CHECK_FALSE(verifyModule(*module, &m_errorOut));
+
+	CHECK(0 == countInstructions(*module, Instruction::Alloca));
+	CHECK(0 == countInstructions(*module, Instruction::Load));
+	CHECK(0 == countInstructions(*module, Instruction::Store));
+
+	// 'b' merges at if.end, the return value is only ever set once and needs none
+	CHECK(1 == countInstructions(*module, Instruction::PHI));
+}
+
+TEST_CASE_METHOD(CodegenTestFixture, "DirectSsaWhileLoop") {
+	const auto testProgram = R"mrk(
+		i64 main(i32 n) {
+			i64 total = 0;
+			i32 unused = 7;
+			while (n > 0) {
+				total = total + n;
+				n = n - 1;
+			}
+			return total;
+		}
+		)mrk";
+
+	CHECK(parse(testProgram, m_root));
+
+	LLVMContext context;
+	auto module = codegenTest(context, m_root, true);
+	INFO(m_errorInfo);
+	CHECK_FALSE(verifyModule(*module, &m_errorOut));
+
+	CHECK(0 == countInstructions(*module, Instruction::Alloca));
+
+	// Only the variables changed by the loop need a phi at while.cond
+	CHECK(2 == countInstructions(*module, Instruction::PHI));
+}
+
+TEST_CASE_METHOD(CodegenTestFixture, "DirectSsaEarlyReturns") {
+	const auto testProgram = R"mrk(
+		i32 main(i32 a) {
+			while (a > 10) {
+				if (a == 15) {
+					return 1;
+				}
+				a = a - 1;
+			}
+			if (a == 3) {
+				return 2;
+			}
+			return a;
+		}
+		)mrk";
+
+	CHECK(parse(testProgram, m_root));
+
+	LLVMContext context;
+	auto module = codegenTest(context, m_root, true);
+	INFO(m_errorInfo);
+	CHECK_FALSE(verifyModule(*module, &m_errorOut));
+	CHECK(0 == countInstructions(*module, Instruction::Alloca));
+}
@@ -0,0 +1,105 @@
+#include "catch.hpp"
+
+#include "ParseBoth.h"
+
+#include <parser.h>
+#include <tokenizer.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/variant/get.hpp>
+
+using namespace marklar;
+using namespace marklar::lexer;
+using namespace parser;
+using namespace std;
+
+
+TEST_CASE("DescentParserTest_Tokenize") {
+	const string source = "i32 a'b = f(12, \"x y\") >= 3; // done\n}";
+
+	vector<token> tokens;
+	REQUIRE(tokenize(source, tokens));
+
+	const vector<string> expected = { "i32", "a'b", "=", "f", "(", "12", ",", "\"x y\"", ")", ">", "=", "3", ";", "}", "" };
+	REQUIRE(expected.size() == tokens.size());
+
+	for (size_t i = 0; i < tokens.size(); ++i) {
+		CHECK(expected[i] == source.substr(tokens[i].begin, tokens[i].end - tokens[i].begin));
+	}
+
+	CHECK(token_kind::identifier == tokens[1].kind);
+	CHECK(token_kind::number == tokens[5].kind);
+	CHECK(token_kind::string == tokens[7].kind);
+	CHECK(token_kind::punct == tokens[9].kind);
+	CHECK(token_kind::end == tokens.back().kind);
+}
+
+TEST_CASE("DescentParserTest_TokenizeUnterminated") {
+	vector<token> tokens;
+	CHECK_FALSE(tokenize("i32 main() { printf(\"abc); }", tokens));
+
+	// A comment without a newline isn't skipped
+	REQUIRE(tokenize("// abc", tokens));
+	CHECK(4u == tokens.size());
+}
+
+TEST_CASE("DescentParserTest_SpiritQuirks") {
+	// Keywords aren't checked for a word boundary, type names stop at a quote and the digits of
+	// a literal may be separated by whitespace
+	const auto testProgram = R"mrk(
+		type a { i32 b; }
+		i32 main(i32 a, i64 b i32 c'd) {
+			returnx;
+			i32 b'c = 1 2 + f(a b,c) - (b >> 2);
+			i'x = 3;
+			if (a){}else{}
+			while (1) { 4 }
+			if (b) { } elsex = 1;
+			return 1;
+		}
+	)mrk";
+
+	base_expr_node root;
+	CHECK(parseBoth(testProgram, root));
+}
+
+TEST_CASE("DescentParserTest_Failures") {
+	CHECK_FALSE(parseBoth("i32 main() {"));
+	CHECK_FALSE(parseBoth("i32 main() { return f(x)+y; }"));
+	CHECK_FALSE(parseBoth("i32 main() { f(a,,b); }"));
+	CHECK_FALSE(parseBoth("i32 main() {} // trailing"));
+	CHECK_FALSE(parseBoth("i32 main() { if (a) {} else { i32 x = ; } }"));
+}
+
+TEST_CASE("DescentParserTest_Program") {
+	const auto testProgram = R"mrk(
+		// Sums the multiples of 3 or 5 below the limit
+		i32 sum(i32 limit) {
+			i32 total = 0;
+			i32 i = 1;
+			while (i < limit) {
+				if ((i % 3 == 0) || (i % 5 == 0)) {
+					total = total + i;
+				} else {
+					total = total;
+				}
+				i = i + 1;
+			}
+			return total;
+		}
+
+		i32 main() {
+			printf("%d\n", sum(1000));
+			return 0;
+		}
+	)mrk";
+
+	base_expr_node root;
+	REQUIRE(parseBoth(testProgram, root));
+
+	const base_expr* expr = boost::get<base_expr>(&root);
+	REQUIRE(expr != nullptr);
+	CHECK(2u == expr->children.size());
+}
@@ -4,14 +4,26 @@
 
 #include <algorithm>
 #include <fstream>
+#include <functional>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <boost/filesystem.hpp>
 #include <boost/scope_exit.hpp>
 
+#include <bytecode.h>
 #include <driver.h>
+#include <parser.h>
+#include <precompiled.h>
+#include <profiler.h>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
 
 
 using namespace marklar;
@@ -69,6 +81,34 @@ namespace {
 	}
 
 
+	// What the last program run by interpret() printed
+	string g_interpretedStdout;
+
+	string interpretedStdout() {
+		return g_interpretedStdout;
+	}
+
+	// Same as createExe and runExecutable, through the bytecode interpreter instead of LLVM
+	int interpret(const string& testProgram, int32_t argCount = 1) {
+		parser::base_expr_node root;
+		bytecode::module program;
+		if (!parse(testProgram, root) || !bytecode::compile(root, program, testProgram)) {
+			return -1;
+		}
+
+		ostringstream out;
+		int exitCode = -1;
+		if (!bytecode::run(program, exitCode, out, argCount)) {
+			return -1;
+		}
+
+		g_interpretedStdout = out.str();
+
+		// As the exit status of an executable
+		return (exitCode & 0xff);
+	}
+
+
 	class DriverTestFixture {
 	public:
 		void TearDown() {
@@ -94,6 +134,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_BasicFunction") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(3 == runExecutable(g_outputExe));
+	CHECK(3 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionSingleDecl") {
@@ -106,6 +147,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionSingleDecl") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(2 == runExecutable(g_outputExe));
+	CHECK(2 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionMultiDecl") {
@@ -119,6 +161,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionMultiDecl") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(5 == runExecutable(g_outputExe));
+	CHECK(5 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionMultiDeclSum") {
@@ -132,6 +175,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionMultiDeclSum") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(7 == runExecutable(g_outputExe));
+	CHECK(7 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionMultiDeclSumComplex") {
@@ -145,6 +189,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionMultiDeclSumCompl
 	REQUIRE(createExe(testProgram));
 
 	CHECK(13 == runExecutable(g_outputExe));
+	CHECK(13 == interpret(testProgram));
 }
 
 // Tests scoping rules of multiple functions with identical variable names
@@ -166,6 +211,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_MultipleFunction") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(3 == runExecutable(g_outputExe));
+	CHECK(3 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionUseArgs") {
@@ -177,8 +223,11 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionUseArgs") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(1 == runExecutable(g_outputExe));
+	CHECK(1 == interpret(testProgram));
 	CHECK(2 == runExecutable(g_outputExe + " arg1"));
+	CHECK(2 == interpret(testProgram, 2));
 	CHECK(3 == runExecutable(g_outputExe + " arg1 arg2"));
+	CHECK(3 == interpret(testProgram, 3));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionCall") {
@@ -193,8 +242,11 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionCall") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(2 == runExecutable(g_outputExe));
+	CHECK(2 == interpret(testProgram));
 	CHECK(3 == runExecutable(g_outputExe + " arg1"));
+	CHECK(3 == interpret(testProgram, 2));
 	CHECK(4 == runExecutable(g_outputExe + " arg1 arg2"));
+	CHECK(4 == interpret(testProgram, 3));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionIfStmtReturnSimple") {
@@ -209,6 +261,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionIfStmtReturnSimpl
 	REQUIRE(createExe(testProgram));
 
 	CHECK(1 == runExecutable(g_outputExe));
+	CHECK(1 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionIfStmtReturn") {
@@ -225,6 +278,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionIfStmtReturn") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(1 == runExecutable(g_outputExe));
+	CHECK(1 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionIfElseStmtReturn") {
@@ -243,6 +297,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionIfElseStmtReturn"
 	REQUIRE(createExe(testProgram));
 
 	CHECK(0 == runExecutable(g_outputExe));
+	CHECK(0 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_OperatorLessThan") {
@@ -257,6 +312,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_OperatorLessThan") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(1 == runExecutable(g_outputExe));
+	CHECK(1 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_OperatorGreaterThan") {
@@ -271,6 +327,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_OperatorGreaterThan") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(2 == runExecutable(g_outputExe));
+	CHECK(2 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_OperatorEqual") {
@@ -285,6 +342,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_OperatorEqual") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(1 == runExecutable(g_outputExe));
+	CHECK(1 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_OperatorModulo") {
@@ -300,6 +358,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_OperatorModulo") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(1 == runExecutable(g_outputExe));
+	CHECK(1 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_WhileStmt") {
@@ -316,6 +375,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_WhileStmt") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(6 == runExecutable(g_outputExe));
+	CHECK(6 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_LogicalOR") {
@@ -332,6 +392,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_LogicalOR") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(2 == runExecutable(g_outputExe));
+	CHECK(2 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_LogicalAND") {
@@ -348,6 +409,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_LogicalAND") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(1 == runExecutable(g_outputExe));
+	CHECK(1 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_Division") {
@@ -360,6 +422,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_Division") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(1 == runExecutable(g_outputExe));
+	CHECK(1 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_Subtraction") {
@@ -372,6 +435,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_Subtraction") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(2 == runExecutable(g_outputExe));
+	CHECK(2 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_Multiplication") {
@@ -384,6 +448,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_Multiplication") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(15 == runExecutable(g_outputExe));
+	CHECK(15 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_MultiMethods") {
@@ -399,6 +464,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_MultiMethods") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(15 == runExecutable(g_outputExe));
+	CHECK(15 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FuncCallInIfStmt") {
@@ -416,6 +482,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FuncCallInIfStmt") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(15 == runExecutable(g_outputExe));
+	CHECK(15 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_IfWith2ReturnStmt") {
@@ -434,6 +501,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_IfWith2ReturnStmt") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(1 == runExecutable(g_outputExe));
+	CHECK(1 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_WhileWithReturnStmt") {
@@ -448,6 +516,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_WhileWithReturnStmt") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(1 == runExecutable(g_outputExe));
+	CHECK(1 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FuncWithEarlyReturnStmt") {
@@ -463,6 +532,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FuncWithEarlyReturnStmt")
 	REQUIRE(createExe(testProgram));
 
 	CHECK(2 == runExecutable(g_outputExe));
+	CHECK(2 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_MultipleChainedFunctionCall") {
@@ -480,6 +550,7 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_MultipleChainedFunctionCa
 	REQUIRE(createExe(testProgram));
 
 	CHECK(27 == runExecutable(g_outputExe));
+	CHECK(27 == interpret(testProgram));
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FuncWithPrintf") {
@@ -492,8 +563,10 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FuncWithPrintf") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(0 == runExecutable(g_outputExe));
+	CHECK(0 == interpret(testProgram));
 
 	CHECK("test" == stdoutContents());
+	CHECK("test" == interpretedStdout());
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_PrintfEscapeChars") {
@@ -507,8 +580,10 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_PrintfEscapeChars") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(0 == runExecutable(g_outputExe));
+	CHECK(0 == interpret(testProgram));
 
 	CHECK("test\n" == stdoutContents());
+	CHECK("test\n" == interpretedStdout());
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_PrintfMultiArg") {
@@ -522,8 +597,10 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_PrintfMultiArg") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(0 == runExecutable(g_outputExe));
+	CHECK(0 == interpret(testProgram));
 
 	CHECK("test: hello world 32\n" == stdoutContents());
+	CHECK("test: hello world 32\n" == interpretedStdout());
 }
 
 TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_PrintfMultiFunc") {
@@ -541,7 +618,803 @@ TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_PrintfMultiFunc") {
 	REQUIRE(createExe(testProgram));
 
 	CHECK(0 == runExecutable(g_outputExe));
+	CHECK(0 == interpret(testProgram));
 
 	CHECK("test: hello world 32\n" == stdoutContents());
+	CHECK("test: hello world 32\n" == interpretedStdout());
+}
+
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_CompileWithoutBitcode") {
+	const auto testProgram =
+		"i32 square(i32 n) {"
+		"  return n * n;"
+		"}"
+		"i32 main() {"
+		"  return 2 + square(4);"
+		"}";
+
+	boost::filesystem::remove(g_outputBitCode);
+
+	REQUIRE(driver::compileExecutable(testProgram, g_outputExe));
+
+	// Optimization and object emission happen in-process, nothing should be left behind
+	CHECK_FALSE(boost::filesystem::exists(g_outputBitCode));
+	CHECK_FALSE(boost::filesystem::exists("output.o"));
+
+	CHECK(18 == runExecutable(g_outputExe));
+	CHECK(18 == interpret(testProgram));
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_JITBasicFunction") {
+	const auto testProgram =
+		"i32 main() {"
+		"  return 3;"
+		"}";
+
+	boost::filesystem::remove(g_outputExe);
+
+	int exitCode = -1;
+	REQUIRE(driver::runJIT(testProgram, exitCode));
+	CHECK(3 == exitCode);
+
+	// Running through the JIT should not produce any files
+	CHECK_FALSE(boost::filesystem::exists(g_outputBitCode));
+	CHECK_FALSE(boost::filesystem::exists(g_outputExe));
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_JITFunctionCallsAndLoops") {
+	const auto testProgram =
+		"i64 sum(i64 n) {"
+		"  i64 total = 0;"
+		"  i64 i = n;"
+		"  while (i > 0) {"
+		"    total = total + i;"
+		"    i = i - 1;"
+		"  }"
+		"  return total;"
+		"}"
+		"i64 main(i32 argc) {"
+		"  return argc + sum(10);"
+		"}";
+
+	int exitCode = -1;
+	REQUIRE(driver::runJIT(testProgram, exitCode));
+	CHECK(56 == exitCode);
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_JITTieredRecompile") {
+	const auto testProgram =
+		"i64 isOdd(i64 n) {"
+		"  return n % 2;"
+		"}"
+		"i64 main() {"
+		"  i64 i = 0;"
+		"  i64 odd = 0;"
+		"  while (i < 200000) {"
+		"    odd = odd + isOdd(i);"
+		"    i = i + 1;"
+		"  }"
+		"  return odd % 256;"
+		"}";
+
+	// A low threshold makes sure isOdd is swapped to its optimized version mid-run, waiting for the
+	// recompile keeps that from depending on how fast the loop finishes
+	jit::jit_options options;
+	options.tiered = true;
+	options.hotCallThreshold = 10;
+	options.waitForRecompile = true;
+
+	unsigned tierUps = 0;
+	options.tierUps = &tierUps;
+
+	int exitCode = -1;
+	REQUIRE(driver::runJIT(testProgram, exitCode, options));
+	CHECK(160 == exitCode);
+	CHECK(tierUps >= 1);
 }
 
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_JITLazyCompile") {
+	const string functions =
+		"i64 sum(i64 n) {"
+		"  i64 total = 0;"
+		"  while (n > 0) {"
+		"    total = total + n;"
+		"    n = n - 1;"
+		"  }"
+		"  return total;"
+		"}"
+		"i64 fact(i64 n) {"
+		"  if (n > 1) { return n * fact(n - 1); }"
+		"  return 1;"
+		"}";
+	const string mainFunction =
+		"i64 main(i32 argc) {"
+		"  if (argc > 5) { return neverCalled(); }"
+		"  return argc + sum(10) + fact(4);"
+		"}";
+	const string neverCalled =
+		"i32 neverCalled() {"
+		"  return missing + 1;"
+		"}"
+		"i32 neverParsed() { return 1 }";
+
+	jit::jit_options options;
+	options.lazy = true;
+
+	// Functions that aren't called are never parsed or generated, so their errors don't surface
+	int exitCode = -1;
+	REQUIRE(driver::runJIT(functions + neverCalled + mainFunction, exitCode, options));
+	CHECK(80 == exitCode);
+
+	// The same as compiling everything up front
+	int eagerExitCode = -1;
+	REQUIRE(driver::runJIT(functions + "i32 neverCalled() { return 0; }" + mainFunction, eagerExitCode));
+	CHECK(eagerExitCode == exitCode);
+
+	// A function the program calls that doesn't compile fails the run
+	const string brokenProgram =
+		"i32 broken() { return 1 }"
+		"i32 main() {"
+		"  return broken();"
+		"}";
+	CHECK_FALSE(driver::runJIT(brokenProgram, exitCode, options));
+
+	// Each run only sees its own failures, even when another one fails at the same time
+	for (int i = 0; i < 4; ++i) {
+		bool brokenRan = true;
+		thread brokenRun([&]() {
+			int brokenExitCode = 0;
+			brokenRan = driver::runJIT(brokenProgram, brokenExitCode, options);
+		});
+
+		int goodExitCode = -1;
+		CHECK(driver::runJIT(functions + neverCalled + mainFunction, goodExitCode, options));
+		brokenRun.join();
+
+		CHECK_FALSE(brokenRan);
+		CHECK(80 == goodExitCode);
+	}
+
+	// Calls to functions defined further down work the same as eagerly
+	const string forwardCallProgram =
+		"i32 main() { return later(2); }"
+		"i32 later(i32 a) { return a + 1; }";
+
+	REQUIRE(driver::runJIT(forwardCallProgram, exitCode, options));
+	CHECK(3 == exitCode);
+	REQUIRE(driver::runJIT(forwardCallProgram, eagerExitCode));
+	CHECK(3 == eagerExitCode);
+
+	// Defining a function twice is an error whether it's compiled lazily or not
+	const string duplicateProgram =
+		"i32 twice() { return 1; }"
+		"i32 twice() { return 2; }"
+		"i32 main() { return twice(); }";
+	CHECK_FALSE(driver::runJIT(duplicateProgram, exitCode));
+	CHECK_FALSE(driver::runJIT(duplicateProgram, exitCode, options));
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_CompileCache") {
+	const string cacheDir = "testCache";
+	boost::filesystem::remove_all(cacheDir);
+
+	BOOST_SCOPE_EXIT(&cacheDir) {
+		boost::filesystem::remove_all(cacheDir);
+	} BOOST_SCOPE_EXIT_END
+
+	const auto countCachedObjects = [&cacheDir]() {
+		return distance(boost::filesystem::directory_iterator(cacheDir), boost::filesystem::directory_iterator());
+	};
+
+	const auto testProgram =
+		"i32 main() {"
+		"  return 7;"
+		"}";
+
+	driver::compile_options options;
+	options.cacheDir = cacheDir;
+
+	REQUIRE(driver::compileExecutable(testProgram, g_outputExe, options));
+	CHECK(7 == runExecutable(g_outputExe));
+	CHECK(1 == countCachedObjects());
+
+	// The second build is served from the cache
+	boost::filesystem::remove(g_outputExe);
+	REQUIRE(driver::compileExecutable(testProgram, g_outputExe, options));
+	CHECK(7 == runExecutable(g_outputExe));
+	CHECK(1 == countCachedObjects());
+
+	// Any change to the source gets its own entry
+	const auto changedProgram =
+		"i32 main() {"
+		"  return 8;"
+		"}";
+
+	REQUIRE(driver::compileExecutable(changedProgram, g_outputExe, options));
+	CHECK(8 == runExecutable(g_outputExe));
+	CHECK(2 == countCachedObjects());
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_FunctionCache") {
+	const string cacheDir = "testFunctionCache";
+	boost::filesystem::remove_all(cacheDir);
+
+	BOOST_SCOPE_EXIT(&cacheDir) {
+		boost::filesystem::remove_all(cacheDir);
+	} BOOST_SCOPE_EXIT_END
+
+	const auto countCachedObjects = [&cacheDir]() {
+		return distance(boost::filesystem::directory_iterator(cacheDir), boost::filesystem::directory_iterator());
+	};
+
+	const auto testProgram =
+		"i32 twice(i32 n) {"
+		"  return n * 2;"
+		"}"
+		"i32 main() {"
+		"  return twice(5);"
+		"}";
+
+	driver::compile_options options;
+	options.cacheDir = cacheDir;
+	options.functionCache = true;
+
+	REQUIRE(driver::compileExecutable(testProgram, g_outputExe, options));
+	CHECK(10 == runExecutable(g_outputExe));
+	CHECK(2 == countCachedObjects());
+
+	// Only the edited function needs a new object, main is reused as-is
+	const auto editedProgram =
+		"i32 twice(i32 n) {"
+		"  return n + n + 1;"
+		"}"
+		"i32 main() {"
+		"  return twice(5);"
+		"}";
+
+	REQUIRE(driver::compileExecutable(editedProgram, g_outputExe, options));
+	CHECK(11 == runExecutable(g_outputExe));
+	CHECK(3 == countCachedObjects());
+
+	// Changing a callee's signature invalidates its callers too
+	const auto newSignatureProgram =
+		"i32 twice(i64 n) {"
+		"  return n + n + 1;"
+		"}"
+		"i32 main() {"
+		"  return twice(5);"
+		"}";
+
+	REQUIRE(driver::compileExecutable(newSignatureProgram, g_outputExe, options));
+	CHECK(11 == runExecutable(g_outputExe));
+	CHECK(5 == countCachedObjects());
+
+	// A function defined twice fails the build as it does without the cache
+	const auto duplicateProgram =
+		"i32 f() { return 1; }"
+		"i32 f() { return 2; }"
+		"i32 main() { return f(); }";
+
+	CHECK_FALSE(driver::compileExecutable(duplicateProgram, g_outputExe, options));
+	CHECK_FALSE(driver::compileExecutable(duplicateProgram, g_outputExe));
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_ParallelCodegen") {
+	const auto testProgram =
+		"i32 add(i32 a, i32 b) {"
+		"  return a + b;"
+		"}"
+		"i32 twice(i32 n) {"
+		"  return add(n, n);"
+		"}"
+		"i32 square(i32 n) {"
+		"  return n * n;"
+		"}"
+		"i32 main() {"
+		"  i32 r = twice(3);"
+		"  return r + square(4);"
+		"}";
+
+	driver::compile_options options;
+	options.jobs = 3;
+
+	REQUIRE(driver::compileExecutable(testProgram, g_outputExe, options));
+	CHECK(22 == runExecutable(g_outputExe));
+
+	// More jobs than functions leaves the extra threads idle
+	options.jobs = 16;
+
+	REQUIRE(driver::compileExecutable(testProgram, g_outputExe, options));
+	CHECK(22 == runExecutable(g_outputExe));
+
+	// Calls to functions defined further down compile the same way whatever the mode
+	const auto forwardCallProgram =
+		"i32 main() { return later(2); }"
+		"i32 later(i32 a) { return a + 1; }";
+
+	for (const unsigned jobs : { 1, 2 }) {
+		for (const int mode : { 0, 1, 2 }) {
+			options.jobs = jobs;
+			options.pipeline = (mode == 1);
+			options.lazyParse = (mode == 2);
+
+			REQUIRE(driver::compileExecutable(forwardCallProgram, g_outputExe, options));
+			CHECK(3 == runExecutable(g_outputExe));
+		}
+	}
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_BatchCompile") {
+	const vector<string> exeNames = { "testBatchA", "testBatchB", "testBatchC" };
+
+	BOOST_SCOPE_EXIT(&exeNames) {
+		for (const auto& exeName : exeNames) {
+			boost::filesystem::remove(exeName);
+		}
+	} BOOST_SCOPE_EXIT_END
+
+	// The inputs only view their sources
+	vector<string> sources;
+	for (size_t i = 0; i < exeNames.size(); ++i) {
+		sources.push_back("i32 main() { return " + to_string(i + 1) + "; }");
+	}
+
+	vector<driver::batch_input> inputs;
+	for (size_t i = 0; i < exeNames.size(); ++i) {
+		inputs.push_back(driver::batch_input{ sources[i], exeNames[i] });
+	}
+
+	driver::compile_options options;
+	options.jobs = 4;
+
+	REQUIRE(driver::compileExecutables(inputs, options));
+	for (size_t i = 0; i < exeNames.size(); ++i) {
+		CHECK(static_cast<int>(i + 1) == runExecutable(exeNames[i]));
+	}
+
+	// A failing input fails the batch without stopping the others
+	inputs[1].input = "i32 main() { return";
+	boost::filesystem::remove(exeNames[2]);
+
+	bool linkFailed = false;
+	CHECK_FALSE(driver::compileExecutables(inputs, options, &linkFailed));
+	CHECK_FALSE(linkFailed);
+	CHECK(boost::filesystem::exists(exeNames[2]));
+
+	// Failing to link is told apart from failing to compile
+	inputs[1].input = sources[1];
+	inputs[1].exeName = "missingDir/testBatchB";
+
+	CHECK_FALSE(driver::compileExecutables(inputs, options, &linkFailed));
+	CHECK(linkFailed);
+
+	// Inputs producing the same executable are refused before any is compiled
+	inputs[1].exeName = exeNames[0];
+	boost::filesystem::remove(exeNames[0]);
+	boost::filesystem::remove(exeNames[2]);
+
+	linkFailed = false;
+	CHECK_FALSE(driver::compileExecutables(inputs, options, &linkFailed));
+	CHECK_FALSE(linkFailed);
+	CHECK_FALSE(boost::filesystem::exists(exeNames[0]));
+	CHECK_FALSE(boost::filesystem::exists(exeNames[2]));
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_PhaseProfiler") {
+	const string traceFile = "testTrace.json";
+
+	BOOST_SCOPE_EXIT(&traceFile) {
+		profiler::disable();
+		boost::filesystem::remove(traceFile);
+	} BOOST_SCOPE_EXIT_END
+
+	const auto testProgram =
+		"i32 square(i32 n) {"
+		"  return n * n;"
+		"}"
+		"i32 main() {"
+		"  return square(3);"
+		"}";
+
+	profiler::enable();
+	REQUIRE(driver::compileExecutable(testProgram, g_outputExe));
+	CHECK(9 == runExecutable(g_outputExe));
+
+	stringstream report;
+	const auto flags = report.flags();
+	const auto precision = report.precision();
+	profiler::printReport(report);
+	for (const auto& phase : { "parse", "codegen", "function", "verify", "optimize", "emit", "link" }) {
+		CHECK(report.str().find(phase) != string::npos);
+	}
+
+	// The report leaves the stream formatted as it was
+	CHECK(flags == report.flags());
+	CHECK(precision == report.precision());
+
+	REQUIRE(profiler::writeTrace(traceFile));
+
+	ifstream in(traceFile.c_str());
+	const string trace(static_cast<stringstream const&>(stringstream() << in.rdbuf()).str());
+	CHECK(trace.find("{\"traceEvents\":[") == 0);
+	CHECK(trace.find("{\"name\":\"square\",\"cat\":\"function\",\"ph\":\"X\"") != string::npos);
+	CHECK(trace.find("{\"name\":\"main\",\"cat\":\"function\",\"ph\":\"X\"") != string::npos);
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_OptimizationLevels") {
+	const auto testProgram =
+		"i32 sum(i32 n) {"
+		"  i32 total = 0;"
+		"  i32 i = 0;"
+		"  while (i < n) {"
+		"    i = i + 1;"
+		"    total = total + i;"
+		"  }"
+		"  return total;"
+		"}"
+		"i32 main() {"
+		"  return sum(10);"
+		"}";
+
+	for (unsigned optLevel = 0; optLevel <= 3; ++optLevel) {
+		driver::compile_options options;
+		options.optLevel = optLevel;
+
+		REQUIRE(driver::compileExecutable(testProgram, g_outputExe, options));
+		CHECK(55 == runExecutable(g_outputExe));
+	}
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_SourceFile") {
+	const string sourceName = "sourceFile.mrk";
+	BOOST_SCOPE_EXIT(&sourceName) {
+		boost::filesystem::remove(sourceName);
+	} BOOST_SCOPE_EXIT_END
+
+	CHECK(driver::source_file::open("missing.mrk") == nullptr);
+
+	// Large enough to be mapped rather than read, with a comment padding it out
+	const string testProgram = "// " + string(64 * 1024, 'x') + "\ni32 main() { return 7; }";
+	{
+		ofstream out(sourceName.c_str());
+		out << testProgram;
+	}
+
+	const unique_ptr<driver::source_file> sourceFile = driver::source_file::open(sourceName);
+	REQUIRE(sourceFile != nullptr);
+	CHECK(testProgram == sourceFile->text());
+
+	int exitCode = 0;
+	REQUIRE(driver::runJIT(sourceFile->text(), exitCode));
+	CHECK(7 == exitCode);
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_PipelinedCodegen") {
+	const string testProgram =
+		"type pair { i32 a; i32 b; }"
+		"i32 add(i32 a, i32 b) {"
+		"  return a + b;"
+		"}"
+		"i32 twice(i32 n) {"
+		"  return add(n, n);"
+		"}"
+		"i32 main() {"
+		"  i32 r = twice(3);"
+		"  return r + add(r, 4);"
+		"}";
+
+	// Both ways of generating produce the same module
+	const auto printModule = [](const string& source, bool pipeline) {
+		llvm::LLVMContext context;
+		unique_ptr<llvm::Module> module = driver::generateModule(source, context, pipeline);
+		REQUIRE(module);
+
+		string ir;
+		llvm::raw_string_ostream out(ir);
+		module->print(out, nullptr);
+
+		return out.str();
+	};
+
+	CHECK(printModule(testProgram, false) == printModule(testProgram, true));
+
+	driver::compile_options options;
+	options.pipeline = true;
+
+	REQUIRE(driver::compileExecutable(testProgram, g_outputExe, options));
+	CHECK(16 == runExecutable(g_outputExe));
+
+	// A syntax error after some functions were generated still fails the compile
+	CHECK_FALSE(driver::compileExecutable(testProgram + " i32 broken() { return", g_outputExe, options));
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_LazyParse") {
+	const string testProgram =
+		"i32 add(i32 a, i32 b) {"
+		"  return a + b;"
+		"}"
+		"i32 main() {"
+		"  i32 r = add(3, 3);"
+		"  if (r > 5) { r = add(r, 10); }"
+		"  return r;"
+		"}";
+
+	const auto printModule = [](const string& source, bool lazyParse) {
+		llvm::LLVMContext context;
+		unique_ptr<llvm::Module> module = driver::generateModule(source, context, false, lazyParse);
+		REQUIRE(module);
+
+		string ir;
+		llvm::raw_string_ostream out(ir);
+		module->print(out, nullptr);
+
+		return out.str();
+	};
+
+	CHECK(printModule(testProgram, false) == printModule(testProgram, true));
+
+	driver::compile_options options;
+	options.lazyParse = true;
+
+	REQUIRE(driver::compileExecutable(testProgram, g_outputExe, options));
+	CHECK(16 == runExecutable(g_outputExe));
+
+	// Only the bodies main reaches are parsed, a syntax error in one of them still fails the compile
+	CHECK(driver::compileExecutable(testProgram + " i32 unused() { return 1 }", g_outputExe, options));
+
+	const string brokenProgram =
+		"i32 broken() { return 1 }"
+		"i32 main() {"
+		"  return broken();"
+		"}";
+	CHECK_FALSE(driver::compileExecutable(brokenProgram, g_outputExe, options));
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_UnreachableFunctions") {
+	const string testProgram =
+		"i32 unused(i32 a) {"
+		"  return a + missing;"
+		"}"
+		"i32 leaf(i32 a) {"
+		"  return a * 2;"
+		"}"
+		"i32 recurse(i32 n) {"
+		"  if (n > 0) { return recurse(n - 1); }"
+		"  return leaf(n + 5);"
+		"}"
+		"i32 main() {"
+		"  printf(\"%d\", 1);"
+		"  return recurse(3);"
+		"}";
+
+	for (const bool lazyParse : { false, true }) {
+		llvm::LLVMContext context;
+		unique_ptr<llvm::Module> module = driver::generateModule(testProgram, context, false, lazyParse);
+		REQUIRE(module);
+
+		// Nothing reaches 'unused' so its bad symbol isn't even reported
+		CHECK(module->getFunction("unused") == nullptr);
+		CHECK(module->getFunction("leaf"));
+		CHECK(module->getFunction("recurse"));
+	}
+
+	// Without a main every function is kept
+	{
+		llvm::LLVMContext context;
+		CHECK(driver::generateModule("i32 f() { return 1; } i32 g() { return f(); }", context)->getFunction("f"));
+	}
+
+	// Everything but main is internal in an executable's module
+	REQUIRE(driver::generateOutput(testProgram, g_outputBitCode));
+	{
+		llvm::LLVMContext context;
+		llvm::SMDiagnostic diag;
+		unique_ptr<llvm::Module> module = llvm::parseIRFile(g_outputBitCode, diag, context);
+		REQUIRE(module);
+
+		CHECK(module->getFunction("main")->hasExternalLinkage());
+		CHECK(module->getFunction("recurse")->hasInternalLinkage());
+		CHECK(module->getFunction("leaf")->hasInternalLinkage());
+	}
+
+	REQUIRE(driver::optimizeAndLink(g_outputBitCode, g_outputExe));
+	CHECK(10 == runExecutable(g_outputExe));
+
+	driver::compile_options options;
+	options.jobs = 2;
+
+	REQUIRE(driver::compileExecutable(testProgram, g_outputExe, options));
+	CHECK(10 == runExecutable(g_outputExe));
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_InterpreterMatchesJIT") {
+	// Each program is run by both
+	const vector<string> testPrograms = {
+		// Callees may be defined after their callers, even mutually recursive ones
+		"i32 main() { i32 a = later(2); return a + (isEven(10)); }"
+		"i32 later(i32 a) { return a + 1; }"
+		"i32 isEven(i32 n) { if (n == 0) { return 1; } return isOdd(n - 1); }"
+		"i32 isOdd(i32 n) { if (n == 0) { return 0; } return isEven(n - 1); }",
+
+		// Wrapping and truncation at each width
+		"i64 big(i64 n) { return n * 65536 * 65536; }"
+		"i32 main() { i64 a = big(3) + 7; i32 b = a; return b + 100; }",
+
+		// Literals are i32, widening them zero extends
+		"i64 main() { i64 a = 0 - 1; i64 b = 4294967295; if (a == b) { return 3; } return 4; }",
+
+		// Signed division and remainder round towards zero
+		"i32 main() { i32 a = 0 - 7; i32 b = a / 2; i32 c = a % 3; return (b * 10) + c; }",
+
+		"i32 main() { i32 a = 1 << 4; i32 b = 255 >> 3; return (a & 31) + b; }",
+
+		"i32 main() { if ((0 - 1) < 1) { return 5; } return 6; }",
+
+		"i32 fib(i32 n) { if (n < 2) { return n; } return (fib(n - 1)) + (fib(n - 2)); }"
+		"i32 main() { i32 n = fib(15); return n % 256; }",
+
+		// Locals of the loop body shadow and go out of scope every iteration
+		"i32 main() {"
+		"  i32 total = 0;"
+		"  i32 i = 0;"
+		"  while (i < 1000) {"
+		"    i32 total = i % 3;"
+		"    if ((total == 0) || ((i % 5) == 0)) {"
+		"      i32 step = i;"
+		"      i = i + 1;"
+		"      total = step;"
+		"    } else {"
+		"      i = i + 1;"
+		"    }"
+		"  }"
+		"  return total + i;"
+		"}",
+	};
+
+	for (const auto& testProgram : testPrograms) {
+		int jitExitCode = -1;
+		REQUIRE(driver::runJIT(testProgram, jitExitCode));
+
+		int exitCode = -2;
+		ostringstream out;
+		CHECK(driver::runInterpreter(testProgram, exitCode, out));
+		CHECK(jitExitCode == exitCode);
+	}
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_InterpreterErrors") {
+	int exitCode = 0;
+	ostringstream out;
+
+	CHECK_FALSE(driver::runInterpreter("i32 main() { i32 a = 0; return 5 / a; }", exitCode, out));
+	CHECK_FALSE(driver::runInterpreter("i32 main() { return missing(1); }", exitCode, out));
+	CHECK_FALSE(driver::runInterpreter("i32 main() { printf(\"%d\", \"text\"); return 0; }", exitCode, out));
+	CHECK_FALSE(driver::runInterpreter("i32 main() { return \"text\" + 1; }", exitCode, out));
+	CHECK_FALSE(driver::runInterpreter("i32 f() { return 1; }", exitCode, out));
+
+	// Unreachable functions aren't compiled, as with codegen
+	CHECK(driver::runInterpreter("i32 unused() { return missing(); } i32 main() { return 2; }", exitCode, out));
+	CHECK(2 == exitCode);
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_InterpreterBytecode") {
+	const auto testProgram =
+		"i32 main() {"
+		"  i32 a = 0;"
+		"  while (a < 10) {"
+		"    a = a + 1;"
+		"  }"
+		"  return a;"
+		"}";
+
+	parser::base_expr_node root;
+	REQUIRE(parse(testProgram, root));
+
+	bytecode::module program;
+	REQUIRE(bytecode::compile(root, program));
+
+	// Locals are updated in place and the loop condition is checked at the bottom
+	CHECK(bytecode::disassemble(program) ==
+		"main: 0 arguments, 3 registers\n"
+		"  0: loadConstant r0, 0\n"
+		"  1: jump @4\n"
+		"  2: loadConstant r1, 1\n"
+		"  3: add32 r0, r0, r1\n"
+		"  4: loadConstant r1, 10\n"
+		"  5: lessThan32 r2, r0, r1\n"
+		"  6: jumpIfNotZero r2, @2\n"
+		"  7: ret r0\n");
+}
+
+TEST_CASE_METHOD(DriverTestFixture, "DriverTestFixture_PrecompiledModules") {
+	const vector<string> moduleNames = { "testMath.mrkm", "testUtil.mrkm", "testCopy.mrkm" };
+
+	BOOST_SCOPE_EXIT(&moduleNames) {
+		for (const auto& moduleName : moduleNames) {
+			boost::filesystem::remove(moduleName);
+		}
+	} BOOST_SCOPE_EXIT_END
+
+	const auto readFile = [](const string& filename) {
+		ifstream file(filename, ios::binary);
+		return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+	};
+
+	const auto mathProgram =
+		"i32 square(i32 n) {"
+		"  return n * n;"
+		"}"
+		"i32 greet() {"
+		"  printf(\"lib %d\", 7);"
+		"  return 1;"
+		"}";
+
+	// Modules may import from the ones precompiled before them
+	REQUIRE(driver::precompileModule(mathProgram, moduleNames[0]));
+	REQUIRE(driver::precompileModule("i32 sumSquares(i32 a, i32 b) { i32 x = square(a); i32 y = square(b); return x + y; }", moduleNames[1], { moduleNames[0] }));
+
+	{
+		unique_ptr<bytecode::precompiled_module> math = bytecode::precompiled_module::open(moduleNames[0]);
+		REQUIRE(math);
+		CHECK(2 == math->functionCount());
+		CHECK(0 == math->importCount());
+		REQUIRE(math->findFunction("square"));
+		CHECK(1 == math->findFunction("square")->argCount);
+		CHECK(math->findFunction("greet"));
+		CHECK(math->findFunction("missing") == nullptr);
+	}
+
+	const auto testProgram =
+		"i32 main() {"
+		"  i32 a = sumSquares(3, 4);"
+		"  i32 b = greet();"
+		"  return a + b;"
+		"}";
+
+	int exitCode = 0;
+	ostringstream out;
+	REQUIRE(driver::runInterpreter(testProgram, exitCode, out, { moduleNames[1], moduleNames[0] }));
+	CHECK(26 == exitCode);
+	CHECK("lib 7" == out.str());
+
+	// The same source always gives the same bytes
+	REQUIRE(driver::precompileModule(mathProgram, moduleNames[2]));
+	const string mathBytes = readFile(moduleNames[0]);
+	CHECK(mathBytes == readFile(moduleNames[2]));
+
+	// Files that aren't complete modules are rejected before anything reads them
+	ofstream(moduleNames[2], ios::binary | ios::trunc) << mathBytes.substr(0, mathBytes.size() / 2);
+	CHECK(bytecode::precompiled_module::open(moduleNames[2]) == nullptr);
+
+	// Nor are ones whose instructions would leave the image or the registers once they run
+	const auto corrupted = [&](const function<void(bytecode::precompiled_header&, bytecode::instruction*)>& corrupt) {
+		string bytes = mathBytes;
+		bytecode::precompiled_header& header = *reinterpret_cast<bytecode::precompiled_header*>(&bytes[0]);
+		corrupt(header, reinterpret_cast<bytecode::instruction*>(&bytes[header.instructionsOffset]));
+
+		ofstream(moduleNames[2], ios::binary | ios::trunc) << bytes;
+		return bytecode::precompiled_module::open(moduleNames[2]);
+	};
+
+	CHECK(corrupted([](bytecode::precompiled_header&, bytecode::instruction*) {}));
+	CHECK_FALSE(corrupted([](bytecode::precompiled_header& header, bytecode::instruction*) { header.version ^= 1; }));
+	CHECK_FALSE(corrupted([](bytecode::precompiled_header&, bytecode::instruction* code) { code[0].op = bytecode::opcode::count; }));
+	CHECK_FALSE(corrupted([](bytecode::precompiled_header&, bytecode::instruction* code) { code[0].a = 1000; }));
+	CHECK_FALSE(corrupted([](bytecode::precompiled_header& header, bytecode::instruction* code) { code[header.instructionCount - 1].op = bytecode::opcode::move; }));
+
+	ofstream(moduleNames[2], ios::binary | ios::trunc) << "i32 main() { return 0; }";
+	CHECK(bytecode::precompiled_module::open(moduleNames[2]) == nullptr);
+	CHECK_FALSE(driver::runInterpreter(testProgram, exitCode, out, { moduleNames[2] }));
+
+	// sumSquares imports square, which nothing defines without the math module
+	CHECK_FALSE(driver::runInterpreter("i32 main() { return sumSquares(1, 2); }", exitCode, out, { moduleNames[1] }));
+
+	// Changing a signature means the modules importing it have to be precompiled again
+	REQUIRE(driver::precompileModule("i64 square(i64 n) { return n * n; } i32 greet() { return 1; }", moduleNames[0]));
+	CHECK_FALSE(driver::runInterpreter(testProgram, exitCode, out, { moduleNames[1], moduleNames[0] }));
+
+	REQUIRE(driver::precompileModule("i32 sumSquares(i32 a, i32 b) { i64 x = square(a); i64 y = square(b); i32 sum = x + y; return sum; }", moduleNames[1], { moduleNames[0] }));
+	CHECK(driver::runInterpreter(testProgram, exitCode, out, { moduleNames[1], moduleNames[0] }));
+	CHECK(26 == exitCode);
+}
@@ -0,0 +1,290 @@
+#include "catch.hpp"
+
+#include <astdump.h>
+#include <parser.h>
+#include <codegen.h>
+#include <flatast.h>
+#include <location.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/variant/get.hpp>
+
+#include <llvm/IR/IRBuilder.h>
+#include "llvm/IR/LLVMContext.h"
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace marklar;
+using namespace parser;
+
+using namespace llvm;
+using namespace std;
+
+
+namespace {
+
+	// Generates the module from either AST and prints its IR
+	string printModule(const base_expr_node& root, const flat::ast* flatAst) {
+		LLVMContext context;
+		unique_ptr<Module> module(new Module("", context));
+		IRBuilder<> builder(context);
+
+		ast_codegen codeGenerator(&context, module.get(), builder, true);
+
+		if (flatAst) {
+			for (const auto& itr : flat::base_expr(flatAst->root()).children) {
+				flat::apply_visitor(codeGenerator, itr);
+			}
+		} else {
+			for (const auto& itr : boost::get<base_expr>(root).children) {
+				boost::apply_visitor(codeGenerator, itr);
+			}
+		}
+
+		string ir;
+		raw_string_ostream out(ir);
+		module->print(out, nullptr);
+
+		return out.str();
+	}
+
+}
+
+TEST_CASE("FlatAstStructure") {
+	const auto testProgram =
+		"i32 add(i32 a, i32 b) {"
+		"  return a + b;"
+		"}"
+		"i32 main() {"
+		"  i32 x = add(1, 2);"
+		"  if (x > 1) {"
+		"    x = 3;"
+		"  } else {"
+		"    x = 4;"
+		"  }"
+		"  return x;"
+		"}";
+
+	base_expr_node root;
+	REQUIRE(parse(testProgram, root));
+
+	flat::ast flatAst;
+	flatten(root, flatAst);
+
+	REQUIRE(flatAst.root().kind() == flat::node_kind::base_expr);
+
+	const flat::base_expr top(flatAst.root());
+	REQUIRE(top.children.size() == 2);
+	REQUIRE(top.children[0].kind() == flat::node_kind::func_expr);
+
+	const flat::func_expr add(top.children[0]);
+	CHECK(add.functionName == "add");
+	CHECK(add.returnType == "i32");
+	REQUIRE(add.args.size() == 2);
+	CHECK(flat::def_expr(add.args[1]).defName == "b");
+	REQUIRE(add.expressions.size() == 1);
+
+	const flat::return_expr ret(add.expressions[0]);
+	REQUIRE(ret.ret.kind() == flat::node_kind::binary_op);
+
+	const flat::binary_op sum(ret.ret);
+	REQUIRE(sum.operation.size() == 1);
+	CHECK(sum.operation[0].op == "+");
+	REQUIRE(sum.operation[0].rhs.kind() == flat::node_kind::value);
+	CHECK(sum.operation[0].rhs.get().name == "b");
+
+	const flat::func_expr mainFunc(top.children[1]);
+	REQUIRE(mainFunc.expressions.size() == 3);
+	REQUIRE(mainFunc.expressions[1].kind() == flat::node_kind::if_expr);
+
+	const flat::if_expr cond(mainFunc.expressions[1]);
+	CHECK(cond.condition.kind() == flat::node_kind::binary_op);
+	CHECK(cond.thenBranch.size() == 1);
+	CHECK(cond.elseBranch.size() == 1);
+	CHECK(flat::var_assign(cond.elseBranch[0]).varName == "x");
+}
+
+TEST_CASE("FlatAstCodegenMatchesTree") {
+	const char* programs[] = {
+		"i32 main() {"
+		"  i64 sum = 0;"
+		"  i32 i = 0;"
+		"  while (i < 10) {"
+		"    if (i % 2 == 0) {"
+		"      sum = sum + i;"
+		"    }"
+		"    i = i + 1;"
+		"  }"
+		"  return sum;"
+		"}",
+
+		"i32 square(i32 v) {"
+		"  return v * v;"
+		"}"
+		"i32 main() {"
+		"  i32 a;"
+		"  a = square(3);"
+		"  printf(\"%d\\n\", a);"
+		"  if (a > 5) {"
+		"    return 1;"
+		"  }"
+		"  return 0;"
+		"}",
+	};
+
+	for (const auto program : programs) {
+		base_expr_node root;
+		REQUIRE(parse(program, root));
+
+		flat::ast flatAst;
+		flatten(root, flatAst);
+
+		INFO(program);
+		CHECK(printModule(root, &flatAst) == printModule(root, nullptr));
+	}
+}
+
+TEST_CASE("FlatAstParseItems") {
+	const string program =
+		"type point { i32 x; i32 y; }"
+		"i32 square(i32 v) {"
+		"  return v * v;"
+		"}"
+		"// comment between items\n"
+		"i32 main() {"
+		"  return square(3);"
+		"}  ";
+
+	for (const auto backend : { parser_backend::spirit, parser_backend::descent }) {
+		base_expr_node root;
+		REQUIRE(parse(program, root, backend));
+
+		// Every item is the matching child of the whole parse
+		vector<string> dumps;
+		CHECK(parseItems(program, [&](flat::ast&& item) {
+			base_expr_node tree;
+			unflatten(item, tree);
+			dumps.push_back(dumpAst(tree));
+			return true;
+		}, backend));
+
+		const auto& children = boost::get<base_expr>(root).children;
+		REQUIRE(children.size() == dumps.size());
+		for (size_t i = 0; i < children.size(); ++i) {
+			CHECK(dumpAst(children[i]) == dumps[i]);
+		}
+
+		// Items before a syntax error are still handed over
+		size_t count = 0;
+		const auto countItems = [&](flat::ast&&) {
+			++count;
+			return true;
+		};
+
+		CHECK_FALSE(parseItems(program + " i32 f() {", countItems, backend));
+		CHECK(3u == count);
+
+		// Rejecting an item stops the parse
+		count = 0;
+		CHECK_FALSE(parseItems(program, [&](flat::ast&&) {
+			return ++count < 2;
+		}, backend));
+		CHECK(2u == count);
+	}
+}
+
+TEST_CASE("FlatAstLocations") {
+	const string program =
+		"// header\n"
+		"i32 main(i32 n) {\n"
+		"  i32 a = n +  2;\n"
+		"\treturn f(a);\n"
+		"}\n";
+
+	const auto text = [&](source_span location) {
+		return program.substr(location.offset, location.length);
+	};
+
+	// Both parsers locate the nodes the same way, without the whitespace around them
+	for (const auto backend : { parser_backend::spirit, parser_backend::descent }) {
+		flat::ast flatAst;
+		REQUIRE(parse(program, flatAst, backend));
+
+		const flat::func_expr func(flat::base_expr(flatAst.root()).children[0]);
+		CHECK(text(func.location) == "i32 main(i32 n) {\n  i32 a = n +  2;\n\treturn f(a);\n}");
+		CHECK(text(flat::def_expr(func.args[0]).location) == "i32 n");
+
+		const flat::decl_expr decl(func.expressions[0]);
+		CHECK(text(decl.location) == "i32 a = n +  2;");
+		CHECK(text(flat::binary_op(decl.val).location) == "n +  2");
+
+		const flat::return_expr ret(func.expressions[1]);
+		CHECK(text(ret.location) == "return f(a);");
+		CHECK(text(flat::call_expr(ret.ret).location) == "f(a)");
+		CHECK("4:2" == describeLocation(program, ret.location));
+	}
+
+	CHECK("1:1" == describeLocation(program, source_span{ 0, 1 }));
+	CHECK("3:11" == describeLocation(program, source_span{ 38, 1 }));
+}
+
+TEST_CASE("FlatAstLazyBodies") {
+	const string program =
+		"type point { i32 x; i32 y; }"
+		"i32 pick(i32 a, i32 b) {"
+		"  if (a > b) { return a; } else { return b; }"
+		"  return 0;"
+		"}"
+		"i32 empty() {}"
+		"i32 main() {\n"
+		"  // a } in a comment and \"}\" in a string don't end the body\n"
+		"  printf(\"}\");\n"
+		"  return pick(3, 4);\n"
+		"}";
+
+	flat::ast eager;
+	REQUIRE(parse(program, eager, parser_backend::descent));
+
+	flat::ast lazy;
+	REQUIRE(parseLazily(program, lazy));
+
+	const auto eagerItems = flat::base_expr(eager.root()).children;
+	const auto lazyItems = flat::base_expr(lazy.root()).children;
+	REQUIRE(eagerItems.size() == lazyItems.size());
+
+	// Only the signatures exist until a body is materialized
+	const flat::func_expr skipped(lazyItems[1]);
+	CHECK(skipped.functionName == "pick");
+	CHECK(skipped.args.size() == 2);
+	CHECK(skipped.expressions.empty());
+	CHECK_FALSE(lazy.isMaterialized(lazyItems[1].id));
+
+	for (size_t i = 0; i < lazyItems.size(); ++i) {
+		REQUIRE(lazy.materialize(lazyItems[i].id));
+		CHECK(lazy.isMaterialized(lazyItems[i].id));
+
+		base_expr_node eagerTree, lazyTree;
+		unflatten(eager, eagerTree);
+		unflatten(lazy, lazyTree);
+		CHECK(dumpAst(boost::get<base_expr>(eagerTree).children[i]) == dumpAst(boost::get<base_expr>(lazyTree).children[i]));
+	}
+
+	// Statements of a materialized body are still located in the whole source
+	const flat::func_expr eagerMain(eagerItems[3]);
+	const flat::func_expr lazyMain(lazyItems[3]);
+	REQUIRE(lazyMain.expressions.size() == eagerMain.expressions.size());
+	CHECK(lazyMain.location.offset == eagerMain.location.offset);
+	CHECK(lazyMain.location.length == eagerMain.location.length);
+	CHECK(flat::return_expr(lazyMain.expressions[1]).location.offset == flat::return_expr(eagerMain.expressions[1]).location.offset);
+
+	// A syntax error inside a body is only found when it's materialized, unbalanced braces are found up front
+	flat::ast broken;
+	REQUIRE(parseLazily("i32 f() { return 1 } i32 main() { return 0; }", broken));
+	CHECK_FALSE(broken.materialize(flat::base_expr(broken.root()).children[0].id));
+	CHECK(broken.materialize(flat::base_expr(broken.root()).children[1].id));
+
+	CHECK_FALSE(parseLazily("i32 main() { if (1) { return 0; }", broken));
+}
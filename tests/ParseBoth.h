@@ -0,0 +1,30 @@
+#pragma once
+
+#include "catch.hpp"
+
+#include <astdump.h>
+#include <parser.h>
+
+#include <string>
+
+
+// Parses with every backend, they have to agree on whether the source parses and on the AST
+inline bool parseBoth(const std::string& str, parser::base_expr_node& root) {
+	parser::base_expr_node descentRoot;
+
+	const bool parsed = marklar::parse(str, root, marklar::parser_backend::spirit);
+	const bool descentParsed = marklar::parse(str, descentRoot, marklar::parser_backend::descent);
+
+	CHECK(parsed == descentParsed);
+	if (parsed && descentParsed) {
+		CHECK(marklar::dumpAst(root) == marklar::dumpAst(descentRoot));
+	}
+
+	return parsed;
+}
+
+inline bool parseBoth(const std::string& str) {
+	parser::base_expr_node root;
+
+	return parseBoth(str, root);
+}
@@ -1,5 +1,7 @@
 #include "catch.hpp"
 
+#include "ParseBoth.h"
+
 #include <parser.h>
 
 using namespace marklar;
@@ -10,7 +12,7 @@ TEST_CASE("ParserTest_BasicFunction") {
 		"i32 main() {"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_SkipperStart") {
@@ -21,7 +23,7 @@ TEST_CASE("ParserTest_SkipperStart") {
 		}
 	)mrk";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_BasicComment") {
@@ -30,7 +32,7 @@ TEST_CASE("ParserTest_BasicComment") {
 		"i32 main() {"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_ComplexComment") {
@@ -39,7 +41,7 @@ TEST_CASE("ParserTest_ComplexComment") {
 		"i32 main() {"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_InvalidComment") {
@@ -48,7 +50,7 @@ TEST_CASE("ParserTest_InvalidComment") {
 		"i32 main() {"
 		"}";
 
-	REQUIRE_FALSE(parse(testProgram));
+	REQUIRE_FALSE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionSingleDecl") {
@@ -57,7 +59,7 @@ TEST_CASE("ParserTest_FunctionSingleDecl") {
 		"  i32 i = 0;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionSingleDecl_NameCheck1") {
@@ -66,7 +68,7 @@ TEST_CASE("ParserTest_FunctionSingleDecl_NameCheck1") {
 		"  i32 i09za_ = 0;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionSingleDecl_NameCheck2") {
@@ -75,7 +77,7 @@ TEST_CASE("ParserTest_FunctionSingleDecl_NameCheck2") {
 		"  i32 i' = 0;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionMultiDecl") {
@@ -86,7 +88,7 @@ TEST_CASE("ParserTest_FunctionMultiDecl") {
 		"  i32 k = 0;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionDeclAssign") {
@@ -95,7 +97,7 @@ TEST_CASE("ParserTest_FunctionDeclAssign") {
 		"  i32 r = 1 + 2;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionMultiDeclAssign") {
@@ -106,7 +108,7 @@ TEST_CASE("ParserTest_FunctionMultiDeclAssign") {
 		"  i32 k = i + j;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionReturn") {
@@ -115,7 +117,7 @@ TEST_CASE("ParserTest_FunctionReturn") {
 		"  return 1;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionReturnComplex") {
@@ -124,7 +126,7 @@ TEST_CASE("ParserTest_FunctionReturnComplex") {
 		"  return a + b + c + 0 + 1 + d;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_MultipleFunction") {
@@ -132,7 +134,7 @@ TEST_CASE("ParserTest_MultipleFunction") {
 		"i32 foo() {}"
 		"i32 main() {}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_MultipleComplexFunction") {
@@ -149,7 +151,7 @@ TEST_CASE("ParserTest_MultipleComplexFunction") {
 		"  return 0 + 1;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionArgs") {
@@ -157,7 +159,7 @@ TEST_CASE("ParserTest_FunctionArgs") {
 		"i32 main(i32 a, i32 b) {"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionCall") {
@@ -167,7 +169,7 @@ TEST_CASE("ParserTest_FunctionCall") {
 		"  foo();"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionCallArgs") {
@@ -177,7 +179,7 @@ TEST_CASE("ParserTest_FunctionCallArgs") {
 		"  foo(45);"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionCallArgsComplex") {
@@ -190,7 +192,7 @@ TEST_CASE("ParserTest_FunctionCallArgsComplex") {
 		"  return foo(45);"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionIfStmt") {
@@ -200,7 +202,7 @@ TEST_CASE("ParserTest_FunctionIfStmt") {
 		"  }"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FunctionIfElseStmt") {
@@ -211,7 +213,7 @@ TEST_CASE("ParserTest_FunctionIfElseStmt") {
 		"  }"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_Assignment") {
@@ -222,7 +224,7 @@ TEST_CASE("ParserTest_Assignment") {
 		"  return a;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_WhileStmt") {
@@ -235,7 +237,7 @@ TEST_CASE("ParserTest_WhileStmt") {
 		"  }"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_LogicalOR") {
@@ -249,7 +251,7 @@ TEST_CASE("ParserTest_LogicalOR") {
 		"  return 1;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_Division") {
@@ -259,7 +261,7 @@ TEST_CASE("ParserTest_Division") {
 		"  return i;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_Subtraction") {
@@ -269,7 +271,7 @@ TEST_CASE("ParserTest_Subtraction") {
 		"  return i;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_RightShift") {
@@ -279,7 +281,7 @@ TEST_CASE("ParserTest_RightShift") {
 		"  return i;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_Multiplication") {
@@ -289,7 +291,7 @@ TEST_CASE("ParserTest_Multiplication") {
 		"  return i;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_ComplexEulerProblem1") {
@@ -306,7 +308,7 @@ TEST_CASE("ParserTest_ComplexEulerProblem1") {
 		"  return sum;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_FuncCallInIfStmt") {
@@ -321,7 +323,7 @@ TEST_CASE("ParserTest_FuncCallInIfStmt") {
 		"  return 0;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_LogicalAnd") {
@@ -333,7 +335,7 @@ TEST_CASE("ParserTest_LogicalAnd") {
 		"  return 0;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_String") {
@@ -343,7 +345,7 @@ TEST_CASE("ParserTest_String") {
 		"  return 0;"
 		"}";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_PrimitiveType_i64") {
@@ -353,7 +355,7 @@ TEST_CASE("ParserTest_PrimitiveType_i64") {
 		}
 	)mrk";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_UserDefinedType_Basic") {
@@ -368,7 +370,7 @@ TEST_CASE("ParserTest_UserDefinedType_Basic") {
 		}
 	)mrk";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
 
 TEST_CASE("ParserTest_UserDefinedType_UseBasic") {
@@ -385,5 +387,5 @@ TEST_CASE("ParserTest_UserDefinedType_UseBasic") {
 		}
 	)mrk";
 
-	REQUIRE(parse(testProgram));
+	REQUIRE(parseBoth(testProgram));
 }
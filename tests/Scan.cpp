@@ -0,0 +1,75 @@
+#include "catch.hpp"
+
+#include <scan.h>
+
+#include <string>
+
+using namespace marklar;
+using namespace std;
+
+
+namespace {
+
+	// Byte by byte versions of the scanners to check the block wise ones against
+	template <typename predicate_t>
+	size_t scalarRun(const string& str, size_t pos, predicate_t predicate) {
+		while (pos < str.size() && predicate(str[pos])) {
+			++pos;
+		}
+
+		return pos;
+	}
+
+	bool isSpace(char c) {
+		return c == ' ' || (c >= '\t' && c <= '\r');
+	}
+
+	bool isIdentifierChar(char c) {
+		return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '\'';
+	}
+
+	bool isDigit(char c) {
+		return c >= '0' && c <= '9';
+	}
+
+	bool isNotLineEnd(char c) {
+		return c != '\r' && c != '\n';
+	}
+
+	// Runs of every length up to a few blocks, ended by each of the given characters
+	template <typename scan_t, typename predicate_t>
+	void checkScanner(const string& runChars, const string& stopChars, scan_t scanner, predicate_t predicate) {
+		for (size_t length = 0; length < 100; ++length) {
+			for (const char stop : stopChars) {
+				string str;
+				for (size_t i = 0; i < length; ++i) {
+					str += runChars[i % runChars.size()];
+				}
+				str += stop;
+				str += runChars;
+
+				for (size_t begin = 0; begin <= str.size(); begin += 7) {
+					const char* p = scanner(str.data() + begin, str.data() + str.size());
+					CHECK(scalarRun(str, begin, predicate) == static_cast<size_t>(p - str.data()));
+				}
+			}
+		}
+	}
+
+}
+
+TEST_CASE("ScanTest_Spaces") {
+	checkScanner(" \t\n\v\f\r", string("a/\x80\x1f\x0e", 5) + '\0', scan::skipSpaces, isSpace);
+}
+
+TEST_CASE("ScanTest_IdentifierChars") {
+	checkScanner("azAZ_09'xyz", string(" ;`{@[/:\xe9", 9) + '\0', scan::skipIdentifierChars, isIdentifierChar);
+}
+
+TEST_CASE("ScanTest_Digits") {
+	checkScanner("0123456789", string(" a/:\xb0", 5), scan::skipDigits, isDigit);
+}
+
+TEST_CASE("ScanTest_LineEnd") {
+	checkScanner("// comment \"text\" \t\x80", "\r\n", scan::findLineEnd, isNotLineEnd);
+}
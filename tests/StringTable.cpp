@@ -0,0 +1,68 @@
+#include "catch.hpp"
+
+#include <parser.h>
+#include <stringtable.h>
+
+#include <string>
+
+#include <boost/variant/get.hpp>
+
+using namespace marklar;
+using namespace parser;
+using namespace std;
+
+
+TEST_CASE("StringTableInterning") {
+	const interned_string a1("stringTableName");
+	const interned_string a2(string("stringTableName"));
+	const interned_string b("stringTableOther");
+
+	CHECK(a1 == a2);
+	CHECK(a1.id() == a2.id());
+	CHECK(a1 != b);
+	CHECK(a1.str() == "stringTableName");
+	CHECK(b == "stringTableOther");
+
+	// Interning an existing string doesn't grow the table
+	const size_t count = internedStringCount();
+	const interned_string a3("stringTableName");
+	CHECK(count == internedStringCount());
+	CHECK(a1 == a3);
+
+	CHECK(interned_string().empty());
+	CHECK(interned_string("") == interned_string());
+}
+
+TEST_CASE("StringTableParsedNames") {
+	const auto testProgram =
+		"i32 main() {"
+		"  i32 a = 1;"
+		"  return a;"
+		"}";
+
+	base_expr_node root;
+	REQUIRE(parse(testProgram, root));
+
+	base_expr* expr = boost::get<base_expr>(&root);
+	REQUIRE(expr != nullptr);
+
+	func_expr* func = boost::get<func_expr>(&expr->children[0]);
+	REQUIRE(func != nullptr);
+	REQUIRE(func->expressions.size() == 2);
+
+	decl_expr* decl = boost::get<decl_expr>(&func->expressions[0]);
+	REQUIRE(decl != nullptr);
+
+	return_expr* ret = boost::get<return_expr>(&func->expressions[1]);
+	REQUIRE(ret != nullptr);
+
+	binary_op* retOp = boost::get<binary_op>(&ret->ret);
+	REQUIRE(retOp != nullptr);
+
+	interned_string* retName = boost::get<interned_string>(&retOp->lhs);
+	REQUIRE(retName != nullptr);
+
+	// Both uses of 'a' share one id
+	CHECK(decl->declName.id() == retName->id());
+	CHECK(func->functionName == interned_string("main"));
+}
@@ -0,0 +1,57 @@
+#include "catch.hpp"
+
+#include <symboltable.h>
+
+#include <string>
+
+using namespace marklar;
+using namespace std;
+
+
+TEST_CASE("SymbolTableShadowing") {
+	symbol_table table;
+
+	symbol outer;
+	outer.ssaVariable = 1;
+	table.set("a", outer);
+
+	{
+		symbol_table::scope inner(table);
+
+		CHECK(1 == table.find("a")->ssaVariable);
+
+		symbol shadow;
+		shadow.ssaVariable = 2;
+		table.set("a", shadow);
+		table.set("b", shadow);
+
+		CHECK(2 == table.find("a")->ssaVariable);
+		CHECK(table.contains("b"));
+		CHECK(2 == table.size());
+	}
+
+	// Leaving the scope uncovers the outer binding and drops the inner-only names
+	CHECK(1 == table.find("a")->ssaVariable);
+	CHECK_FALSE(table.contains("b"));
+	CHECK(1 == table.size());
+}
+
+TEST_CASE("SymbolTableRebindSameScope") {
+	symbol_table table;
+	table.pushScope();
+
+	symbol first;
+	first.ssaVariable = 1;
+	table.set("a", first);
+
+	symbol second;
+	second.ssaVariable = 2;
+	table.set("a", second);
+
+	CHECK(2 == table.find("a")->ssaVariable);
+
+	// Rebinding in the same scope replaces rather than shadows, nothing is left behind
+	table.popScope();
+	CHECK(nullptr == table.find("a"));
+	CHECK(0 == table.size());
+}